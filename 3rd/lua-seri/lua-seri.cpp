@@ -15,9 +15,11 @@
 #    include <lua.h>
 #endif
 #include <stdlib.h>
+#include <limits.h>
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <atomic>
 
 #define TYPE_BOOLEAN 0
 
@@ -34,12 +36,26 @@
 #define TYPE_NUMBER_DWORD 4
 #define TYPE_NUMBER_QWORD 6
 #define TYPE_NUMBER_REAL 8
+// hibits 16 | (byte, word, dword, qword, real) : packed number array
+// only appears as the first element of a table, and covers the whole array part
+#define TYPE_NUMBER_ARRAY 16
+// hibits 15 : hash part size of a table, followed by an integer
+// only appears right after the table header
+#define TYPE_NUMBER_HASH 15
 
 #define TYPE_USERDATA 2
 // hibits 0 : void *
 // hibits 1 : c function
+// hibits 2 : full userdata, followed by the id of __deseri (see seri_register) and the value returned by __seri
+// hibits 3 : lua function, followed by bytecode, upvalue count and upvalues
+// hibits 4 : upvalue is the global table
+// hibits 5 : upvalue is the function itself
 #define TYPE_USERDATA_POINTER 0
 #define TYPE_USERDATA_CFUNCTION 1
+#define TYPE_USERDATA_FULL 2
+#define TYPE_USERDATA_LUAFUNCTION 3
+#define TYPE_USERDATA_GLOBALS 4
+#define TYPE_USERDATA_SELF 5
 
 #define TYPE_SHORT_STRING 3
 // hibits 0~31 : len
@@ -61,6 +77,10 @@
 
 #define MAX_REFERENCE 32
 
+#define MIN_NUMBER_ARRAY 8
+
+#define MAX_DESERIALIZER 64
+
 struct block {
 	struct block * next;
 	char buffer[BLOCK_SIZE];
@@ -83,15 +103,23 @@ struct write_block {
 	struct block * current;
 	int len;
 	int ptr;
+	int function_depth;
 	struct stack s;
 	struct reference r[MAX_REFERENCE];
 };
 
+struct slot {
+	struct block * b;
+	int ptr;
+};
+
 struct read_block {
 	char * buffer;
 	int len;
 	int ptr;
 	struct stack s;
+	int view;	// stack index of the view being unpacked, 0 for none
+	int plain;	// only nil, boolean, number, string and table are accepted
 };
 
 inline static struct block *
@@ -132,6 +160,21 @@ wb_address(struct write_block *b) {
 	return (void *)(b->current->buffer + b->ptr);
 }
 
+static void
+wb_patch(struct slot *slot, const void *buf, int sz) {
+	const char * buffer = (const char *)buf;
+	struct block *b = slot->b;
+	int ptr = slot->ptr;
+	int i;
+	for (i=0;i<sz;i++) {
+		if (ptr == BLOCK_SIZE) {
+			b = b->next;
+			ptr = 0;
+		}
+		b->buffer[ptr++] = buffer[i];
+	}
+}
+
 static inline void
 init_stack(struct stack *s) {
 	s->depth = 0;
@@ -146,6 +189,7 @@ wb_init(struct write_block *wb , struct block *b) {
 	wb->len = 0;
 	wb->current = wb->head;
 	wb->ptr = 0;
+	wb->function_depth = 0;
 	init_stack(&wb->s);
 }
 
@@ -169,6 +213,8 @@ rball_init(struct read_block * rb, char * buffer, int size) {
 	rb->buffer = buffer;
 	rb->len = size;
 	rb->ptr = 0;
+	rb->view = 0;
+	rb->plain = 0;
 	init_stack(&rb->s);
 }
 
@@ -271,8 +317,158 @@ wb_string(struct write_block *wb, const char *str, int len) {
 
 static void pack_one(lua_State *L, struct write_block *b, int index);
 
+static inline int
+number_array_width(int cookie) {
+	switch (cookie & ~TYPE_NUMBER_ARRAY) {
+	case TYPE_NUMBER_BYTE:
+		return 1;
+	case TYPE_NUMBER_WORD:
+		return 2;
+	case TYPE_NUMBER_DWORD:
+		return 4;
+	case TYPE_NUMBER_QWORD:
+	case TYPE_NUMBER_REAL:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+union number_slot {
+	lua_Integer i;
+	double d;
+};
+
+// Narrows v[i].i to width bytes in place. Element i is read before its
+// bytes are written, and the output never overtakes the input, so the
+// stores go through memcpy instead of a punned pointer.
+static void
+narrow_integers(union number_slot *v, int array_size, int width) {
+	uint8_t *out = (uint8_t *)v;
+	int i;
+	for (i=0;i<array_size;i++) {
+		lua_Integer x = v[i].i;
+		switch (width) {
+		case 1: {
+			uint8_t y = (uint8_t)x;
+			memcpy(out + i, &y, 1);
+			break;
+		}
+		case 2: {
+			uint16_t y = (uint16_t)x;
+			memcpy(out + (size_t)i * 2, &y, 2);
+			break;
+		}
+		default: {
+			int32_t y = (int32_t)x;
+			memcpy(out + (size_t)i * 4, &y, 4);
+			break;
+		}
+		}
+	}
+}
+
+static int
+wb_number_array(lua_State *L, struct write_block *wb, int index, int array_size) {
+	// Most arrays hold tables or strings; look before allocating.
+	if (lua_rawgeti(L,index,1) != LUA_TNUMBER) {
+		lua_pop(L,1);
+		return 0;
+	}
+	lua_pop(L,1);
+	union number_slot *v = (union number_slot *)malloc(sizeof(union number_slot) * array_size);
+	if (v == NULL) {
+		return 0;
+	}
+	int isinteger = 0;
+	lua_Integer min = 0;
+	lua_Integer max = 0;
+	int i;
+	for (i=0;i<array_size;i++) {
+		if (lua_rawgeti(L,index,i+1) != LUA_TNUMBER) {
+			lua_pop(L,1);
+			free(v);
+			return 0;
+		}
+		if (lua_isinteger(L,-1)) {
+			lua_Integer x = lua_tointeger(L,-1);
+			if (i == 0) {
+				isinteger = 1;
+				min = max = x;
+			} else if (!isinteger) {
+				lua_pop(L,1);
+				free(v);
+				return 0;
+			} else if (x < min) {
+				min = x;
+			} else if (x > max) {
+				max = x;
+			}
+			v[i].i = x;
+		} else {
+			if (isinteger) {
+				lua_pop(L,1);
+				free(v);
+				return 0;
+			}
+			v[i].d = (double)lua_tonumber(L,-1);
+		}
+		lua_pop(L,1);
+	}
+	int cookie;
+	if (!isinteger) {
+		cookie = TYPE_NUMBER_REAL;
+	} else if (min >= 0 && max < 0x100) {
+		narrow_integers(v, array_size, 1);
+		cookie = TYPE_NUMBER_BYTE;
+	} else if (min >= 0 && max < 0x10000) {
+		narrow_integers(v, array_size, 2);
+		cookie = TYPE_NUMBER_WORD;
+	} else if (min >= INT32_MIN && max <= INT32_MAX) {
+		narrow_integers(v, array_size, 4);
+		cookie = TYPE_NUMBER_DWORD;
+	} else {
+		cookie = TYPE_NUMBER_QWORD;
+	}
+	size_t bytes = (size_t)number_array_width(cookie) * (size_t)array_size;
+	if (bytes > INT_MAX) {
+		// wb_push takes an int; let the caller encode element by element.
+		free(v);
+		return 0;
+	}
+	uint8_t n = COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_ARRAY | cookie);
+	wb_push(wb, &n, 1);
+	wb_push(wb, v, (int)bytes);
+	free(v);
+	return 1;
+}
+
 static int
-wb_table_array(lua_State *L, struct write_block * wb, int index) {
+has_hash(lua_State *L, int index, int array_size) {
+	// Start after the array part, so a pure array costs a single lua_next.
+	// If the border lives in the hash part, some keys may be skipped,
+	// which only drops the hint.
+	if (array_size > 0) {
+		lua_pushinteger(L, array_size);
+	} else {
+		lua_pushnil(L);
+	}
+	while (lua_next(L, index) != 0) {
+		lua_pop(L, 1);
+		if (lua_isinteger(L, -1)) {
+			lua_Integer x = lua_tointeger(L, -1);
+			if (x>0 && x<=array_size) {
+				continue;
+			}
+		}
+		lua_pop(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+wb_table_array(lua_State *L, struct write_block * wb, int index, struct slot *slot) {
 	int array_size = (int)lua_rawlen(L,index);
 	if (array_size >= EXTEND_NUMBER) {
 		uint8_t n = COMBINE_TYPE(TYPE_TABLE, EXTEND_NUMBER);
@@ -283,6 +479,23 @@ wb_table_array(lua_State *L, struct write_block * wb, int index) {
 		wb_push(wb, &n, 1);
 	}
 
+	if (has_hash(L, index, array_size)) {
+		uint8_t n[2] = {
+			COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_HASH),
+			COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_DWORD),
+		};
+		wb_push(wb, n, 2);
+		int32_t zero = 0;
+		wb_address(wb);
+		slot->b = wb->current;
+		slot->ptr = wb->ptr;
+		wb_push(wb, &zero, sizeof(zero));
+	}
+
+	if (array_size >= MIN_NUMBER_ARRAY && wb_number_array(L, wb, index, array_size)) {
+		return array_size;
+	}
+
 	int i;
 	for (i=1;i<=array_size;i++) {
 		lua_rawgeti(L,index,i);
@@ -294,7 +507,8 @@ wb_table_array(lua_State *L, struct write_block * wb, int index) {
 }
 
 static void
-wb_table_hash(lua_State *L, struct write_block * wb, int index, int array_size) {
+wb_table_hash(lua_State *L, struct write_block * wb, int index, int array_size, struct slot *slot) {
+	int32_t hash_size = 0;
 	lua_pushnil(L);
 	while (lua_next(L, index) != 0) {
 		if (lua_type(L,-2) == LUA_TNUMBER) {
@@ -309,8 +523,12 @@ wb_table_hash(lua_State *L, struct write_block * wb, int index, int array_size)
 		pack_one(L,wb,-2);
 		pack_one(L,wb,-1);
 		lua_pop(L, 1);
+		hash_size++;
 	}
 	wb_nil(wb);
+	if (slot->b) {
+		wb_patch(slot, &hash_size, sizeof(hash_size));
+	}
 }
 
 static void
@@ -379,8 +597,9 @@ wb_table(lua_State *L, struct write_block *wb, int index) {
 	if (luaL_getmetafield(L, index, "__pairs") != LUA_TNIL) {
 		wb_table_metapairs(L, wb, index);
 	} else {
-		int array_size = wb_table_array(L, wb, index);
-		wb_table_hash(L, wb, index, array_size);
+		struct slot slot = { NULL, 0 };
+		int array_size = wb_table_array(L, wb, index, &slot);
+		wb_table_hash(L, wb, index, array_size, &slot);
 	}
 }
 
@@ -457,6 +676,150 @@ ref_object(lua_State *L, struct write_block *b, int index) {
 	}
 }
 
+// Process wide, so that an id packed by one thread resolves in another.
+// Slots are only ever filled, never cleared.
+// A userdata packs only if its __deseri is a C function registered here
+// with seri_register; a Lua function or an unregistered C function fails
+// with "Unsupport type".
+static std::atomic<lua_CFunction> deserializer[MAX_DESERIALIZER];
+
+int
+seri_register(lua_CFunction f) {
+	int i;
+	if (f == NULL) {
+		return -1;
+	}
+	for (i=0;i<MAX_DESERIALIZER;i++) {
+		lua_CFunction expected = NULL;
+		if (deserializer[i].compare_exchange_strong(expected, f) || expected == f) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int
+deserializer_id(lua_CFunction f) {
+	int i;
+	if (f == NULL) {
+		return -1;
+	}
+	for (i=0;i<MAX_DESERIALIZER;i++) {
+		lua_CFunction slot = deserializer[i].load();
+		if (slot == f) {
+			return i;
+		}
+		if (slot == NULL) {
+			break;
+		}
+	}
+	return -1;
+}
+
+static int function_key = 0;
+
+void
+seri_enablefunction(lua_State *L, int enable) {
+	lua_pushboolean(L, enable);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &function_key);
+}
+
+static int
+isenablefunction(lua_State *L) {
+	int enable = lua_rawgetp(L, LUA_REGISTRYINDEX, &function_key) == LUA_TBOOLEAN && lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	return enable;
+}
+
+struct function_writer {
+	int init;
+	luaL_Buffer b;
+};
+
+static int
+function_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+	struct function_writer *w = (struct function_writer *)ud;
+	if (!w->init) {
+		w->init = 1;
+		luaL_buffinit(L, &w->b);
+	}
+	luaL_addlstring(&w->b, (const char *)p, sz);
+	return 0;
+}
+
+static void
+wb_function(lua_State *L, struct write_block *b, int index) {
+	if (b->function_depth >= MAX_DEPTH) {
+		wb_free(b);
+		luaL_error(L, "Too many nested functions to serialize");
+	}
+	luaL_checkstack(L, LUA_MINSTACK, NULL);
+	uint8_t n = COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_LUAFUNCTION);
+	wb_push(b, &n, 1);
+
+	struct function_writer w;
+	w.init = 0;
+	lua_pushvalue(L, index);
+	lua_dump(L, function_writer, &w, 0);
+	luaL_pushresult(&w.b);
+	size_t sz = 0;
+	const char *code = lua_tolstring(L, -1, &sz);
+	wb_string(b, code, (int)sz);
+	lua_pop(L, 2);
+
+	lua_Debug ar;
+	lua_pushvalue(L, index);
+	lua_getinfo(L, ">u", &ar);
+	wb_integer(b, ar.nups);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+	int globals = lua_gettop(L);
+	++b->function_depth;
+	int i;
+	for (i=1;i<=ar.nups;i++) {
+		lua_getupvalue(L, index, i);
+		if (lua_rawequal(L, -1, globals)) {
+			n = COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_GLOBALS);
+			wb_push(b, &n, 1);
+		} else if (lua_rawequal(L, -1, index)) {
+			n = COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_SELF);
+			wb_push(b, &n, 1);
+		} else {
+			pack_one(L, b, -1);
+		}
+		lua_pop(L, 1);
+	}
+	--b->function_depth;
+	lua_pop(L, 1);
+}
+
+static void
+wb_userdata(lua_State *L, struct write_block *b, int index) {
+	luaL_checkstack(L, LUA_MINSTACK, NULL);
+	if (luaL_getmetafield(L, index, "__seri") == LUA_TNIL) {
+		wb_free(b);
+		luaL_error(L, "Unsupport type %s to serialize", lua_typename(L, LUA_TUSERDATA));
+	}
+	int id = -1;
+	if (luaL_getmetafield(L, index, "__deseri") != LUA_TNIL) {
+		id = deserializer_id(lua_tocfunction(L, -1));
+		lua_pop(L, 1);
+	}
+	if (id < 0) {
+		wb_free(b);
+		luaL_error(L, "Unsupport type %s to serialize", lua_typename(L, LUA_TUSERDATA));
+	}
+	uint8_t n = COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_FULL);
+	wb_push(b, &n, 1);
+	wb_integer(b, id);
+	lua_pushvalue(L, index);
+	if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+		wb_free(b);
+		lua_error(L);
+	}
+	pack_one(L, b, -1);
+	lua_pop(L, 1);
+}
+
 static void
 pack_one(lua_State *L, struct write_block *b, int index) {
 	struct stack *s = &b->s;
@@ -488,12 +851,25 @@ pack_one(lua_State *L, struct write_block *b, int index) {
 		wb_pointer(b, lua_touserdata(L,index), TYPE_USERDATA_POINTER);
 		break;
 	case LUA_TFUNCTION: {
+		if (index < 0) {
+			index = lua_gettop(L) + index + 1;
+		}
 		lua_CFunction func = lua_tocfunction(L,index);
-		if (func == NULL || lua_getupvalue(L, index, 1) != NULL) {
+		if (func != NULL && lua_getupvalue(L, index, 1) == NULL) {
+			wb_pointer(b, (void *)func, TYPE_USERDATA_CFUNCTION);
+			break;
+		}
+		if (func != NULL || !isenablefunction(L)) {
 			luaL_error(L, "Only light C function can be serialized");
 		}
-		wb_pointer(b, (void *)func, TYPE_USERDATA_CFUNCTION);
+		wb_function(L, b, index);
 		break; }
+	case LUA_TUSERDATA:
+		if (index < 0) {
+			index = lua_gettop(L) + index + 1;
+		}
+		wb_userdata(L, b, index);
+		break;
 	case LUA_TTABLE: {
 		if (index < 0) {
 			index = lua_gettop(L) + index + 1;
@@ -609,6 +985,41 @@ get_buffer(lua_State *L, struct read_block *rb, int len) {
 	lua_pushlstring(L,p,len);
 }
 
+static int
+rb_byte(lua_State *L, struct read_block *rb) {
+	const uint8_t *t = (const uint8_t *)rb_read(rb, 1);
+	if (t == NULL) {
+		invalid_stream(L, rb);
+	}
+	return *t;
+}
+
+static int
+get_string_length(lua_State *L, struct read_block *rb, int type, int cookie) {
+	if (type == TYPE_SHORT_STRING) {
+		return cookie;
+	}
+	if (cookie == 2) {
+		const void *plen = rb_read(rb, 2);
+		if (plen == NULL) {
+			invalid_stream(L,rb);
+		}
+		uint16_t n;
+		memcpy(&n, plen, sizeof(n));
+		return n;
+	}
+	if (cookie != 4) {
+		invalid_stream(L,rb);
+	}
+	const void *plen = rb_read(rb, 4);
+	if (plen == NULL) {
+		invalid_stream(L,rb);
+	}
+	uint32_t n;
+	memcpy(&n, plen, sizeof(n));
+	return (int)n;
+}
+
 static void unpack_one(lua_State *L, struct read_block *rb);
 
 static int
@@ -626,15 +1037,101 @@ get_extend_integer(lua_State *L, struct read_block *rb) {
 	return (int)get_integer(L,rb,cookie);
 }
 
+static int
+rb_peek_hash_size(struct read_block *rb) {
+	if (rb->len < 1) {
+		return 0;
+	}
+	uint8_t type = (uint8_t)rb->buffer[rb->ptr];
+	return type == COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_HASH);
+}
+
+static int
+rb_peek_number_array(struct read_block *rb) {
+	if (rb->len < 1) {
+		return 0;
+	}
+	uint8_t type = (uint8_t)rb->buffer[rb->ptr];
+	int cookie = type >> 3;
+	if ((type & 7) != TYPE_NUMBER || !(cookie & TYPE_NUMBER_ARRAY)) {
+		return 0;
+	}
+	return cookie;
+}
+
+static void
+unpack_number_array(lua_State *L, struct read_block *rb, int array_size, int cookie) {
+	int width = number_array_width(cookie);
+	if (width == 0 || array_size > (rb->len - 1) / width) {
+		invalid_stream(L,rb);
+	}
+	rb_read(rb, 1);
+	const uint8_t *p = (const uint8_t *)rb_read(rb, width * array_size);
+	int i;
+	switch (cookie & ~TYPE_NUMBER_ARRAY) {
+	case TYPE_NUMBER_BYTE:
+		for (i=1;i<=array_size;i++) {
+			lua_pushinteger(L, p[i-1]);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_NUMBER_WORD:
+		for (i=1;i<=array_size;i++) {
+			uint16_t n;
+			memcpy(&n, p + (i-1) * sizeof(n), sizeof(n));
+			lua_pushinteger(L, n);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_NUMBER_DWORD:
+		for (i=1;i<=array_size;i++) {
+			int32_t n;
+			memcpy(&n, p + (i-1) * sizeof(n), sizeof(n));
+			lua_pushinteger(L, n);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_NUMBER_QWORD:
+		for (i=1;i<=array_size;i++) {
+			int64_t n;
+			memcpy(&n, p + (i-1) * sizeof(n), sizeof(n));
+			lua_pushinteger(L, (lua_Integer)n);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_NUMBER_REAL:
+		for (i=1;i<=array_size;i++) {
+			double n;
+			memcpy(&n, p + (i-1) * sizeof(n), sizeof(n));
+			lua_pushnumber(L, n);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	default:
+		invalid_stream(L,rb);
+	}
+}
+
 static void
 unpack_table(lua_State *L, struct read_block *rb, int array_size, int type) {
 	if (array_size == EXTEND_NUMBER) {
 		array_size = get_extend_integer(L, rb);
+		if (array_size < 0 || array_size > rb->len) {
+			invalid_stream(L,rb);
+		}
+	}
+	int hash_size = 0;
+	if (rb_peek_hash_size(rb)) {
+		rb_read(rb, 1);
+		hash_size = get_extend_integer(L, rb);
+		if (hash_size < 0 || hash_size > rb->len) {
+			invalid_stream(L,rb);
+		}
 	}
 	struct stack *s = &rb->s;
 	int id = ++s->objectid;
 	luaL_checkstack(L,LUA_MINSTACK,NULL);
-	lua_createtable(L,array_size,0);
+	lua_createtable(L,array_size,hash_size);
 	if (type == TYPE_TABLE_MARK) {
 		lua_pushvalue(L, -1);
 		if (lua_type(L, s->ref_index) == LUA_TNIL) {
@@ -646,10 +1143,15 @@ unpack_table(lua_State *L, struct read_block *rb, int array_size, int type) {
 	if (s->depth < MAX_DEPTH)
 		s->ancestor[s->depth] = lua_gettop(L);
 	++s->depth;
-	int i;
-	for (i=1;i<=array_size;i++) {
-		unpack_one(L,rb);
-		lua_rawseti(L,-2,i);
+	int cookie = array_size > 0 ? rb_peek_number_array(rb) : 0;
+	if (cookie) {
+		unpack_number_array(L, rb, array_size, cookie);
+	} else {
+		int i;
+		for (i=1;i<=array_size;i++) {
+			unpack_one(L,rb);
+			lua_rawseti(L,-2,i);
+		}
 	}
 	--s->depth;
 	for (;;) {
@@ -665,14 +1167,25 @@ unpack_table(lua_State *L, struct read_block *rb, int array_size, int type) {
 	}
 }
 
+static void view_locate(lua_State *L, int index, int id);
+
 static void
 unpack_ref(lua_State *L, struct read_block *rb, int ref) {
 	struct stack *s = &rb->s;
 	if (ref == EXTEND_NUMBER) {
 		int id = get_extend_integer(L, rb);
-		if (lua_type(L, s->ref_index) != LUA_TTABLE || lua_rawgeti(L, s->ref_index, id) != LUA_TTABLE) {
-			luaL_error(L, "Invalid ref object id %d", id);
+		if (lua_type(L, s->ref_index) == LUA_TTABLE) {
+			if (lua_rawgeti(L, s->ref_index, id) == LUA_TTABLE) {
+				return;
+			}
+			lua_pop(L, 1);
 		}
+		if (rb->view) {
+			// reference to an object outside of the view
+			view_locate(L, rb->view, id);
+			return;
+		}
+		luaL_error(L, "Invalid ref object id %d", id);
 	} else {
 		if (ref >= s->depth)
 			luaL_error(L, "Invalid ref object %d/%d", ref, s->depth);
@@ -680,6 +1193,62 @@ unpack_ref(lua_State *L, struct read_block *rb, int ref) {
 	}
 }
 
+static void
+unpack_function(lua_State *L, struct read_block *rb) {
+	if (!isenablefunction(L)) {
+		luaL_error(L, "Lua function can't be deserialized");
+	}
+	luaL_checkstack(L, LUA_MINSTACK, NULL);
+	int tag = rb_byte(L, rb);
+	int type = tag & 0x7;
+	if (type != TYPE_SHORT_STRING && type != TYPE_LONG_STRING) {
+		invalid_stream(L, rb);
+	}
+	int len = get_string_length(L, rb, type, tag >> 3);
+	const char *code = (const char *)rb_read(rb, len);
+	if (code == NULL) {
+		invalid_stream(L, rb);
+	}
+	if (luaL_loadbufferx(L, code, len, "=(seri)", "b") != LUA_OK) {
+		lua_error(L);
+	}
+	int f = lua_gettop(L);
+	int n = get_extend_integer(L, rb);
+	int i;
+	for (i=1;i<=n;i++) {
+		uint8_t t = rb->len > 0 ? (uint8_t)rb->buffer[rb->ptr] : 0;
+		if (t == COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_GLOBALS)) {
+			rb_read(rb, 1);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+		} else if (t == COMBINE_TYPE(TYPE_USERDATA, TYPE_USERDATA_SELF)) {
+			rb_read(rb, 1);
+			lua_pushvalue(L, f);
+		} else {
+			unpack_one(L, rb);
+		}
+		if (lua_setupvalue(L, f, i) == NULL) {
+			invalid_stream(L, rb);
+		}
+	}
+}
+
+static void
+unpack_userdata(lua_State *L, struct read_block *rb) {
+	luaL_checkstack(L, LUA_MINSTACK, NULL);
+	int tag = rb_byte(L, rb);
+	if ((tag & 0x7) != TYPE_NUMBER || (tag >> 3) == TYPE_NUMBER_REAL) {
+		luaL_error(L, "Invalid userdata");
+	}
+	lua_Integer id = get_integer(L, rb, tag >> 3);
+	lua_CFunction f = (id >= 0 && id < MAX_DESERIALIZER) ? deserializer[id].load() : NULL;
+	if (f == NULL) {
+		luaL_error(L, "Invalid userdata");
+	}
+	lua_pushcfunction(L, f);
+	unpack_one(L, rb);
+	lua_call(L, 1, 1);
+}
+
 static void
 push_value(lua_State *L, struct read_block *rb, int type, int cookie) {
 	switch(type) {
@@ -706,12 +1275,24 @@ push_value(lua_State *L, struct read_block *rb, int type, int cookie) {
 		}
 		break;
 	case TYPE_USERDATA:
-		if (cookie == TYPE_USERDATA_POINTER)
+		if (rb->plain) {
+			luaL_error(L, "Userdata can't be deserialized");
+		}
+		switch (cookie) {
+		case TYPE_USERDATA_POINTER:
 			lua_pushlightuserdata(L,get_pointer(L,rb));
-		else {
-			if (cookie != TYPE_USERDATA_CFUNCTION)
-				luaL_error(L, "Invalid userdata");
+			break;
+		case TYPE_USERDATA_CFUNCTION:
 			lua_pushcfunction(L, (lua_CFunction)get_pointer(L, rb));
+			break;
+		case TYPE_USERDATA_FULL:
+			unpack_userdata(L, rb);
+			break;
+		case TYPE_USERDATA_LUAFUNCTION:
+			unpack_function(L, rb);
+			break;
+		default:
+			luaL_error(L, "Invalid userdata");
 		}
 		break;
 	case TYPE_SHORT_STRING:
@@ -764,9 +1345,8 @@ unpack_one(lua_State *L, struct read_block *rb) {
 	push_value(L, rb, type & 0x7, type>>3);
 }
 
-static void *
-seri(struct block *b, int len) {
-	uint8_t * buffer = (uint8_t *)malloc(len + 4);
+static void
+seri_copy(uint8_t *buffer, struct block *b, int len) {
 	memcpy(buffer, &len, 4);	// write length
 	uint8_t * ptr = buffer + 4;
 	while(len>0) {
@@ -780,18 +1360,24 @@ seri(struct block *b, int len) {
 			break;
 		}
 	}
+}
 
+static void *
+seri(struct block *b, int len) {
+	uint8_t * buffer = (uint8_t *)malloc(len + 4);
+	seri_copy(buffer, b, len);
 	return buffer;
 }
 
-int
-seri_unpack(lua_State *L, void *buffer) {
+static int
+unpack_buffer(lua_State *L, void *buffer, int plain) {
 	int top = lua_gettop(L);
 	int len = 0;
 	memcpy(&len, buffer, 4);	// get length
 
 	struct read_block rb;
 	rball_init(&rb, (char *)buffer + 4, len);
+	rb.plain = plain;
 	lua_pushnil(L);	// slot for ref table
 	rb.s.ref_index = top + 1;
 
@@ -811,6 +1397,18 @@ seri_unpack(lua_State *L, void *buffer) {
 	return lua_gettop(L) - 1 - top;
 }
 
+int
+seri_unpack(lua_State *L, void *buffer) {
+	return unpack_buffer(L, buffer, 0);
+}
+
+// For buffers from an untrusted peer: pointers, C functions, userdata and
+// Lua functions are rejected instead of being rebuilt.
+int
+seri_unpackplain(lua_State *L, void *buffer) {
+	return unpack_buffer(L, buffer, 1);
+}
+
 static int
 seri_unpack_(lua_State *L) {
 	void *buffer = lua_touserdata(L, 1);
@@ -864,6 +1462,26 @@ seri_pack(lua_State *L, int from, int *sz) {
 	return buffer;
 }
 
+void *
+seri_packto(lua_State *L, int from, void *(*alloc)(void *ud, int sz), void *ud) {
+	struct block temp;
+	temp.next = NULL;
+	struct write_block wb;
+	wb_init(&wb, &temp);
+
+	pack_from(L,&wb,from);
+	assert(wb.head == &temp);
+
+	uint8_t * buffer = (uint8_t *)alloc(ud, wb.len + 4);
+	if (buffer) {
+		seri_copy(buffer, &temp, wb.len);
+	}
+
+	wb_free(&wb);
+
+	return buffer;
+}
+
 void *
 seri_packstring(const char * str, int sz) {
 	struct block temp;
@@ -881,6 +1499,504 @@ seri_packstring(const char * str, int sz) {
 	return buffer;
 }
 
+/*
+	view : index into a packed buffer without unpacking it.
+ */
+
+#define VIEW_NAME "bee::serialization::view"
+
+struct view_node {
+	int offset;	// offset of the table tag
+	int id;	// object id of the table
+};
+
+struct seri_view {
+	const char * buffer;
+	int len;
+	int depth;
+	struct view_node ancestor[MAX_DEPTH+1];	// ancestor[min(depth, MAX_DEPTH)] is the view itself
+};
+
+struct view_walk {
+	int objectid;
+	int depth;
+	struct view_node ancestor[MAX_DEPTH];
+	int target;
+	struct seri_view *found;
+};
+
+static inline struct view_node *
+view_self(struct seri_view *v) {
+	return &v->ancestor[v->depth < MAX_DEPTH ? v->depth : MAX_DEPTH];
+}
+
+static void
+rb_view_init(struct read_block *rb, const struct seri_view *v, int offset) {
+	rball_init(rb, (char *)v->buffer, v->len);
+	rb->ptr = offset;
+	rb->len = v->len - offset;
+}
+
+static void
+rb_skip(lua_State *L, struct read_block *rb, int sz) {
+	if (sz < 0 || rb_read(rb, sz) == NULL) {
+		invalid_stream(L, rb);
+	}
+}
+
+static int walk_one(lua_State *L, struct read_block *rb, struct view_walk *w);
+
+static void
+walk_found(struct view_walk *w, struct view_node node) {
+	struct seri_view *v = w->found;
+	int depth = w->depth < MAX_DEPTH ? w->depth : MAX_DEPTH;
+	v->depth = w->depth;
+	memcpy(v->ancestor, w->ancestor, depth * sizeof(struct view_node));
+	v->ancestor[depth] = node;
+}
+
+// Read the rest of the table header, returns the array size.
+static int
+walk_table_header(lua_State *L, struct read_block *rb, int cookie) {
+	int array_size = cookie;
+	if (array_size == EXTEND_NUMBER) {
+		array_size = get_extend_integer(L, rb);
+	}
+	if (rb_peek_hash_size(rb)) {
+		rb_read(rb, 1);
+		get_extend_integer(L, rb);
+	}
+	return array_size;
+}
+
+static void
+walk_skip_number_array(lua_State *L, struct read_block *rb, int array_size, int cookie) {
+	int width = number_array_width(cookie);
+	if (width == 0 || array_size > (rb->len - 1) / width) {
+		invalid_stream(L,rb);
+	}
+	rb_skip(L, rb, 1 + width * array_size);
+}
+
+static int
+walk_table(lua_State *L, struct read_block *rb, struct view_walk *w, int cookie, int offset) {
+	int array_size = walk_table_header(L, rb, cookie);
+	struct view_node node = { offset, ++w->objectid };
+	if (node.id == w->target) {
+		walk_found(w, node);
+		return 1;
+	}
+	if (w->depth < MAX_DEPTH)
+		w->ancestor[w->depth] = node;
+	++w->depth;
+	int array_cookie = array_size > 0 ? rb_peek_number_array(rb) : 0;
+	if (array_cookie) {
+		walk_skip_number_array(L, rb, array_size, array_cookie);
+	} else {
+		int i;
+		for (i=0;i<array_size;i++) {
+			if (walk_one(L, rb, w))
+				return 1;
+		}
+	}
+	for (;;) {
+		if (rb->len > 0 && (uint8_t)rb->buffer[rb->ptr] == COMBINE_TYPE(TYPE_BOOLEAN, TYPE_BOOLEAN_NIL)) {
+			rb_read(rb, 1);
+			break;
+		}
+		if (walk_one(L, rb, w))
+			return 1;
+		if (walk_one(L, rb, w))
+			return 1;
+	}
+	--w->depth;
+	return 0;
+}
+
+static int
+walk_value(lua_State *L, struct read_block *rb, struct view_walk *w, int tag) {
+	int type = tag & 0x7;
+	int cookie = tag >> 3;
+	switch (type) {
+	case TYPE_BOOLEAN:
+		break;
+	case TYPE_NUMBER:
+		if (cookie == TYPE_NUMBER_REAL) {
+			rb_skip(L, rb, sizeof(double));
+		} else {
+			get_integer(L, rb, cookie);
+		}
+		break;
+	case TYPE_USERDATA:
+		switch (cookie) {
+		case TYPE_USERDATA_POINTER:
+		case TYPE_USERDATA_CFUNCTION:
+			rb_skip(L, rb, sizeof(void *));
+			break;
+		case TYPE_USERDATA_FULL:
+			if (walk_one(L, rb, w))
+				return 1;
+			return walk_one(L, rb, w);
+		case TYPE_USERDATA_LUAFUNCTION: {
+			if (walk_one(L, rb, w))
+				return 1;
+			int n = get_extend_integer(L, rb);
+			int i;
+			for (i=0;i<n;i++) {
+				if (walk_one(L, rb, w))
+					return 1;
+			}
+			break;
+		}
+		case TYPE_USERDATA_GLOBALS:
+		case TYPE_USERDATA_SELF:
+			break;
+		default:
+			invalid_stream(L, rb);
+		}
+		break;
+	case TYPE_SHORT_STRING:
+	case TYPE_LONG_STRING:
+		rb_skip(L, rb, get_string_length(L, rb, type, cookie));
+		break;
+	case TYPE_TABLE:
+	case TYPE_TABLE_MARK:
+		return walk_table(L, rb, w, cookie, rb->ptr - 1);
+	case TYPE_REF:
+		if (cookie == EXTEND_NUMBER) {
+			get_extend_integer(L, rb);
+		}
+		break;
+	default:
+		invalid_stream(L, rb);
+	}
+	return 0;
+}
+
+static int
+walk_one(lua_State *L, struct read_block *rb, struct view_walk *w) {
+	return walk_value(L, rb, w, rb_byte(L, rb));
+}
+
+static struct seri_view *
+view_new(lua_State *L, const struct seri_view *from, int index) {
+	struct seri_view *v = (struct seri_view *)lua_newuserdatauv(L, sizeof(struct seri_view), 1);
+	v->buffer = from->buffer;
+	v->len = from->len;
+	v->depth = 0;
+	lua_getiuservalue(L, index, 1);
+	lua_setiuservalue(L, -2, 1);
+	luaL_setmetatable(L, VIEW_NAME);
+	return v;
+}
+
+static void
+view_locate(lua_State *L, int index, int id) {
+	const struct seri_view *from = (const struct seri_view *)lua_touserdata(L, index);
+	struct view_walk w;
+	w.objectid = 0;
+	w.depth = 0;
+	w.target = id;
+	w.found = view_new(L, from, index);
+	struct read_block rb;
+	rb_view_init(&rb, from, 0);
+	while (rb.len > 0) {
+		if (walk_one(L, &rb, &w))
+			return;
+		w.depth = 0;
+	}
+	luaL_error(L, "Invalid ref object id %d", id);
+}
+
+static void
+view_ancestor(lua_State *L, int index, int ref, const struct view_walk *w) {
+	if (ref >= w->depth)
+		luaL_error(L, "Invalid ref object %d/%d", ref, w->depth);
+	const struct seri_view *from = (const struct seri_view *)lua_touserdata(L, index);
+	struct seri_view *v = view_new(L, from, index);
+	v->depth = ref;
+	memcpy(v->ancestor, w->ancestor, (ref + 1) * sizeof(struct view_node));
+}
+
+// Push the value at rb, tables become views.
+static void
+view_push_value(lua_State *L, int index, struct read_block *rb, struct view_walk *w) {
+	int offset = rb->ptr;
+	int tag = rb_byte(L, rb);
+	int type = tag & 0x7;
+	int cookie = tag >> 3;
+	switch (type) {
+	case TYPE_TABLE:
+	case TYPE_TABLE_MARK: {
+		const struct seri_view *from = (const struct seri_view *)lua_touserdata(L, index);
+		struct view_node node = { offset, w->objectid + 1 };
+		w->found = view_new(L, from, index);
+		walk_found(w, node);
+		break;
+	}
+	case TYPE_REF:
+		if (cookie == EXTEND_NUMBER) {
+			view_locate(L, index, get_extend_integer(L, rb));
+		} else {
+			view_ancestor(L, index, cookie, w);
+		}
+		break;
+	default: {
+		int top = lua_gettop(L);
+		lua_pushnil(L);
+		rb->s.ref_index = top + 1;
+		push_value(L, rb, type, cookie);
+		lua_remove(L, top + 1);
+		break;
+	}
+	}
+}
+
+static int
+view_match_key(lua_State *L, struct read_block *rb, struct view_walk *w, int key) {
+	int tag = rb_byte(L, rb);
+	int type = tag & 0x7;
+	int cookie = tag >> 3;
+	switch (type) {
+	case TYPE_BOOLEAN:
+		return lua_type(L, key) == LUA_TBOOLEAN && cookie == (lua_toboolean(L, key) ? TYPE_BOOLEAN_TRUE : TYPE_BOOLEAN_FALSE);
+	case TYPE_NUMBER:
+		if (cookie == TYPE_NUMBER_REAL) {
+			double n = get_real(L, rb);
+			return lua_type(L, key) == LUA_TNUMBER && !lua_isinteger(L, key) && lua_tonumber(L, key) == n;
+		} else {
+			lua_Integer n = get_integer(L, rb, cookie);
+			return lua_isinteger(L, key) && lua_tointeger(L, key) == n;
+		}
+	case TYPE_SHORT_STRING:
+	case TYPE_LONG_STRING: {
+		int len = get_string_length(L, rb, type, cookie);
+		const char *str = (const char *)rb_read(rb, len);
+		if (str == NULL) {
+			invalid_stream(L, rb);
+		}
+		if (lua_type(L, key) != LUA_TSTRING) {
+			return 0;
+		}
+		size_t sz = 0;
+		const char *k = lua_tolstring(L, key, &sz);
+		return sz == (size_t)len && memcmp(k, str, len) == 0;
+	}
+	default:
+		walk_value(L, rb, w, tag);
+		return 0;
+	}
+}
+
+static struct seri_view *
+view_check(lua_State *L, int index) {
+	return (struct seri_view *)luaL_checkudata(L, index, VIEW_NAME);
+}
+
+// Position rb at the first element of the view, returns the array size.
+static int
+view_begin(lua_State *L, struct seri_view *v, struct read_block *rb, struct view_walk *w) {
+	struct view_node *self = view_self(v);
+	rb_view_init(rb, v, self->offset);
+	int tag = rb_byte(L, rb);
+	if ((tag & 0x7) != TYPE_TABLE && (tag & 0x7) != TYPE_TABLE_MARK) {
+		invalid_stream(L, rb);
+	}
+	int array_size = walk_table_header(L, rb, tag >> 3);
+	w->objectid = self->id;
+	w->depth = v->depth + 1;
+	w->target = 0;
+	w->found = NULL;
+	memcpy(w->ancestor, v->ancestor, (v->depth < MAX_DEPTH ? v->depth + 1 : MAX_DEPTH) * sizeof(struct view_node));
+	return array_size;
+}
+
+static int
+lview_index(lua_State *L) {
+	struct seri_view *v = view_check(L, 1);
+	struct read_block rb;
+	struct view_walk w;
+	int array_size = view_begin(L, v, &rb, &w);
+	int array_cookie = array_size > 0 ? rb_peek_number_array(&rb) : 0;
+	lua_Integer key = 0;
+	if (lua_isinteger(L, 2)) {
+		key = lua_tointeger(L, 2);
+	} else if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Number n = lua_tonumber(L, 2);
+		if (lua_numbertointeger(n, &key) && (lua_Number)key == n) {
+			lua_pushinteger(L, key);
+			lua_replace(L, 2);
+		} else {
+			key = 0;
+		}
+	}
+	if (key > 0 && key <= array_size) {
+		int i = (int)key;
+		if (array_cookie) {
+			int width = number_array_width(array_cookie);
+			if (width == 0 || array_size > (rb.len - 1) / width) {
+				invalid_stream(L, &rb);
+			}
+			const uint8_t *p = (const uint8_t *)rb.buffer + rb.ptr + 1 + (i-1) * width;
+			switch (array_cookie & ~TYPE_NUMBER_ARRAY) {
+			case TYPE_NUMBER_BYTE:
+				lua_pushinteger(L, *p);
+				break;
+			case TYPE_NUMBER_WORD: {
+				uint16_t n;
+				memcpy(&n, p, sizeof(n));
+				lua_pushinteger(L, n);
+				break;
+			}
+			case TYPE_NUMBER_DWORD: {
+				int32_t n;
+				memcpy(&n, p, sizeof(n));
+				lua_pushinteger(L, n);
+				break;
+			}
+			case TYPE_NUMBER_QWORD: {
+				int64_t n;
+				memcpy(&n, p, sizeof(n));
+				lua_pushinteger(L, (lua_Integer)n);
+				break;
+			}
+			default: {
+				double n;
+				memcpy(&n, p, sizeof(n));
+				lua_pushnumber(L, n);
+				break;
+			}
+			}
+			return 1;
+		}
+		for (;i>1;i--) {
+			walk_one(L, &rb, &w);
+		}
+		view_push_value(L, 1, &rb, &w);
+		return 1;
+	}
+	if (array_cookie) {
+		walk_skip_number_array(L, &rb, array_size, array_cookie);
+	} else {
+		int i;
+		for (i=0;i<array_size;i++) {
+			walk_one(L, &rb, &w);
+		}
+	}
+	for (;;) {
+		if (rb.len > 0 && (uint8_t)rb.buffer[rb.ptr] == COMBINE_TYPE(TYPE_BOOLEAN, TYPE_BOOLEAN_NIL)) {
+			return 0;
+		}
+		if (view_match_key(L, &rb, &w, 2)) {
+			view_push_value(L, 1, &rb, &w);
+			return 1;
+		}
+		walk_one(L, &rb, &w);
+	}
+}
+
+static int
+lview_len(lua_State *L) {
+	struct seri_view *v = view_check(L, 1);
+	struct read_block rb;
+	struct view_walk w;
+	lua_pushinteger(L, view_begin(L, v, &rb, &w));
+	return 1;
+}
+
+static int
+lview_call(lua_State *L) {
+	struct seri_view *v = view_check(L, 1);
+	lua_settop(L, 1);
+	struct read_block rb;
+	struct view_node *self = view_self(v);
+	rb_view_init(&rb, v, self->offset);
+	rb.view = 1;
+	lua_pushnil(L);	// slot for ref table
+	rb.s.ref_index = 2;
+	rb.s.objectid = self->id - 1;
+	int depth = v->depth < MAX_DEPTH ? v->depth : MAX_DEPTH;
+	luaL_checkstack(L, depth + LUA_MINSTACK, NULL);
+	int i;
+	for (i=0;i<depth;i++) {
+		// references to ancestors outside of the view come back as views
+		struct seri_view *a = view_new(L, v, 1);
+		a->depth = i;
+		memcpy(a->ancestor, v->ancestor, (i + 1) * sizeof(struct view_node));
+		rb.s.ancestor[i] = lua_gettop(L);
+	}
+	rb.s.depth = v->depth;
+	unpack_one(L, &rb);
+	return 1;
+}
+
+static int
+lview_tostring(lua_State *L) {
+	struct seri_view *v = view_check(L, 1);
+	lua_pushfstring(L, "view (%d)", view_self(v)->id);
+	return 1;
+}
+
+static int
+lview_free(lua_State *L) {
+	void **p = (void **)lua_touserdata(L, 1);
+	free(*p);
+	*p = NULL;
+	return 0;
+}
+
+int
+seri_view(lua_State *L, void *buffer, int owner) {
+	if (owner) {
+		lua_pushvalue(L, owner);
+	} else {
+		void **p = (void **)lua_newuserdatauv(L, sizeof(void *), 0);
+		*p = buffer;
+		if (luaL_newmetatable(L, VIEW_NAME "::buffer")) {
+			lua_pushcfunction(L, lview_free);
+			lua_setfield(L, -2, "__gc");
+		}
+		lua_setmetatable(L, -2);
+	}
+	int owner_index = lua_gettop(L);
+	if (luaL_newmetatable(L, VIEW_NAME)) {
+		luaL_Reg l[] = {
+			{ "__index", lview_index },
+			{ "__len", lview_len },
+			{ "__call", lview_call },
+			{ "__tostring", lview_tostring },
+			{ NULL, NULL },
+		};
+		luaL_setfuncs(L, l, 0);
+	}
+	lua_pop(L, 1);
+
+	int len = 0;
+	memcpy(&len, buffer, 4);
+	struct seri_view root;
+	root.buffer = (const char *)buffer + 4;
+	root.len = len;
+	root.depth = 0;
+	if (len == 0) {
+		return 0;
+	}
+	struct seri_view *v = (struct seri_view *)lua_newuserdatauv(L, sizeof(struct seri_view), 1);
+	*v = root;
+	lua_pushvalue(L, owner_index);
+	lua_setiuservalue(L, -2, 1);
+	luaL_setmetatable(L, VIEW_NAME);
+
+	struct read_block rb;
+	struct view_walk w;
+	rb_view_init(&rb, v, 0);
+	w.objectid = 0;
+	w.depth = 0;
+	w.target = 0;
+	w.found = NULL;
+	view_push_value(L, lua_gettop(L), &rb, &w);
+	return 1;
+}
+
 int
 luaseri_unpack(lua_State *L) {
 	if (lua_isnoneornil(L, 1)) {
@@ -3,6 +3,12 @@
 struct lua_State;
 
 int seri_unpack(lua_State* L, void* buffer);
+int seri_unpackplain(lua_State* L, void* buffer);
 int seri_unpackptr(lua_State* L, void* buffer);
 void * seri_pack(lua_State* L, int from, int* sz);
+void * seri_packto(lua_State* L, int from, void* (*alloc)(void* ud, int sz), void* ud);
 void * seri_packstring(const char* str, int sz);
+int seri_view(lua_State* L, void* buffer, int owner);
+void seri_enablefunction(lua_State* L, int enable);
+// Registers the C function a userdata's __deseri must be for it to pack.
+int seri_register(int (*deseri)(lua_State* L));
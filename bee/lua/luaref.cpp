@@ -1,89 +1,99 @@
 #include <bee/lua/luaref.h>
 
 #include <cassert>
+#include <vector>
 
-#define FREELIST 1
+// freed[r] is set while slot r is free, so that isvalid and trimming the
+// top are O(1). The free list may hold slots since trimmed away; ref skips
+// them.
+struct luaref_state {
+    lua_State* refL;
+    std::vector<int> freelist;
+    std::vector<bool> freed;
+};
+
+static bool isfreed(luaref ref, int r) {
+    return (size_t)r < ref->freed.size() && ref->freed[r];
+}
 
 luaref luaref_init(lua_State* L) {
     lua_State* refL = lua_newthread(L);
     lua_rawsetp(L, LUA_REGISTRYINDEX, refL);
-    lua_newtable(refL);
-    return refL;
+    return new luaref_state { refL, {}, {} };
 }
 
-void luaref_close(luaref refL) {
-    lua_State* L = (lua_State*)refL;
+void luaref_close(luaref ref) {
+    lua_State* L = ref->refL;
     lua_pushnil(L);
-    lua_rawsetp(L, LUA_REGISTRYINDEX, refL);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, L);
+    delete ref;
 }
 
-bool luaref_isvalid(luaref refL, int ref) {
-    if (ref <= FREELIST || ref > lua_gettop(refL)) {
+bool luaref_isvalid(luaref ref, int r) {
+    if (r <= 0 || r > lua_gettop(ref->refL)) {
         return false;
     }
-    lua_pushnil(refL);
-    while (lua_next(refL, FREELIST)) {
-        lua_pop(refL, 1);
-        if (lua_tointeger(refL, -1) == ref) {
-            lua_pop(refL, 1);
-            return false;
-        }
-    }
-    return true;
+    return !isfreed(ref, r);
 }
 
-int luaref_ref(luaref refL, lua_State* L) {
-    if (!lua_checkstack(refL, 3)) {
+int luaref_ref(luaref ref, lua_State* L) {
+    lua_State* refL = ref->refL;
+    // keep a spare slot, luaref_get pushes onto refL before moving.
+    if (!lua_checkstack(refL, 2)) {
         return LUA_NOREF;
     }
-    lua_xmove(L, refL, 1);
-    lua_pushnil(refL);
-    if (!lua_next(refL, FREELIST)) {
-        return lua_gettop(refL);
+    int top = lua_gettop(refL);
+    while (!ref->freelist.empty()) {
+        int r = ref->freelist.back();
+        ref->freelist.pop_back();
+        if (r <= top && isfreed(ref, r)) {
+            ref->freed[r] = false;
+            lua_xmove(L, refL, 1);
+            lua_replace(refL, r);
+            return r;
+        }
     }
-    int r = (int)lua_tointeger(refL, -2);
-    lua_pop(refL, 1);
-    lua_pushnil(refL);
-    lua_rawset(refL, FREELIST);
-    lua_replace(refL, r);
-    return r;
+    lua_xmove(L, refL, 1);
+    return lua_gettop(refL);
 }
 
-void luaref_unref(luaref refL, int ref) {
-    if (ref <= FREELIST) {
+void luaref_unref(luaref ref, int r) {
+    lua_State* refL = ref->refL;
+    int top         = lua_gettop(refL);
+    if (r <= 0 || r > top) {
         return;
     }
-    int top = lua_gettop(refL);
-    if (ref > top) {
+    if (isfreed(ref, r)) {
         return;
     }
-    if (ref < top) {
-        lua_pushboolean(refL, 1);
-        lua_rawseti(refL, FREELIST, ref);
-        lua_pushnil(refL);
-        lua_replace(refL, ref);
+    if (r == top) {
+        // trim the free slots below, so the stack shrinks after churn.
+        for (--top; top > 0 && isfreed(ref, top); --top) {
+            ref->freed[top] = false;
+        }
+        if (ref->freed.size() > (size_t)top + 1) {
+            ref->freed.resize((size_t)top + 1);
+        }
+        lua_settop(refL, top);
         return;
     }
-    for (--top; top > FREELIST; --top) {
-        if (LUA_TNIL == lua_rawgeti(refL, FREELIST, top)) {
-            lua_pop(refL, 1);
-            break;
-        }
-        lua_pop(refL, 1);
-        lua_pushnil(refL);
-        lua_rawseti(refL, FREELIST, top);
+    lua_pushnil(refL);
+    lua_replace(refL, r);
+    if (ref->freed.size() <= (size_t)r) {
+        ref->freed.resize((size_t)r + 1);
     }
-    lua_settop(refL, top);
+    ref->freed[r] = true;
+    ref->freelist.push_back(r);
 }
 
-void luaref_get(luaref refL, lua_State* L, int ref) {
-    assert(luaref_isvalid(refL, ref));
-    lua_pushvalue(refL, ref);
-    lua_xmove(refL, L, 1);
+void luaref_get(luaref ref, lua_State* L, int r) {
+    assert(luaref_isvalid(ref, r));
+    lua_pushvalue(ref->refL, r);
+    lua_xmove(ref->refL, L, 1);
 }
 
-void luaref_set(luaref refL, lua_State* L, int ref) {
-    assert(luaref_isvalid(refL, ref));
-    lua_xmove(L, refL, 1);
-    lua_replace(refL, ref);
+void luaref_set(luaref ref, lua_State* L, int r) {
+    assert(luaref_isvalid(ref, r));
+    lua_xmove(L, ref->refL, 1);
+    lua_replace(ref->refL, r);
 }
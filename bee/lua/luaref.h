@@ -2,12 +2,13 @@
 
 #include <lua.hpp>
 
-typedef lua_State* luaref;
+struct luaref_state;
+typedef luaref_state* luaref;
 
 luaref luaref_init(lua_State* L);
-void luaref_close(luaref refL);
-bool luaref_isvalid(luaref refL, int ref);
-int luaref_ref(luaref refL, lua_State* L);
-void luaref_unref(luaref refL, int ref);
-void luaref_get(luaref refL, lua_State* L, int ref);
-void luaref_set(luaref refL, lua_State* L, int ref);
+void luaref_close(luaref ref);
+bool luaref_isvalid(luaref ref, int r);
+int luaref_ref(luaref ref, lua_State* L);
+void luaref_unref(luaref ref, int r);
+void luaref_get(luaref ref, lua_State* L, int r);
+void luaref_set(luaref ref, lua_State* L, int r);
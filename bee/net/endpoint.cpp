@@ -24,6 +24,7 @@ struct sockaddr_un {
 #    endif
 #endif
 #include <bee/net/ip.h>
+#include <bee/net/resolver.h>
 #include <bee/nonstd/charconv.h>
 
 #include <array>
@@ -103,6 +104,10 @@ namespace bee::net {
         } else {
             p[0] = '\0';
         }
+        const bool numeric = AddrInfo::needsnolookup(name);
+        if (!numeric && resolve_cache::lookup(ep, name, port)) {
+            return true;
+        }
         AddrInfo info(name, portstr);
         if (!info) {
             return false;
@@ -115,16 +120,18 @@ namespace bee::net {
                 return false;
             }
             ep.assign(*(const sockaddr_in*)info->ai_addr);
-            return true;
         } else if (info->ai_family == AF_INET6) {
             if (info->ai_addrlen != sizeof(sockaddr_in6)) {
                 return false;
             }
             ep.assign(*(const sockaddr_in6*)info->ai_addr);
-            return true;
         } else {
             return false;
         }
+        if (!numeric) {
+            resolve_cache::store(name, ep);
+        }
+        return true;
     }
 
     bool endpoint::ctor_unix(endpoint& ep, zstring_view path) noexcept {
@@ -2,6 +2,13 @@
 #include <bee/net/socket.h>
 #include <bee/nonstd/unreachable.h>
 
+#if defined(__linux__)
+#    include <sys/eventfd.h>
+#    include <unistd.h>
+
+#    include <cstdint>
+#endif
+
 namespace bee::net {
     event::~event() noexcept {
         if (pipe[0] != retired_fd) {
@@ -17,7 +24,13 @@ namespace bee::net {
     bool event::open() noexcept {
         if (pipe[0] != retired_fd)
             return false;
+#if defined(__linux__)
+        // eventfd needs one descriptor and no socket buffer.
+        pipe[0] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return pipe[0] != retired_fd;
+#else
         return socket::pair(pipe, socket::fd_flags::nonblock);
+#endif
     }
 
     void event::set() noexcept {
@@ -25,12 +38,22 @@ namespace bee::net {
             return;
         if (e.test_and_set(std::memory_order_seq_cst))
             return;
+#if defined(__linux__)
+        uint64_t v = 1;
+        (void)!::write(pipe[0], &v, sizeof(v));
+#else
         char tmp[1] = { 0 };
         int rc      = 0;
         socket::send(pipe[1], rc, tmp, sizeof(tmp));
+#endif
     }
 
     void event::clear() noexcept {
+#if defined(__linux__)
+        uint64_t v;
+        (void)!::read(pipe[0], &v, sizeof(v));
+        e.clear(std::memory_order_seq_cst);
+#else
         char tmp[128];
         int rc = 0;
         for (;;) {
@@ -46,6 +69,7 @@ namespace bee::net {
                 std::unreachable();
             }
         }
+#endif
     }
 
     fd_t event::fd() const noexcept {
@@ -0,0 +1,210 @@
+#include <bee/net/resolver.h>
+
+#if defined(_WIN32)
+#    include <winsock2.h>
+#    include <ws2tcpip.h>
+#else
+#    include <netinet/in.h>
+#    include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+namespace bee::net {
+    namespace resolve_cache {
+        using clock = std::chrono::steady_clock;
+
+        constexpr size_t kMaxEntries = 4096;
+
+        struct entry {
+            endpoint ep;
+            clock::time_point expire;
+        };
+
+        static struct {
+            std::mutex mutex;
+            std::unordered_map<std::string, entry> entries;
+            std::atomic<int> ttl = 60000;
+        } G;
+
+        static bool setport(endpoint& ep, uint16_t port) noexcept {
+            switch (ep.get_family()) {
+            case family::inet:
+                ((sockaddr_in*)ep.out_addr())->sin_port = htons(port);
+                return true;
+            case family::inet6:
+                ((sockaddr_in6*)ep.out_addr())->sin6_port = htons(port);
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        void set_ttl(int msec) noexcept {
+            G.ttl = msec > 0 ? msec : 0;
+            if (msec <= 0) {
+                clear();
+            }
+        }
+
+        int get_ttl() noexcept {
+            return G.ttl;
+        }
+
+        bool lookup(endpoint& ep, zstring_view name, uint16_t port) noexcept {
+            if (G.ttl == 0) {
+                return false;
+            }
+            std::string key { name.data(), name.size() };
+            std::unique_lock<std::mutex> lk(G.mutex);
+            auto it = G.entries.find(key);
+            if (it == G.entries.end()) {
+                return false;
+            }
+            if (it->second.expire <= clock::now()) {
+                G.entries.erase(it);
+                return false;
+            }
+            ep = it->second.ep;
+            lk.unlock();
+            return setport(ep, port);
+        }
+
+        void store(zstring_view name, const endpoint& ep) noexcept {
+            int ttl = G.ttl;
+            if (ttl == 0) {
+                return;
+            }
+            std::string key { name.data(), name.size() };
+            auto now = clock::now();
+            std::lock_guard<std::mutex> lk(G.mutex);
+            if (G.entries.size() >= kMaxEntries) {
+                for (auto it = G.entries.begin(); it != G.entries.end();) {
+                    if (it->second.expire <= now) {
+                        it = G.entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if (G.entries.size() >= kMaxEntries) {
+                    G.entries.clear();
+                }
+            }
+            G.entries.insert_or_assign(std::move(key), entry { ep, now + std::chrono::milliseconds(ttl) });
+        }
+
+        void clear() noexcept {
+            std::lock_guard<std::mutex> lk(G.mutex);
+            G.entries.clear();
+        }
+    }
+
+    resolver::~resolver() noexcept {
+        close();
+    }
+
+    bool resolver::open(int nthreads) noexcept {
+        p = std::make_shared<pool>();
+        if (!p->ev.open()) {
+            return false;
+        }
+        for (int i = 0; i < nthreads; ++i) {
+            auto ud = new (std::nothrow) std::shared_ptr<pool>(p);
+            if (!ud) {
+                close();
+                return false;
+            }
+            thread_handle h = thread_create(worker, ud);
+            if (!h) {
+                delete ud;
+                close();
+                return false;
+            }
+            thread_detach(h);
+        }
+        return true;
+    }
+
+    void resolver::close() noexcept {
+        if (!p) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lk(p->mutex);
+            p->stopping = true;
+            p->requests.clear();
+        }
+        p->cond.notify_all();
+    }
+
+    bool resolver::submit(uint64_t id, zstring_view name, uint16_t port) {
+        if (!p) {
+            return false;
+        }
+        resolve_result r;
+        if (resolve_cache::lookup(r.ep, name, port)) {
+            r.id = id;
+            r.ok = true;
+            p->complete(std::move(r));
+            return true;
+        }
+        {
+            std::unique_lock<std::mutex> lk(p->mutex);
+            if (p->stopping) {
+                return false;
+            }
+            p->requests.push_back({ id, std::string { name.data(), name.size() }, port });
+        }
+        p->cond.notify_one();
+        return true;
+    }
+
+    bool resolver::pop(resolve_result& r) noexcept {
+        if (!p) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lk(p->mutex);
+        if (p->results.empty()) {
+            p->ev.clear();
+            return false;
+        }
+        r = std::move(p->results.front());
+        p->results.pop_front();
+        return true;
+    }
+
+    fd_t resolver::fd() const noexcept {
+        return p ? p->ev.fd() : retired_fd;
+    }
+
+    void resolver::pool::complete(resolve_result&& r) {
+        std::unique_lock<std::mutex> lk(mutex);
+        results.push_back(std::move(r));
+        ev.set();
+    }
+
+    void resolver::worker(void* ud) noexcept {
+        std::shared_ptr<pool> self = std::move(*(std::shared_ptr<pool>*)ud);
+        delete (std::shared_ptr<pool>*)ud;
+        for (;;) {
+            request req;
+            {
+                std::unique_lock<std::mutex> lk(self->mutex);
+                self->cond.wait(lk, [&] { return self->stopping || !self->requests.empty(); });
+                if (self->stopping) {
+                    return;
+                }
+                req = std::move(self->requests.front());
+                self->requests.pop_front();
+            }
+            resolve_result r;
+            r.id = req.id;
+            r.ok = endpoint::ctor_hostname(r.ep, req.name, req.port);
+            self->complete(std::move(r));
+        }
+    }
+}
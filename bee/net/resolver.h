@@ -0,0 +1,68 @@
+#pragma once
+
+#include <bee/net/endpoint.h>
+#include <bee/net/event.h>
+#include <bee/thread/simplethread.h>
+#include <bee/utility/zstring_view.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace bee::net {
+    // Process-wide cache of hostname lookups, consulted by
+    // endpoint::ctor_hostname. Entries expire after the ttl; a ttl of 0
+    // disables the cache.
+    namespace resolve_cache {
+        void set_ttl(int msec) noexcept;
+        int get_ttl() noexcept;
+        bool lookup(endpoint& ep, zstring_view name, uint16_t port) noexcept;
+        void store(zstring_view name, const endpoint& ep) noexcept;
+        void clear() noexcept;
+    }
+
+    struct resolve_result {
+        uint64_t id;
+        bool ok;
+        endpoint ep;
+    };
+
+    // Resolves hostnames on a pool of background threads. Finished lookups
+    // are queued and signalled through fd(), which can be polled. The
+    // threads are detached and share the pool by reference, so close()
+    // returns at once; a lookup still in getaddrinfo finishes on its own.
+    class resolver {
+    public:
+        resolver() noexcept = default;
+        ~resolver() noexcept;
+        resolver(const resolver&)            = delete;
+        resolver& operator=(const resolver&) = delete;
+        bool open(int nthreads) noexcept;
+        void close() noexcept;
+        bool submit(uint64_t id, zstring_view name, uint16_t port);
+        bool pop(resolve_result& r) noexcept;
+        fd_t fd() const noexcept;
+
+    private:
+        struct request {
+            uint64_t id;
+            std::string name;
+            uint16_t port;
+        };
+        struct pool {
+            std::mutex mutex;
+            std::condition_variable cond;
+            std::deque<request> requests;
+            std::deque<resolve_result> results;
+            bool stopping = false;
+            event ev;
+            void complete(resolve_result&& r);
+        };
+        static void worker(void* ud) noexcept;
+
+        std::shared_ptr<pool> p;
+    };
+}
@@ -7,21 +7,34 @@
 #    include <mstcpip.h>
 #    include <mswsock.h>
 #else
+#    include <errno.h>
 #    include <fcntl.h>
 #    include <netinet/in.h>
 #    include <netinet/tcp.h>
 #    include <signal.h>
+#    include <sys/uio.h>
 #    include <unistd.h>
 #    if defined(__APPLE__)
 #        include <sys/ioctl.h>
 #    elif defined(__FreeBSD__) || defined(__OpenBSD__)
 #        include <sys/socket.h>
 #    endif
+#    if defined(__linux__)
+#        include <linux/errqueue.h>
+#        include <linux/sockios.h>
+#        include <sys/ioctl.h>
+#        include <sys/sendfile.h>
+#    endif
 #endif
 
 #include <bee/net/endpoint.h>
 #include <bee/net/socket.h>
 #include <bee/nonstd/unreachable.h>
+#include <bee/sys/file_handle.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
 
 namespace bee::net::socket {
     static bool net_success(int x) noexcept {
@@ -145,6 +158,15 @@ namespace bee::net::socket {
         return net_success(ok);
     }
 
+    [[maybe_unused]] static bool unsupported_option() noexcept {
+#if defined(_WIN32)
+        ::WSASetLastError(WSAENOPROTOOPT);
+#else
+        errno = ENOPROTOOPT;
+#endif
+        return false;
+    }
+
     static fd_t createSocket(int af, int type, int protocol, fd_flags fd_flags) noexcept {
 #if defined(_WIN32)
         const fd_t fd = u_createSocket(af, type, protocol, fd_flags);
@@ -250,6 +272,64 @@ namespace bee::net::socket {
             return setoption(s, SOL_SOCKET, SO_SNDBUF, value);
         case option::rcvbuf:
             return setoption(s, SOL_SOCKET, SO_RCVBUF, value);
+        case option::reuseport:
+#if defined(SO_REUSEPORT_LB)
+            return setoption(s, SOL_SOCKET, SO_REUSEPORT_LB, value);
+#elif defined(SO_REUSEPORT)
+            return setoption(s, SOL_SOCKET, SO_REUSEPORT, value);
+#else
+            return unsupported_option();
+#endif
+        case option::nodelay:
+            return setoption(s, IPPROTO_TCP, TCP_NODELAY, value);
+        case option::keepalive:
+            return setoption(s, SOL_SOCKET, SO_KEEPALIVE, value);
+        case option::keepidle:
+#if defined(TCP_KEEPIDLE)
+            return setoption(s, IPPROTO_TCP, TCP_KEEPIDLE, value);
+#elif defined(TCP_KEEPALIVE)
+            return setoption(s, IPPROTO_TCP, TCP_KEEPALIVE, value);
+#else
+            return unsupported_option();
+#endif
+        case option::keepintvl:
+#if defined(TCP_KEEPINTVL)
+            return setoption(s, IPPROTO_TCP, TCP_KEEPINTVL, value);
+#else
+            return unsupported_option();
+#endif
+        case option::keepcnt:
+#if defined(TCP_KEEPCNT)
+            return setoption(s, IPPROTO_TCP, TCP_KEEPCNT, value);
+#else
+            return unsupported_option();
+#endif
+        case option::defer_accept:
+#if defined(TCP_DEFER_ACCEPT)
+            return setoption(s, IPPROTO_TCP, TCP_DEFER_ACCEPT, value);
+#else
+            return unsupported_option();
+#endif
+        case option::busy_poll:
+#if defined(SO_BUSY_POLL)
+            return setoption(s, SOL_SOCKET, SO_BUSY_POLL, value);
+#else
+            return unsupported_option();
+#endif
+        case option::cork:
+#if defined(TCP_CORK)
+            return setoption(s, IPPROTO_TCP, TCP_CORK, value);
+#elif defined(TCP_NOPUSH)
+            return setoption(s, IPPROTO_TCP, TCP_NOPUSH, value);
+#else
+            return unsupported_option();
+#endif
+        case option::zerocopy:
+#if defined(SO_ZEROCOPY)
+            return setoption(s, SOL_SOCKET, SO_ZEROCOPY, value);
+#else
+            return unsupported_option();
+#endif
         default:
             std::unreachable();
         }
@@ -364,6 +444,51 @@ namespace bee::net::socket {
         return status::success;
     }
 
+    status sendv(fd_t s, int& rc, const span<const iobuf>& bufs) noexcept {
+        size_t n     = std::min(bufs.size(), kMaxSendv);
+        size_t total = 0;
+#if defined(_WIN32)
+        WSABUF vec[kMaxSendv];
+#else
+        struct iovec vec[kMaxSendv];
+#endif
+        size_t i = 0;
+        for (; i < n && total < INT_MAX; ++i) {
+            size_t len = std::min<size_t>(bufs[i].len, INT_MAX - total);
+#if defined(_WIN32)
+            vec[i].buf = (CHAR*)bufs[i].buf;
+            vec[i].len = (ULONG)len;
+#else
+            vec[i].iov_base = (void*)bufs[i].buf;
+            vec[i].iov_len  = len;
+#endif
+            total += len;
+        }
+#if defined(_WIN32)
+        DWORD sent = 0;
+        if (::WSASend(s, vec, (DWORD)i, &sent, 0, NULL, NULL) != 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        rc = (int)sent;
+        return status::success;
+#else
+        struct msghdr msg = {};
+        msg.msg_iov       = vec;
+        msg.msg_iovlen    = i;
+        int flags         = 0;
+#    ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#    endif
+        ssize_t r = ::sendmsg(s, &msg, flags);
+        if (r < 0) {
+            rc = -1;
+            return wait_finish() ? status::wait : status::failed;
+        }
+        rc = (int)r;
+        return status::success;
+#endif
+    }
+
     status recvfrom(fd_t s, int& rc, endpoint& ep, char* buf, int len) noexcept {
         rc = ::recvfrom(s, buf, len, 0, ep.out_addr(), ep.out_addrlen());
         if (rc < 0) {
@@ -384,6 +509,306 @@ namespace bee::net::socket {
         return status::success;
     }
 
+#if defined(__linux__)
+    status recvmmsg(fd_t s, int& rc, const span<datagram>& msgs) noexcept {
+        size_t n = std::min(msgs.size(), kMaxMmsg);
+        struct mmsghdr hdr[kMaxMmsg];
+        struct iovec vec[kMaxMmsg];
+        for (size_t i = 0; i < n; ++i) {
+            vec[i].iov_base            = msgs[i].buf;
+            vec[i].iov_len             = msgs[i].len;
+            hdr[i].msg_hdr             = {};
+            hdr[i].msg_hdr.msg_name    = msgs[i].ep->out_addr();
+            hdr[i].msg_hdr.msg_iov     = &vec[i];
+            hdr[i].msg_hdr.msg_iovlen  = 1;
+            hdr[i].msg_hdr.msg_namelen = *msgs[i].ep->out_addrlen();
+        }
+        rc = ::recvmmsg(s, hdr, (unsigned int)n, 0, NULL);
+        if (rc < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        for (int i = 0; i < rc; ++i) {
+            msgs[i].len                = hdr[i].msg_len;
+            *msgs[i].ep->out_addrlen() = hdr[i].msg_hdr.msg_namelen;
+        }
+        return status::success;
+    }
+
+    status sendmmsg(fd_t s, int& rc, const span<const datagram>& msgs) noexcept {
+        size_t n = std::min(msgs.size(), kMaxMmsg);
+        struct mmsghdr hdr[kMaxMmsg];
+        struct iovec vec[kMaxMmsg];
+        for (size_t i = 0; i < n; ++i) {
+            vec[i].iov_base            = msgs[i].buf;
+            vec[i].iov_len             = msgs[i].len;
+            hdr[i].msg_hdr             = {};
+            hdr[i].msg_hdr.msg_name    = (void*)msgs[i].ep->addr();
+            hdr[i].msg_hdr.msg_namelen = msgs[i].ep->addrlen();
+            hdr[i].msg_hdr.msg_iov     = &vec[i];
+            hdr[i].msg_hdr.msg_iovlen  = 1;
+        }
+        rc = ::sendmmsg(s, hdr, (unsigned int)n, MSG_NOSIGNAL);
+        if (rc < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        return status::success;
+    }
+#else
+    status recvmmsg(fd_t s, int& rc, const span<datagram>& msgs) noexcept {
+        size_t n = std::min(msgs.size(), kMaxMmsg);
+        size_t i = 0;
+        for (; i < n; ++i) {
+            int r;
+            status st = recvfrom(s, r, *msgs[i].ep, msgs[i].buf, (int)std::min<size_t>(msgs[i].len, INT_MAX));
+            if (st != status::success) {
+                if (i == 0) {
+                    return st;
+                }
+                break;
+            }
+            msgs[i].len = (size_t)r;
+        }
+        rc = (int)i;
+        return status::success;
+    }
+
+    status sendmmsg(fd_t s, int& rc, const span<const datagram>& msgs) noexcept {
+        size_t n = std::min(msgs.size(), kMaxMmsg);
+        size_t i = 0;
+        for (; i < n; ++i) {
+            int r;
+            status st = sendto(s, r, msgs[i].buf, (int)std::min<size_t>(msgs[i].len, INT_MAX), *msgs[i].ep);
+            if (st != status::success) {
+                if (i == 0) {
+                    return st;
+                }
+                break;
+            }
+        }
+        rc = (int)i;
+        return status::success;
+    }
+#endif
+
+    status sendfile(fd_t s, int& rc, const file_handle& f, int64_t offset, int len) noexcept {
+#if defined(__linux__)
+        off_t off = (off_t)offset;
+        ssize_t r = ::sendfile(s, f.value(), &off, (size_t)len);
+        if (r < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        rc = (int)r;
+        return status::success;
+#elif defined(__APPLE__)
+        off_t sent = len;
+        if (::sendfile(f.value(), s, (off_t)offset, &sent, NULL, 0) < 0) {
+            if (wait_finish()) {
+                if (sent > 0) {
+                    rc = (int)sent;
+                    return status::success;
+                }
+                return status::wait;
+            }
+            return status::failed;
+        }
+        rc = (int)sent;
+        return status::success;
+#elif defined(__FreeBSD__)
+        off_t sent = 0;
+        if (::sendfile(f.value(), s, (off_t)offset, (size_t)len, NULL, &sent, 0) < 0) {
+            if (wait_finish()) {
+                if (sent > 0) {
+                    rc = (int)sent;
+                    return status::success;
+                }
+                return status::wait;
+            }
+            return status::failed;
+        }
+        rc = (int)sent;
+        return status::success;
+#else
+        // no sendfile(2) here, copy one chunk through user space.
+        char buf[16 * 1024];
+        int n = std::min(len, (int)sizeof(buf));
+#    if defined(_WIN32)
+        // a positioned ReadFile on a synchronous handle still moves the
+        // file pointer, so put it back as pread would have left it.
+        LARGE_INTEGER zero = {};
+        LARGE_INTEGER pos;
+        if (!::SetFilePointerEx(f.value(), zero, &pos, FILE_CURRENT)) {
+            return status::failed;
+        }
+        OVERLAPPED ov = {};
+        ov.Offset     = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD nread   = 0;
+        BOOL ok       = ::ReadFile(f.value(), buf, (DWORD)n, &nread, &ov);
+        DWORD err     = ok ? ERROR_SUCCESS : ::GetLastError();
+        ::SetFilePointerEx(f.value(), pos, NULL, FILE_BEGIN);
+        if (!ok) {
+            if (err != ERROR_HANDLE_EOF) {
+                ::SetLastError(err);
+                return status::failed;
+            }
+            nread = 0;
+        }
+#    else
+        ssize_t nread = ::pread(f.value(), buf, (size_t)n, (off_t)offset);
+        if (nread < 0) {
+            return status::failed;
+        }
+#    endif
+        if (nread == 0) {
+            rc = 0;
+            return status::success;
+        }
+        return send(s, rc, buf, (int)nread);
+#endif
+    }
+
+#if defined(__linux__)
+    status send_zerocopy(fd_t s, int& rc, const char* buf, int len) noexcept {
+        rc = ::send(s, buf, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (rc < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        return status::success;
+    }
+
+    status reap_zerocopy(fd_t s, errqueue_entry& e) noexcept {
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg  = {};
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(s, &msg, MSG_ERRQUEUE) < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        e = {};
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recverr) {
+                continue;
+            }
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+            e.origin = ee.ee_origin;
+            e.error  = (int)ee.ee_errno;
+            if (ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY && ee.ee_errno == 0) {
+                e.zerocopy = true;
+                e.copied   = (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+                e.lo       = ee.ee_info;
+                e.hi       = ee.ee_data;
+            }
+            break;
+        }
+        return status::success;
+    }
+#endif
+
+#if !defined(_WIN32)
+    status sendfd(fd_t s, int& rc, const char* buf, int len, const span<const fd_t>& fds) noexcept {
+        size_t n = std::min(fds.size(), kMaxFds);
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        struct iovec vec;
+        vec.iov_base      = (void*)buf;
+        vec.iov_len       = (size_t)len;
+        struct msghdr msg = {};
+        msg.msg_iov       = &vec;
+        msg.msg_iovlen    = 1;
+        if (n > 0) {
+            msg.msg_control      = control;
+            msg.msg_controllen   = CMSG_SPACE(sizeof(int) * n);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level     = SOL_SOCKET;
+            cmsg->cmsg_type      = SCM_RIGHTS;
+            cmsg->cmsg_len       = CMSG_LEN(sizeof(int) * n);
+            for (size_t i = 0; i < n; ++i) {
+                int fd = fds[i];
+                memcpy(CMSG_DATA(cmsg) + i * sizeof(int), &fd, sizeof(int));
+            }
+        }
+        int flags = 0;
+#    ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#    endif
+        ssize_t r = ::sendmsg(s, &msg, flags);
+        if (r < 0) {
+            return wait_finish() ? status::wait : status::failed;
+        }
+        rc = (int)r;
+        return status::success;
+    }
+
+    recv_status recvfd(fd_t s, int& rc, char* buf, int len, fd_t fds[kMaxFds], size_t& nfds) noexcept {
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        struct iovec vec;
+        vec.iov_base       = buf;
+        vec.iov_len        = (size_t)len;
+        struct msghdr msg  = {};
+        msg.msg_iov        = &vec;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+        int flags          = 0;
+#    ifdef MSG_CMSG_CLOEXEC
+        flags |= MSG_CMSG_CLOEXEC;
+#    endif
+        nfds      = 0;
+        ssize_t r = ::recvmsg(s, &msg, flags);
+        if (r < 0) {
+            return wait_finish() ? recv_status::wait : recv_status::failed;
+        }
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+#    if !defined(MSG_CMSG_CLOEXEC)
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+#    endif
+                if (nfds < kMaxFds) {
+                    fds[nfds++] = fd;
+                } else {
+                    ::close(fd);
+                }
+            }
+        }
+        if (r == 0 && nfds == 0) {
+            return recv_status::close;
+        }
+        rc = (int)r;
+        return recv_status::success;
+    }
+#endif
+
+#if defined(__linux__)
+    recv_status splice(fd_t from, fd_t to, fd_t pipe[2], size_t& pending, int& rc, int len) noexcept {
+        const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        rc                       = 0;
+        if (pending == 0) {
+            ssize_t r = ::splice(from, NULL, pipe[1], NULL, (size_t)len, flags);
+            if (r < 0) {
+                return wait_finish() ? recv_status::wait : recv_status::failed;
+            }
+            if (r == 0) {
+                return recv_status::close;
+            }
+            pending = (size_t)r;
+        }
+        ssize_t r = ::splice(pipe[0], NULL, to, NULL, pending, flags);
+        if (r < 0) {
+            return wait_finish() ? recv_status::wait : recv_status::failed;
+        }
+        pending -= (size_t)r;
+        rc = (int)r;
+        return recv_status::success;
+    }
+#endif
+
     bool getpeername(fd_t s, endpoint& ep) noexcept {
         const int ok = ::getpeername(s, ep.out_addr(), ep.out_addrlen());
         return net_success(ok);
@@ -400,6 +825,38 @@ namespace bee::net::socket {
         return net_success(ok);
     }
 
+    bool tcpinfo(fd_t s, connection_info& info) noexcept {
+#if defined(__linux__)
+        struct ::tcp_info ti;
+        socklen_t len = (socklen_t)sizeof(ti);
+        if (::getsockopt(s, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+            return false;
+        }
+        info.rtt         = ti.tcpi_rtt;
+        info.rttvar      = ti.tcpi_rttvar;
+        info.cwnd        = ti.tcpi_snd_cwnd;
+        info.mss         = ti.tcpi_snd_mss;
+        info.retransmits = ti.tcpi_total_retrans;
+        info.unacked     = ti.tcpi_unacked;
+        // the kernel's tcp_packets_in_flight.
+        uint32_t left    = ti.tcpi_sacked + ti.tcpi_lost;
+        uint32_t packets = ti.tcpi_unacked > left ? ti.tcpi_unacked - left : 0;
+        info.inflight    = (uint64_t)(packets + ti.tcpi_retrans) * ti.tcpi_snd_mss;
+        int outq         = 0;
+        int inq          = 0;
+        if (::ioctl(s, SIOCOUTQ, &outq) < 0 || ::ioctl(s, SIOCINQ, &inq) < 0) {
+            return false;
+        }
+        info.sendq = (uint64_t)outq;
+        info.recvq = (uint64_t)inq;
+        return true;
+#else
+        (void)s;
+        (void)info;
+        return unsupported_option();
+#endif
+    }
+
 #if defined(_WIN32)
     static bool unnamed_unix_bind(fd_t s) noexcept {
         wchar_t buf[MAX_PATH];
@@ -1,6 +1,14 @@
 #pragma once
 
 #include <bee/net/fd.h>
+#include <bee/utility/span.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bee {
+    class file_handle;
+}
 
 namespace bee::net {
     struct endpoint;
@@ -38,6 +46,16 @@ namespace bee::net::socket {
         reuseaddr,
         sndbuf,
         rcvbuf,
+        reuseport,
+        nodelay,
+        keepalive,
+        keepidle,
+        keepintvl,
+        keepcnt,
+        defer_accept,
+        busy_poll,
+        cork,
+        zerocopy,
     };
 
     enum class fd_flags {
@@ -45,12 +63,47 @@ namespace bee::net::socket {
         nonblock,
     };
 
+    struct iobuf {
+        const char* buf;
+        size_t len;
+    };
+
+    // sendv sends at most kMaxSendv buffers per call.
+    constexpr inline size_t kMaxSendv = 64;
+
+    struct datagram {
+        char* buf;
+        size_t len;
+        endpoint* ep;
+    };
+
+    // recvmmsg and sendmmsg move at most kMaxMmsg datagrams per call.
+    constexpr inline size_t kMaxMmsg = 64;
+
+    // sendfd and recvfd pass at most kMaxFds descriptors per message.
+    constexpr inline size_t kMaxFds = 64;
+
+    // Kernel view of a TCP connection. rtt and rttvar are in microseconds,
+    // cwnd in segments, inflight and the queues in bytes.
+    struct connection_info {
+        uint32_t rtt;
+        uint32_t rttvar;
+        uint32_t cwnd;
+        uint32_t mss;
+        uint32_t retransmits;
+        uint32_t unacked;
+        uint64_t inflight;
+        uint64_t sendq;
+        uint64_t recvq;
+    };
+
     bool initialize() noexcept;
     fd_t open(protocol protocol, fd_flags flags = fd_flags::nonblock) noexcept;
     bool pair(fd_t sv[2], fd_flags flags = fd_flags::nonblock) noexcept;
     bool pipe(fd_t sv[2], fd_flags flags = fd_flags::nonblock) noexcept;
     bool close(fd_t s) noexcept;
     bool shutdown(fd_t s, shutdown_flag flag) noexcept;
+    // setoption fails with ENOPROTOOPT for options the platform lacks.
     bool setoption(fd_t s, option opt, int value) noexcept;
     bool bind(fd_t s, const endpoint& ep) noexcept;
     bool listen(fd_t s, int backlog) noexcept;
@@ -58,10 +111,50 @@ namespace bee::net::socket {
     status accept(fd_t s, fd_t& newfd, fd_flags flags = fd_flags::nonblock) noexcept;
     recv_status recv(fd_t s, int& rc, char* buf, int len) noexcept;
     status send(fd_t s, int& rc, const char* buf, int len) noexcept;
+    status sendv(fd_t s, int& rc, const span<const iobuf>& bufs) noexcept;
     status recvfrom(fd_t s, int& rc, endpoint& ep, char* buf, int len) noexcept;
     status sendto(fd_t s, int& rc, const char* buf, int len, const endpoint& ep) noexcept;
+    status recvmmsg(fd_t s, int& rc, const span<datagram>& msgs) noexcept;
+    status sendmmsg(fd_t s, int& rc, const span<const datagram>& msgs) noexcept;
+    status sendfile(fd_t s, int& rc, const file_handle& f, int64_t offset, int len) noexcept;
+#if defined(__linux__)
+    // splice moves data from `from` to `to` through `pipe` without copying
+    // it to user space. Bytes that reached the pipe but not `to` are counted
+    // in `pending` and are delivered first by the next call.
+    recv_status splice(fd_t from, fd_t to, fd_t pipe[2], size_t& pending, int& rc, int len) noexcept;
+#endif
+#if defined(__linux__)
+    // send_zerocopy sends with MSG_ZEROCOPY on a socket with the zerocopy
+    // option set. The kernel reads buf after the call returns, so it must
+    // stay untouched until the completion of this call is reaped. Each
+    // successful call takes the next 32 bit completion id, starting at 0.
+    status send_zerocopy(fd_t s, int& rc, const char* buf, int len) noexcept;
+    // An entry of the error queue. For a zerocopy completion the sends
+    // lo..hi are done, and copied is set when the kernel fell back to
+    // copying the data anyway. Any other entry is returned with the
+    // origin and errno of its sock_extended_err.
+    struct errqueue_entry {
+        bool zerocopy;
+        bool copied;
+        uint32_t lo;
+        uint32_t hi;
+        int origin;
+        int error;
+    };
+    // reap_zerocopy pops one entry from the error queue.
+    status reap_zerocopy(fd_t s, errqueue_entry& e) noexcept;
+#endif
+#if !defined(_WIN32)
+    // sendfd and recvfd carry descriptors over a unix domain socket as
+    // SCM_RIGHTS ancillary data, attached to the first byte of buf.
+    // Received descriptors are close-on-exec; nfds is how many arrived.
+    status sendfd(fd_t s, int& rc, const char* buf, int len, const span<const fd_t>& fds) noexcept;
+    recv_status recvfd(fd_t s, int& rc, char* buf, int len, fd_t fds[kMaxFds], size_t& nfds) noexcept;
+#endif
     bool getpeername(fd_t s, endpoint& ep) noexcept;
     bool getsockname(fd_t s, endpoint& ep) noexcept;
     bool errcode(fd_t s, int& err) noexcept;
+    // tcpinfo fails with ENOPROTOOPT where TCP_INFO is not available.
+    bool tcpinfo(fd_t s, connection_info& info) noexcept;
     fd_t dup(fd_t s) noexcept;
 }
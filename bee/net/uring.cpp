@@ -0,0 +1,297 @@
+#include <bee/net/endpoint.h>
+#include <bee/net/socket.h>
+#include <bee/net/uring.h>
+#include <bee/nonstd/to_underlying.h>
+#include <bee/nonstd/unreachable.h>
+
+#include <algorithm>
+#include <climits>
+
+#if defined(_WIN32)
+#    include <winsock2.h>
+#else
+#    include <errno.h>
+#endif
+
+namespace bee::net {
+    static int64_t last_error() noexcept {
+#if defined(_WIN32)
+        return -(int64_t)::WSAGetLastError();
+#else
+        return -(int64_t)errno;
+#endif
+    }
+
+    static int clamp_len(size_t len) noexcept {
+        return (int)std::min<size_t>(len, INT_MAX);
+    }
+
+    static uint32_t interest(const uring_request& req) noexcept {
+        switch (req.op) {
+        case uring_op::recv:
+        case uring_op::accept:
+            return std::to_underlying(bpoll_event::in);
+        case uring_op::send:
+        case uring_op::connect:
+            return std::to_underlying(bpoll_event::out);
+        default:
+            std::unreachable();
+        }
+    }
+
+    uring::uring() noexcept {}
+
+    uring::~uring() noexcept {
+        close();
+    }
+
+    bool uring::open(unsigned entries, uring_backend prefer) noexcept {
+        if (kind != uring_backend::none) {
+            return false;
+        }
+#if defined(__linux__)
+        if (prefer == uring_backend::io_uring) {
+            native = uring_native_create(entries);
+            if (native) {
+                kind = uring_backend::io_uring;
+                return true;
+            }
+        }
+#endif
+        poll = bpoll_create();
+        if (poll == invalid_bpoll_handle) {
+            return false;
+        }
+        events.resize(std::max(entries, 1u));
+        kind = uring_backend::bpoll;
+        return true;
+    }
+
+    bool uring::close() noexcept {
+        switch (kind) {
+        case uring_backend::none:
+            return true;
+#if defined(__linux__)
+        case uring_backend::io_uring: {
+            bool drained = uring_native_destroy(native);
+            native       = nullptr;
+            kind         = uring_backend::none;
+            return drained;
+        }
+#endif
+        case uring_backend::bpoll:
+            if (!bpoll_close(poll)) {
+                return false;
+            }
+            poll = invalid_bpoll_handle;
+            queue.clear();
+            waiters.clear();
+            break;
+        default:
+            std::unreachable();
+        }
+        kind = uring_backend::none;
+        return true;
+    }
+
+    uring_backend uring::backend() const noexcept {
+        return kind;
+    }
+
+    bool uring::submit(const uring_request& req) noexcept {
+        switch (kind) {
+#if defined(__linux__)
+        case uring_backend::io_uring:
+            return uring_native_submit(native, req);
+#endif
+        case uring_backend::bpoll:
+            queue.push_back(req);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    int uring::wait(const span<uring_completion>& completions, int timeout) noexcept {
+        switch (kind) {
+#if defined(__linux__)
+        case uring_backend::io_uring:
+            return uring_native_wait(native, completions, timeout);
+#endif
+        case uring_backend::bpoll:
+            return poll_wait(completions, timeout);
+        default:
+            return -1;
+        }
+    }
+
+    bool uring::poll_perform(const uring_request& req, uring_completion& c) noexcept {
+        c.data = req.data;
+        switch (req.op) {
+        case uring_op::recv: {
+            int rc = 0;
+            switch (socket::recv(req.fd, rc, req.buf, clamp_len(req.len))) {
+            case socket::recv_status::success:
+                c.res = rc;
+                return true;
+            case socket::recv_status::close:
+                c.res = 0;
+                return true;
+            case socket::recv_status::wait:
+                return false;
+            case socket::recv_status::failed:
+                c.res = last_error();
+                return true;
+            default:
+                std::unreachable();
+            }
+        }
+        case uring_op::send: {
+            int rc = 0;
+            switch (socket::send(req.fd, rc, req.buf, clamp_len(req.len))) {
+            case socket::status::success:
+                c.res = rc;
+                return true;
+            case socket::status::wait:
+                return false;
+            case socket::status::failed:
+                c.res = last_error();
+                return true;
+            default:
+                std::unreachable();
+            }
+        }
+        case uring_op::accept: {
+            fd_t newfd = retired_fd;
+            switch (socket::accept(req.fd, newfd)) {
+            case socket::status::success:
+                c.res = (int64_t)newfd;
+                return true;
+            case socket::status::wait:
+                return false;
+            case socket::status::failed:
+                c.res = last_error();
+                return true;
+            default:
+                std::unreachable();
+            }
+        }
+        case uring_op::connect: {
+            if (req.ep == nullptr) {
+                // the connection is in progress, collect its result.
+                int err = 0;
+                if (!socket::errcode(req.fd, err)) {
+                    c.res = last_error();
+                    return true;
+                }
+                c.res = -(int64_t)err;
+                return true;
+            }
+            switch (socket::connect(req.fd, *req.ep)) {
+            case socket::status::success:
+                c.res = 0;
+                return true;
+            case socket::status::wait:
+                return false;
+            case socket::status::failed:
+                c.res = last_error();
+                return true;
+            default:
+                std::unreachable();
+            }
+        }
+        default:
+            std::unreachable();
+        }
+    }
+
+    bool uring::poll_watch(const uring_request& req) noexcept {
+        auto& w        = waiters[req.fd];
+        uint32_t event = w.events | interest(req);
+        if (event != w.events) {
+            bpoll_event_t ev;
+            ev.events   = static_cast<decltype(ev.events)>(event);
+            ev.data.u64 = (uint64_t)req.fd;
+            bool ok     = w.events == 0 ? bpoll_ctl_add(poll, req.fd, ev) : bpoll_ctl_mod(poll, req.fd, ev);
+            if (!ok) {
+                if (w.reqs.empty()) {
+                    waiters.erase(req.fd);
+                }
+                return false;
+            }
+            w.events = event;
+        }
+        w.reqs.push_back(req);
+        if (req.op == uring_op::connect) {
+            w.reqs.back().ep = nullptr;
+        }
+        return true;
+    }
+
+    void uring::poll_ready(fd_t fd, const span<uring_completion>& completions, int& n) noexcept {
+        auto it = waiters.find(fd);
+        if (it == waiters.end()) {
+            return;
+        }
+        auto& w        = it->second;
+        uint32_t event = 0;
+        size_t i       = 0;
+        for (size_t j = 0; j < w.reqs.size(); ++j) {
+            auto& req = w.reqs[j];
+            if ((size_t)n >= completions.size() || !poll_perform(req, completions[n])) {
+                event |= interest(req);
+                w.reqs[i++] = req;
+            } else {
+                ++n;
+            }
+        }
+        w.reqs.resize(i);
+        if (event == 0) {
+            bpoll_ctl_del(poll, fd);
+            waiters.erase(it);
+            return;
+        }
+        if (event != w.events) {
+            bpoll_event_t ev;
+            ev.events   = static_cast<decltype(ev.events)>(event);
+            ev.data.u64 = (uint64_t)fd;
+            bpoll_ctl_mod(poll, fd, ev);
+            w.events = event;
+        }
+    }
+
+    int uring::poll_wait(const span<uring_completion>& completions, int timeout) noexcept {
+        int n    = 0;
+        size_t i = 0;
+        for (; i < queue.size() && (size_t)n < completions.size(); ++i) {
+            const auto& req = queue[i];
+            if (poll_perform(req, completions[n])) {
+                ++n;
+            } else if (!poll_watch(req)) {
+                completions[n].data = req.data;
+                completions[n].res  = last_error();
+                ++n;
+            }
+        }
+        queue.erase(queue.begin(), queue.begin() + i);
+        if ((size_t)n >= completions.size()) {
+            return n;
+        }
+        if (n > 0 || waiters.empty()) {
+            timeout = 0;
+        }
+        int nevents = bpoll_wait(poll, events, timeout);
+        if (nevents == -1) {
+#if !defined(_WIN32)
+            if (errno == EINTR) {
+                return n;
+            }
+#endif
+            return n > 0 ? n : -1;
+        }
+        for (int e = 0; e < nevents && (size_t)n < completions.size(); ++e) {
+            poll_ready((fd_t)events[e].data.u64, completions, n);
+        }
+        return n;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <bee/net/bpoll.h>
+#include <bee/net/fd.h>
+#include <bee/utility/span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace bee::net {
+    struct endpoint;
+    struct uring_native;
+
+    enum class uring_op : uint8_t {
+        recv,
+        send,
+        accept,
+        connect,
+    };
+
+    enum class uring_backend : uint8_t {
+        none,
+        io_uring,
+        bpoll,
+    };
+
+    struct uring_request {
+        uring_op op;
+        fd_t fd;
+        char* buf;
+        size_t len;
+        const endpoint* ep;
+        uint64_t data;
+    };
+
+    struct uring_completion {
+        uint64_t data;
+        // >= 0: bytes transferred, the accepted socket, or 0 for connect.
+        // <  0: negated system error code.
+        int64_t res;
+    };
+
+    struct uring {
+        uring() noexcept;
+        ~uring() noexcept;
+        uring(const uring&)            = delete;
+        uring& operator=(const uring&) = delete;
+        bool open(unsigned entries, uring_backend prefer = uring_backend::io_uring) noexcept;
+        // close fails with the ring still open when the backend cannot be
+        // closed. It also fails with ETIMEDOUT, and backend() none, when
+        // io_uring requests were still in flight after being cancelled:
+        // the kernel may still write into their buffers, which must then
+        // never be freed.
+        bool close() noexcept;
+        uring_backend backend() const noexcept;
+        bool submit(const uring_request& req) noexcept;
+        int wait(const span<uring_completion>& completions, int timeout) noexcept;
+
+    private:
+        struct waiter {
+            uint32_t events = 0;
+            std::vector<uring_request> reqs;
+        };
+        bool poll_perform(const uring_request& req, uring_completion& c) noexcept;
+        bool poll_watch(const uring_request& req) noexcept;
+        void poll_ready(fd_t fd, const span<uring_completion>& completions, int& n) noexcept;
+        int poll_wait(const span<uring_completion>& completions, int timeout) noexcept;
+
+        uring_backend kind   = uring_backend::none;
+        uring_native* native = nullptr;
+        bpoll_handle poll    = invalid_bpoll_handle;
+        std::vector<uring_request> queue;
+        std::unordered_map<fd_t, waiter> waiters;
+        std::vector<bpoll_event_t> events;
+    };
+
+#if defined(__linux__)
+    uring_native* uring_native_create(unsigned entries) noexcept;
+    bool uring_native_destroy(uring_native* ring) noexcept;
+    bool uring_native_submit(uring_native* ring, const uring_request& req) noexcept;
+    int uring_native_wait(uring_native* ring, const span<uring_completion>& completions, int timeout) noexcept;
+#endif
+}
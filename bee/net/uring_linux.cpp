@@ -0,0 +1,497 @@
+#include <bee/net/endpoint.h>
+#include <bee/net/socket.h>
+#include <bee/net/uring.h>
+
+#if __has_include(<linux/io_uring.h>)
+#    include <errno.h>
+#    include <linux/io_uring.h>
+#    include <poll.h>
+#    include <signal.h>
+#    include <sys/mman.h>
+#    include <sys/socket.h>
+#    include <sys/syscall.h>
+#    include <time.h>
+#    include <unistd.h>
+
+#    include <algorithm>
+#    include <cstring>
+#    include <memory>
+#endif
+
+namespace bee::net {
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+    static constexpr uint64_t kTimeoutData = ~(uint64_t)0;
+    static constexpr uint64_t kCancelData  = ~(uint64_t)1;
+    static constexpr unsigned kMaxEntries  = 4096;
+
+    enum class slot_state : uint8_t {
+        free,
+        op,
+        poll,
+    };
+
+    struct uring_slot {
+        uring_request req;
+        slot_state state = slot_state::free;
+    };
+
+    struct uring_native {
+        int fd              = -1;
+        unsigned features   = 0;
+        void* sq_ptr        = MAP_FAILED;
+        size_t sq_size      = 0;
+        void* cq_ptr        = MAP_FAILED;
+        size_t cq_size      = 0;
+        io_uring_sqe* sqes  = (io_uring_sqe*)MAP_FAILED;
+        size_t sqes_size    = 0;
+        unsigned* sq_head   = nullptr;
+        unsigned* sq_tail   = nullptr;
+        unsigned* sq_array  = nullptr;
+        unsigned sq_mask    = 0;
+        unsigned sq_entries = 0;
+        unsigned sq_local   = 0;
+        unsigned to_submit  = 0;
+        unsigned* cq_head   = nullptr;
+        unsigned* cq_tail   = nullptr;
+        unsigned cq_mask    = 0;
+        io_uring_cqe* cqes  = nullptr;
+        size_t inflight     = 0;
+        std::vector<uring_slot> slots;
+        std::vector<uint32_t> freelist;
+        std::vector<uring_completion> pending;
+        ~uring_native() noexcept {
+            if (sqes != MAP_FAILED) {
+                ::munmap(sqes, sqes_size);
+            }
+            if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+                ::munmap(cq_ptr, cq_size);
+            }
+            if (sq_ptr != MAP_FAILED) {
+                ::munmap(sq_ptr, sq_size);
+            }
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+    };
+
+    static int sys_io_uring_setup(unsigned entries, io_uring_params* p) noexcept {
+        return (int)::syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz) noexcept {
+        return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+    }
+
+    static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) noexcept {
+        return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    }
+
+    static bool probe(uring_native* r) noexcept {
+        constexpr unsigned kProbeOps = 256;
+        size_t size                  = sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op);
+        std::unique_ptr<char[]> storage(new (std::nothrow) char[size]);
+        if (!storage) {
+            return false;
+        }
+        memset(storage.get(), 0, size);
+        auto p = (io_uring_probe*)storage.get();
+        if (sys_io_uring_register(r->fd, IORING_REGISTER_PROBE, p, kProbeOps) < 0) {
+            return false;
+        }
+        for (auto op : { IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_POLL_ADD, IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL }) {
+            if (op > p->last_op || !(p->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uring_native* uring_native_create(unsigned entries) noexcept {
+        std::unique_ptr<uring_native> r(new (std::nothrow) uring_native);
+        if (!r) {
+            return nullptr;
+        }
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        r->fd = sys_io_uring_setup(std::clamp(entries, 1u, kMaxEntries), &p);
+        if (r->fd < 0) {
+            return nullptr;
+        }
+        r->features = p.features;
+        r->sq_size  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cq_size  = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            r->sq_size = r->cq_size = std::max(r->sq_size, r->cq_size);
+        }
+        r->sq_ptr = ::mmap(nullptr, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+        if (r->sq_ptr == MAP_FAILED) {
+            return nullptr;
+        }
+        if (single) {
+            r->cq_ptr = r->sq_ptr;
+        } else {
+            r->cq_ptr = ::mmap(nullptr, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+            if (r->cq_ptr == MAP_FAILED) {
+                return nullptr;
+            }
+        }
+        r->sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        r->sqes      = (io_uring_sqe*)::mmap(nullptr, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        if (r->sqes == MAP_FAILED) {
+            return nullptr;
+        }
+        auto sq       = (char*)r->sq_ptr;
+        auto cq       = (char*)r->cq_ptr;
+        r->sq_head    = (unsigned*)(sq + p.sq_off.head);
+        r->sq_tail    = (unsigned*)(sq + p.sq_off.tail);
+        r->sq_array   = (unsigned*)(sq + p.sq_off.array);
+        r->sq_mask    = *(unsigned*)(sq + p.sq_off.ring_mask);
+        r->sq_entries = *(unsigned*)(sq + p.sq_off.ring_entries);
+        r->sq_local   = *r->sq_tail;
+        r->cq_head    = (unsigned*)(cq + p.cq_off.head);
+        r->cq_tail    = (unsigned*)(cq + p.cq_off.tail);
+        r->cq_mask    = *(unsigned*)(cq + p.cq_off.ring_mask);
+        r->cqes       = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        if (!probe(r.get())) {
+            return nullptr;
+        }
+        return r.release();
+    }
+
+    static int enter(uring_native* r, unsigned min_complete, unsigned flags, void* arg, size_t argsz) noexcept {
+        __atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+        int rc = sys_io_uring_enter(r->fd, r->to_submit, min_complete, flags, arg, argsz);
+        if (rc > 0) {
+            r->to_submit -= std::min((unsigned)rc, r->to_submit);
+        }
+        return rc;
+    }
+
+    static io_uring_sqe* get_sqe(uring_native* r) noexcept {
+        unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->sq_local - head >= r->sq_entries) {
+            if (enter(r, 0, 0, nullptr, 0) < 0) {
+                return nullptr;
+            }
+            head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+            if (r->sq_local - head >= r->sq_entries) {
+                return nullptr;
+            }
+        }
+        unsigned index     = r->sq_local & r->sq_mask;
+        io_uring_sqe* sqe  = &r->sqes[index];
+        r->sq_array[index] = index;
+        r->sq_local++;
+        r->to_submit++;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    static bool prep_op(uring_native* r, uint32_t id) noexcept {
+        io_uring_sqe* sqe = get_sqe(r);
+        if (!sqe) {
+            return false;
+        }
+        auto& slot      = r->slots[id];
+        const auto& req = slot.req;
+        sqe->fd         = (int)req.fd;
+        sqe->user_data  = id;
+        switch (req.op) {
+        case uring_op::recv:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->addr   = (uint64_t)(uintptr_t)req.buf;
+            sqe->len    = (uint32_t)std::min<size_t>(req.len, UINT32_MAX);
+            break;
+        case uring_op::send:
+            sqe->opcode    = IORING_OP_SEND;
+            sqe->addr      = (uint64_t)(uintptr_t)req.buf;
+            sqe->len       = (uint32_t)std::min<size_t>(req.len, UINT32_MAX);
+            sqe->msg_flags = MSG_NOSIGNAL;
+            break;
+        case uring_op::accept:
+            sqe->opcode       = IORING_OP_ACCEPT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            break;
+        case uring_op::connect:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr   = (uint64_t)(uintptr_t)req.ep->addr();
+            sqe->off    = req.ep->addrlen();
+            break;
+        }
+        slot.state = slot_state::op;
+        return true;
+    }
+
+    static bool prep_poll(uring_native* r, uint32_t id) noexcept {
+        io_uring_sqe* sqe = get_sqe(r);
+        if (!sqe) {
+            return false;
+        }
+        auto& slot = r->slots[id];
+        bool in    = slot.req.op == uring_op::recv || slot.req.op == uring_op::accept;
+        // poll_events is the low half of poll32_events on either byte order.
+        sqe->opcode      = IORING_OP_POLL_ADD;
+        sqe->fd          = (int)slot.req.fd;
+        sqe->poll_events = in ? POLLIN : POLLOUT;
+        sqe->user_data   = id;
+        slot.state       = slot_state::poll;
+        return true;
+    }
+
+    static void free_slot(uring_native* r, uint32_t id) noexcept {
+        r->slots[id].state = slot_state::free;
+        r->freelist.push_back(id);
+        r->inflight--;
+    }
+
+    bool uring_native_submit(uring_native* r, const uring_request& req) noexcept {
+        uint32_t id;
+        if (!r->freelist.empty()) {
+            id = r->freelist.back();
+            r->freelist.pop_back();
+        } else {
+            id = (uint32_t)r->slots.size();
+            r->slots.emplace_back();
+        }
+        r->slots[id].req = req;
+        r->inflight++;
+        if (!prep_op(r, id)) {
+            free_slot(r, id);
+            return false;
+        }
+        return true;
+    }
+
+    static bool retry(int res, uring_op op) noexcept {
+        switch (res) {
+        case -EAGAIN:
+#    if EAGAIN != EWOULDBLOCK
+        case -EWOULDBLOCK:
+#    endif
+        case -EINTR:
+            return true;
+        case -EINPROGRESS:
+        case -EALREADY:
+            return op == uring_op::connect;
+        case -ECONNABORTED:
+        case -EPROTO:
+            return op == uring_op::accept;
+        default:
+            return false;
+        }
+    }
+
+    static void complete(uring_native* r, uint32_t id, int64_t res, const span<uring_completion>& completions, int& n) noexcept {
+        uring_completion c { r->slots[id].req.data, res };
+        free_slot(r, id);
+        if ((size_t)n < completions.size()) {
+            completions[n++] = c;
+        } else {
+            r->pending.push_back(c);
+        }
+    }
+
+    static void handle(uring_native* r, const io_uring_cqe& cqe, const span<uring_completion>& completions, int& n) noexcept {
+        if (cqe.user_data == kTimeoutData || cqe.user_data >= r->slots.size()) {
+            return;
+        }
+        uint32_t id = (uint32_t)cqe.user_data;
+        auto& slot  = r->slots[id];
+        switch (slot.state) {
+        case slot_state::op:
+            if (retry(cqe.res, slot.req.op)) {
+                if (prep_poll(r, id)) {
+                    return;
+                }
+                complete(r, id, -ENOBUFS, completions, n);
+                return;
+            }
+            complete(r, id, cqe.res, completions, n);
+            return;
+        case slot_state::poll:
+            if (cqe.res < 0) {
+                complete(r, id, cqe.res, completions, n);
+                return;
+            }
+            if (slot.req.op == uring_op::connect) {
+                int err = 0;
+                if (!socket::errcode(slot.req.fd, err)) {
+                    err = errno;
+                }
+                complete(r, id, -(int64_t)err, completions, n);
+                return;
+            }
+            if (prep_op(r, id)) {
+                return;
+            }
+            complete(r, id, -ENOBUFS, completions, n);
+            return;
+        default:
+            return;
+        }
+    }
+
+    static void reap(uring_native* r, const span<uring_completion>& completions, int& n) noexcept {
+        unsigned head = *r->cq_head;
+        for (;;) {
+            unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+            if (head == tail || (size_t)n >= completions.size()) {
+                break;
+            }
+            io_uring_cqe cqe = r->cqes[head & r->cq_mask];
+            head++;
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+            handle(r, cqe, completions, n);
+        }
+    }
+
+    static int64_t monotonic_ms() noexcept {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static bool wait_cqe(uring_native* r, int timeout) noexcept {
+        if (timeout < 0) {
+            return enter(r, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0 || errno == EINTR;
+        }
+        __kernel_timespec ts;
+        ts.tv_sec  = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000;
+#    if defined(IORING_FEAT_EXT_ARG)
+        if (r->features & IORING_FEAT_EXT_ARG) {
+            io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            if (enter(r, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) >= 0) {
+                return true;
+            }
+            return errno == ETIME || errno == EINTR;
+        }
+#    endif
+        io_uring_sqe* sqe = get_sqe(r);
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode    = IORING_OP_TIMEOUT;
+        sqe->fd        = -1;
+        sqe->addr      = (uint64_t)(uintptr_t)&ts;
+        sqe->len       = 1;
+        sqe->off       = 1;
+        sqe->user_data = kTimeoutData;
+        return enter(r, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0 || errno == EINTR;
+    }
+
+    // The kernel keeps writing into the buffers of in-flight requests until
+    // they complete, even after the ring is closed. Cancel them all and wait
+    // for their completions, so the caller may free the buffers afterwards.
+    // Cancels that do not fit in the submission queue are queued as it
+    // drains. Returns false if the requests did not all complete in time;
+    // their buffers must then be leaked rather than freed.
+    static bool drain(uring_native* r) noexcept {
+        constexpr int kDrainTimeout = 1000;
+        int64_t deadline            = monotonic_ms() + kDrainTimeout;
+        uint32_t next               = 0;
+        while (r->inflight > 0) {
+            for (; next < r->slots.size(); ++next) {
+                if (r->slots[next].state == slot_state::free) {
+                    continue;
+                }
+                io_uring_sqe* sqe = get_sqe(r);
+                if (!sqe) {
+                    break;
+                }
+                sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+                sqe->fd        = -1;
+                sqe->addr      = next;
+                sqe->user_data = kCancelData;
+            }
+            int remaining = (int)std::max<int64_t>(deadline - monotonic_ms(), 0);
+            if (remaining == 0) {
+                return false;
+            }
+            // EBUSY: the completion queue overflowed, reaping below makes room.
+            if (!wait_cqe(r, remaining) && errno != EBUSY && errno != EAGAIN) {
+                return false;
+            }
+            unsigned head = *r->cq_head;
+            unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                uint64_t id = r->cqes[head & r->cq_mask].user_data;
+                if (id < r->slots.size() && r->slots[id].state != slot_state::free) {
+                    free_slot(r, (uint32_t)id);
+                }
+            }
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    bool uring_native_destroy(uring_native* r) noexcept {
+        if (!drain(r)) {
+            // the kernel may still write into the request buffers; keep the
+            // ring open so that it never reuses the memory it maps.
+            errno = ETIMEDOUT;
+            return false;
+        }
+        delete r;
+        return true;
+    }
+
+    // A blocking wait submits the queued requests with the same
+    // io_uring_enter that waits for a completion. A wait that does not block
+    // submits them once, at the end. Requests re-armed by the last reap are
+    // submitted by the next wait.
+    int uring_native_wait(uring_native* r, const span<uring_completion>& completions, int timeout) noexcept {
+        int n = 0;
+        if (!r->pending.empty()) {
+            size_t count = std::min(r->pending.size(), completions.size());
+            std::copy_n(r->pending.begin(), count, completions.begin());
+            r->pending.erase(r->pending.begin(), r->pending.begin() + count);
+            n = (int)count;
+        }
+        reap(r, completions, n);
+        bool entered     = false;
+        int64_t deadline = timeout > 0 ? monotonic_ms() + timeout : 0;
+        while (n == 0 && timeout != 0 && r->inflight > 0) {
+            int remaining = -1;
+            if (timeout > 0) {
+                remaining = (int)std::max<int64_t>(deadline - monotonic_ms(), 0);
+            }
+            if (!wait_cqe(r, remaining)) {
+                return -1;
+            }
+            entered = true;
+            reap(r, completions, n);
+            if (timeout > 0 && monotonic_ms() >= deadline) {
+                break;
+            }
+        }
+        if (!entered && r->to_submit > 0) {
+            if (enter(r, 0, 0, nullptr, 0) < 0 && errno != EBUSY && errno != EINTR) {
+                return n > 0 ? n : -1;
+            }
+            reap(r, completions, n);
+        }
+        return n;
+    }
+#else
+    uring_native* uring_native_create(unsigned entries) noexcept {
+        return nullptr;
+    }
+
+    bool uring_native_destroy(uring_native* ring) noexcept {
+        return true;
+    }
+
+    bool uring_native_submit(uring_native* ring, const uring_request& req) noexcept {
+        return false;
+    }
+
+    int uring_native_wait(uring_native* ring, const span<uring_completion>& completions, int timeout) noexcept {
+        return -1;
+    }
+#endif
+}
@@ -44,6 +44,11 @@ namespace bee {
         CloseHandle(h);
     }
 
+    void thread_detach(thread_handle handle) noexcept {
+        HANDLE h = (HANDLE)handle;
+        CloseHandle(h);
+    }
+
     extern "C" NTSTATUS NTAPI NtSetTimerResolution(ULONG RequestedResolution, BOOLEAN Set, PULONG ActualResolution);
 
     static bool is_support_hrtimer() noexcept {
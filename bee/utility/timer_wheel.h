@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bee {
+    // Hierarchical timing wheel with 1 tick resolution. Level 0 has 256
+    // slots, the four upper levels have 64 slots each, so timeouts up to
+    // 2^32-1 ticks are exact and longer ones are clamped. add and cancel are
+    // O(1); update jumps over empty ticks and cascades the upper levels down
+    // when level 0 wraps.
+    class timer_wheel {
+    public:
+        using id_t = uint64_t;
+
+        explicit timer_wheel(uint64_t now = 0) noexcept
+            : jiffies(now + 1) {
+            for (auto& h : heads) {
+                h = nil;
+            }
+        }
+
+        uint64_t now() const noexcept {
+            return jiffies - 1;
+        }
+
+        size_t size() const noexcept {
+            return count;
+        }
+
+        // The timer fires at the first update with now >= now() + timeout.
+        id_t add(uint64_t timeout) {
+            uint32_t i;
+            if (freelist != nil) {
+                i        = freelist;
+                freelist = nodes[i].next;
+            } else {
+                i = (uint32_t)nodes.size();
+                nodes.emplace_back();
+            }
+            auto& n  = nodes[i];
+            n.expire = now() + timeout;
+            place(i);
+            ++count;
+            return ((id_t)n.gen << 32) | i;
+        }
+
+        bool cancel(id_t id) noexcept {
+            uint32_t i = (uint32_t)id;
+            if (i >= nodes.size()) {
+                return false;
+            }
+            auto& n = nodes[i];
+            if (n.list == nil || n.gen != (uint32_t)(id >> 32)) {
+                return false;
+            }
+            unlink(i);
+            release(i);
+            return true;
+        }
+
+        // Advances the wheel to `now` and appends the ids of fired timers to
+        // `fired`, earlier ticks first.
+        void update(uint64_t now, std::vector<id_t>& fired) {
+            while (jiffies <= now) {
+                if (count == 0) {
+                    jiffies = now + 1;
+                    return;
+                }
+                uint64_t due = this->now() + (uint64_t)next();
+                if (due > now) {
+                    jiffies = now + 1;
+                    return;
+                }
+                jiffies        = due;
+                uint32_t index = jiffies & kRootMask;
+                if (index == 0) {
+                    for (int level = 0; level < kLevels; ++level) {
+                        if (cascade(level) != 0) {
+                            break;
+                        }
+                    }
+                }
+                ++jiffies;
+                uint32_t& head = heads[index];
+                while (head != nil) {
+                    uint32_t i = head;
+                    unlink(i);
+                    fired.push_back(((id_t)nodes[i].gen << 32) | i);
+                    release(i);
+                }
+            }
+        }
+
+        // Returns the number of ticks after now() before the next update can
+        // fire a timer, or -1 if there are no timers. Timers in the upper
+        // levels report the start of their slot, so the result may be early
+        // but is never late.
+        int64_t next() const noexcept {
+            if (count == 0) {
+                return -1;
+            }
+            uint64_t best = UINT64_MAX;
+            for (uint32_t i = 0; i < kRootSize; ++i) {
+                if (heads[(jiffies + i) & kRootMask] != nil) {
+                    best = jiffies + i;
+                    break;
+                }
+            }
+            for (int level = 0; level < kLevels; ++level) {
+                int shift      = kRootBits + level * kLevelBits;
+                const auto* tv = &heads[kRootSize + level * kLevelSize];
+                uint64_t block = jiffies >> shift;
+                // Once past the start of the current block its slot has been
+                // cascaded, so a timer found there is one rotation away.
+                uint32_t first = (block << shift) < jiffies ? 1 : 0;
+                for (uint32_t i = first; i < first + kLevelSize; ++i) {
+                    uint64_t start = (block + i) << shift;
+                    if (start >= best) {
+                        break;
+                    }
+                    if (tv[(block + i) & kLevelMask] != nil) {
+                        best = start;
+                        break;
+                    }
+                }
+            }
+            return (int64_t)(best - now());
+        }
+
+    private:
+        static constexpr int kRootBits        = 8;
+        static constexpr int kLevelBits       = 6;
+        static constexpr int kLevels          = 4;
+        static constexpr uint32_t kRootSize   = 1u << kRootBits;
+        static constexpr uint32_t kLevelSize  = 1u << kLevelBits;
+        static constexpr uint32_t kRootMask   = kRootSize - 1;
+        static constexpr uint32_t kLevelMask  = kLevelSize - 1;
+        static constexpr uint64_t kMaxTimeout = (UINT64_C(1) << (kRootBits + kLevels * kLevelBits)) - 1;
+        static constexpr uint32_t nil         = UINT32_MAX;
+
+        struct node {
+            uint64_t expire = 0;
+            uint32_t prev   = nil;
+            uint32_t next   = nil;
+            uint32_t list   = nil;
+            uint32_t gen    = 1;
+        };
+
+        uint32_t slot(uint64_t expire) const noexcept {
+            if (expire < jiffies) {
+                return jiffies & kRootMask;
+            }
+            uint64_t idx = expire - jiffies;
+            if (idx < kRootSize) {
+                return expire & kRootMask;
+            }
+            for (int level = 0; level < kLevels; ++level) {
+                int shift = kRootBits + (level + 1) * kLevelBits;
+                if (level == kLevels - 1 || idx < (UINT64_C(1) << shift)) {
+                    return kRootSize + level * kLevelSize + ((expire >> (shift - kLevelBits)) & kLevelMask);
+                }
+            }
+            return nil;
+        }
+
+        void place(uint32_t i) noexcept {
+            auto& n = nodes[i];
+            if (n.expire > jiffies && n.expire - jiffies > kMaxTimeout) {
+                n.expire = jiffies + kMaxTimeout;
+            }
+            uint32_t list = slot(n.expire);
+            n.list        = list;
+            n.prev        = nil;
+            n.next        = heads[list];
+            if (n.next != nil) {
+                nodes[n.next].prev = i;
+            }
+            heads[list] = i;
+        }
+
+        void unlink(uint32_t i) noexcept {
+            auto& n = nodes[i];
+            if (n.prev != nil) {
+                nodes[n.prev].next = n.next;
+            } else {
+                heads[n.list] = n.next;
+            }
+            if (n.next != nil) {
+                nodes[n.next].prev = n.prev;
+            }
+            n.list = nil;
+        }
+
+        void release(uint32_t i) noexcept {
+            auto& n = nodes[i];
+            n.gen   = (n.gen + 1) & 0x7fffffff;
+            if (n.gen == 0) {
+                n.gen = 1;
+            }
+            n.next   = freelist;
+            freelist = i;
+            --count;
+        }
+
+        // Moves the slot of `level` that covers the current tick down to the
+        // lower levels. Returns the slot index, which is 0 when the next
+        // level needs to cascade too.
+        uint32_t cascade(int level) noexcept {
+            uint32_t index = (jiffies >> (kRootBits + level * kLevelBits)) & kLevelMask;
+            uint32_t& head = heads[kRootSize + level * kLevelSize + index];
+            uint32_t i     = head;
+            head           = nil;
+            while (i != nil) {
+                uint32_t next = nodes[i].next;
+                place(i);
+                i = next;
+            }
+            return index;
+        }
+
+        std::vector<node> nodes;
+        uint32_t heads[kRootSize + kLevels * kLevelSize];
+        uint32_t freelist = nil;
+        size_t count      = 0;
+        uint64_t jiffies;
+    };
+}
@@ -0,0 +1,115 @@
+local reactor = require "bee.reactor"
+local socket = require "bee.socket"
+local channel = require "bee.channel"
+local epoll = require "bee.epoll"
+
+local MAX_REACTORS = tonumber(arg and arg[1]) or 4
+local CONNECTIONS = 64
+local DURATION = 2000
+local PAYLOAD = 64
+
+local server = [[
+    local ctx = ...
+    local epoll = require "bee.epoll"
+    ctx:on_accept(function (fd)
+        ctx:add(fd, epoll.EPOLLIN, function ()
+            local data = fd:recv()
+            if data then
+                fd:send(data)
+            elseif data == nil then
+                ctx:del(fd)
+                fd:close()
+            end
+        end)
+    end)
+    ctx:on_post(function (listener)
+        ctx:accept(listener)
+    end)
+]]
+
+local client = [[
+    local ctx, port, connections, duration, payload = ...
+    local socket = require "bee.socket"
+    local epoll = require "bee.epoll"
+    local chan = require "bee.channel".query "bench_echo"
+    local msg = ("x"):rep(payload)
+    local bytes = 0
+    local running = true
+    for _ = 1, connections do
+        local fd = assert(socket.create "tcp")
+        fd:option("nodelay", 1)
+        fd:connect("127.0.0.1", port)
+        local pending = 0
+        ctx:add(fd, epoll.EPOLLOUT, function (e)
+            if pending == 0 then
+                ctx:mod(fd, epoll.EPOLLIN)
+                fd:send(msg)
+                pending = payload
+                return
+            end
+            local data = fd:recv()
+            if not data then
+                return
+            end
+            bytes = bytes + #data
+            pending = pending - #data
+            if pending == 0 and running then
+                fd:send(msg)
+                pending = payload
+            end
+        end)
+    end
+    ctx:timeout(duration, function ()
+        running = false
+        chan:push(bytes // payload)
+    end)
+]]
+
+local chan = channel.create "bench_echo"
+local poll <close> = epoll.create(4)
+poll:event_add(chan:fd(), epoll.EPOLLIN)
+
+local function collect(n)
+    local total = 0
+    while n > 0 do
+        for _ in poll:wait() do
+        end
+        while true do
+            local ok, count = chan:pop()
+            if not ok then
+                break
+            end
+            total = total + count
+            n = n - 1
+        end
+    end
+    return total
+end
+
+local function bench(n)
+    local shards = assert(socket.listen_shards("tcp", n, "127.0.0.1", 0))
+    local _, port = shards[1]:info "socket":value()
+    local srv <close> = reactor.start(n, server)
+    for i, fd in ipairs(shards) do
+        srv:post(i, fd)
+        fd:close()
+    end
+    local cli <close> = reactor.start(n, client, port, CONNECTIONS // n, DURATION, PAYLOAD)
+    local total = collect(n)
+    cli:stop()
+    cli:wait()
+    srv:stop()
+    srv:wait()
+    assert(srv:errlog() == nil)
+    assert(cli:errlog() == nil)
+    return total
+end
+
+print(("%d connections, %d byte messages, %d ms per run"):format(CONNECTIONS, PAYLOAD, DURATION))
+local n = 1
+while n <= MAX_REACTORS do
+    local total = bench(n)
+    print(("%2d reactors %12.0f requests/s"):format(n, total / (DURATION / 1000)))
+    n = n * 2
+end
+channel.destroy "bench_echo"
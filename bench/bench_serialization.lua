@@ -0,0 +1,122 @@
+local seri = require "bee.serialization"
+local time = require "bee.time"
+
+local filter = arg and arg[1]
+
+local function measure(n, f)
+    f()
+    collectgarbage "collect"
+    collectgarbage "stop"
+    local mem = collectgarbage "count"
+    f()
+    local alloc = collectgarbage "count" - mem
+    collectgarbage "restart"
+    collectgarbage "collect"
+    local start = time.monotonic()
+    for _ = 1, n do
+        f()
+    end
+    local elapsed = time.monotonic() - start
+    return elapsed / n, alloc
+end
+
+local function report(name, size, ms, alloc)
+    local mbps = ms > 0 and size / 1024 / 1024 / (ms / 1000) or math.huge
+    print(("%-28s %10.4f ms/op %10.1f MB/s %10.1f KB/op"):format(name, ms, mbps, alloc))
+end
+
+local function scalars()
+    return 1, -1, 0x7fffffff, math.maxinteger, 0.5, true, false, nil, "bee", print
+end
+
+local function tree(depth, width)
+    if depth == 0 then
+        return { leaf = true, value = 0.25 }
+    end
+    local t = { depth = depth }
+    for i = 1, width do
+        t[i] = tree(depth - 1, width)
+    end
+    return t
+end
+
+local function chain(depth)
+    local t = { name = "leaf" }
+    for i = 1, depth do
+        t = { i, t }
+    end
+    return t
+end
+
+local function dict(n)
+    local t = {}
+    for i = 1, n do
+        t["key"..i] = i
+    end
+    return t
+end
+
+local function array(n, f)
+    local t = {}
+    for i = 1, n do
+        t[i] = f(i)
+    end
+    return t
+end
+
+local function records(n)
+    return array(n, function (i)
+        return {
+            id = i,
+            name = "name"..i,
+            x = i * 0.5,
+            y = i * 1.5,
+            tag = "tag",
+            flag = i % 2 == 0,
+        }
+    end)
+end
+
+local function references(n)
+    local shared = array(n, function (i)
+        return { id = i }
+    end)
+    local t = {}
+    for i = 1, n * 4 do
+        t[i] = shared[(i * 7) % n + 1]
+    end
+    t.self = t
+    return t
+end
+
+local corpus = {
+    { "scalars", 100000, table.pack(scalars()) },
+    { "tree 4^8", 5, { tree(8, 4) } },
+    { "chain 30", 100000, { chain(30) } },
+    { "dict 100", 5000, { dict(100) } },
+    { "dict 10000", 50, { dict(10000) } },
+    { "dict 1000000", 2, { dict(1000000) } },
+    { "array int8 1000000", 10, { array(1000000, function (i) return i % 256 end) } },
+    { "array int64 1000000", 10, { array(1000000, function (i) return i * 0x100000000 end) } },
+    { "array real 1000000", 10, { array(1000000, function (i) return i * 0.5 end) } },
+    { "array mixed 100000", 20, { array(100000, function (i) return i % 3 == 0 and "s" or i end) } },
+    { "records 10000", 20, { records(10000) } },
+    { "strings short 100000", 10, { array(100000, function (i) return "str"..i end) } },
+    { "strings long 16x64K", 200, { array(16, function (i) return ("x"):rep(65536 + i) end) } },
+    { "references 10000", 20, { references(10000) } },
+}
+
+for _, c in ipairs(corpus) do
+    local name, n, data = c[1], c[2], c[3]
+    if not filter or name:find(filter, 1, true) then
+        local str = seri.packstring(table.unpack(data, 1, data.n or #data))
+        local ms, alloc = measure(n, function ()
+            seri.packstring(table.unpack(data, 1, data.n or #data))
+        end)
+        report(name.." pack", #str, ms, alloc)
+        ms, alloc = measure(n, function ()
+            seri.unpack(str)
+        end)
+        report(name.." unpack", #str, ms, alloc)
+    end
+end
@@ -0,0 +1,85 @@
+local socket = require "bee.socket"
+local select = require "bee.select"
+local time = require "bee.time"
+
+local PACKETS = tonumber(arg and arg[1]) or 200000
+local BATCH = 64
+local PAYLOAD = ("x"):rep(128)
+
+local function open()
+    local fd = assert(socket.create "udp")
+    assert(fd:bind("127.0.0.1", 0))
+    return fd, fd:info "socket"
+end
+
+local sender = open()
+local receiver, receiver_ep = open()
+local poll <close> = select.create()
+poll:event_add(receiver, select.SELECT_READ)
+
+local function wait_readable()
+    for _ in poll:wait(1000) do
+    end
+end
+
+local function report(name, elapsed)
+    local pps = elapsed > 0 and PACKETS / (elapsed / 1000) or math.huge
+    print(("%-24s %10.1f ms %12.0f packets/s"):format(name, elapsed, pps))
+end
+
+local function bench_single()
+    local received = 0
+    local start = time.monotonic()
+    while received < PACKETS do
+        local n = math.min(BATCH, PACKETS - received)
+        for _ = 1, n do
+            assert(sender:sendto(PAYLOAD, receiver_ep))
+        end
+        local got = 0
+        while got < n do
+            local data = receiver:recvfrom(2048)
+            if data then
+                got = got + 1
+            else
+                wait_readable()
+            end
+        end
+        received = received + got
+    end
+    return time.monotonic() - start
+end
+
+local function bench_batch()
+    local payloads = {}
+    for i = 1, BATCH do
+        payloads[i] = PAYLOAD
+    end
+    local datas, endpoints = {}, {}
+    local received = 0
+    local start = time.monotonic()
+    while received < PACKETS do
+        local n = math.min(BATCH, PACKETS - received)
+        local sent = 0
+        while sent < n do
+            sent = sent + assert(sender:sendmmsg(payloads, receiver_ep, n - sent))
+        end
+        local got = 0
+        while got < n do
+            local r = receiver:recvmmsg(n - got, 2048, datas, endpoints)
+            if r then
+                got = got + r
+            else
+                wait_readable()
+            end
+        end
+        received = received + got
+    end
+    return time.monotonic() - start
+end
+
+print(("%d packets of %d bytes, batch %d"):format(PACKETS, #PAYLOAD, BATCH))
+report("sendto/recvfrom", bench_single())
+report("sendmmsg/recvmmsg", bench_batch())
+
+sender:close()
+receiver:close()
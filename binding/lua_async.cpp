@@ -0,0 +1,503 @@
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/luaref.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/net/bpoll.h>
+#include <bee/net/socket.h>
+#include <bee/nonstd/to_underlying.h>
+#include <bee/nonstd/unreachable.h>
+#include <bee/utility/dynarray.h>
+#include <bee/utility/flatmap.h>
+#include <bee/utility/timer_wheel.h>
+#include <binding/lua_socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace bee::lua_async {
+    constexpr int kMaxEvents = 256;
+
+    static uint64_t monotonic() noexcept {
+        using namespace std::chrono;
+        return (uint64_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Tasks parked on an fd, at most one per direction.
+    struct waiter {
+        int reader      = LUA_NOREF;
+        int writer      = LUA_NOREF;
+        uint32_t events = 0;
+    };
+
+    // Runs coroutines on one bpoll handle. A task that has to wait parks
+    // itself on an fd or a timer and yields through a C continuation; the
+    // loop moves it back to the ready queue once the wait is over, so
+    // waiting costs no Lua allocation.
+    struct scheduler {
+        net::bpoll_handle fd;
+        luaref ref;
+        flatmap<lua_State*, int> tasks;
+        flatmap<net::fd_t, waiter> waiters;
+        flatmap<timer_wheel::id_t, int> timers;
+        std::deque<int> ready;
+        dynarray<net::bpoll_event_t> events;
+        timer_wheel wheel;
+        std::vector<timer_wheel::id_t> fired;
+        bool parked   = false;
+        bool running  = false;
+        bool stopping = false;
+        scheduler(lua_State* L, net::bpoll_handle fd)
+            : fd(fd)
+            , ref(luaref_init(L))
+            , events(kMaxEvents)
+            , wheel(monotonic()) {}
+        ~scheduler() {
+            net::bpoll_close(fd);
+            luaref_close(ref);
+        }
+    };
+
+    // The scheduler whose run() is on the C stack, shared by all tasks
+    // through the registry.
+    static int kCurrent = 0;
+
+    static scheduler& checksched(lua_State* L) {
+        return lua::checkudata<scheduler>(L, 1);
+    }
+
+    static scheduler& current(lua_State* L, int& task) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &kCurrent);
+        auto s = (scheduler*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if (s) {
+            if (auto t = s->tasks.find(L)) {
+                if (!lua_isyieldable(L)) {
+                    luaL_error(L, "attempt to wait across a C-call boundary.");
+                }
+                task = *t;
+                return *s;
+            }
+        }
+        luaL_error(L, "not in an async task.");
+        std::unreachable();
+    }
+
+    static bool update(scheduler& s, net::fd_t fd, waiter& w) {
+        uint32_t want = 0;
+        if (w.reader != LUA_NOREF) {
+            want |= std::to_underlying(net::bpoll_event::in);
+        }
+        if (w.writer != LUA_NOREF) {
+            want |= std::to_underlying(net::bpoll_event::out);
+        }
+        if (want == w.events) {
+            return true;
+        }
+        if (want == 0) {
+            net::bpoll_ctl_del(s.fd, fd);
+            s.waiters.erase(fd);
+            return true;
+        }
+        net::bpoll_event_t ev;
+        ev.events   = static_cast<decltype(ev.events)>(want);
+        ev.data.u64 = (uint64_t)fd;
+        bool ok     = w.events == 0 ? net::bpoll_ctl_add(s.fd, fd, ev) : net::bpoll_ctl_mod(s.fd, fd, ev);
+        if (ok) {
+            w.events = want;
+        }
+        return ok;
+    }
+
+    static int wait_fd(lua_State* L, net::fd_t fd, bool write, lua_KContext ctx, lua_KFunction k) {
+        int task;
+        auto& s = current(L, task);
+        auto w  = s.waiters.find(fd);
+        if (!w) {
+            s.waiters.insert(fd, waiter {});
+            w = s.waiters.find(fd);
+        }
+        int& slot = write ? w->writer : w->reader;
+        if (slot != LUA_NOREF) {
+            return luaL_error(L, "another task is already %s this socket.", write ? "writing" : "reading");
+        }
+        slot = task;
+        if (!update(s, fd, *w)) {
+            slot = LUA_NOREF;
+            if (w->events == 0) {
+                s.waiters.erase(fd);
+            }
+            return lua::return_net_error(L, "epoll_ctl");
+        }
+        s.parked = true;
+        return lua_yieldk(L, 0, ctx, k);
+    }
+
+    static void wake_fd(scheduler& s, const net::bpoll_event_t& ev) {
+        auto fd = (net::fd_t)ev.data.u64;
+        auto w  = s.waiters.find(fd);
+        if (!w) {
+            return;
+        }
+        uint32_t events = static_cast<uint32_t>(ev.events);
+        uint32_t failed = std::to_underlying(net::bpoll_event::err | net::bpoll_event::hup);
+        if (w->reader != LUA_NOREF && (events & (std::to_underlying(net::bpoll_event::in) | failed))) {
+            s.ready.push_back(w->reader);
+            w->reader = LUA_NOREF;
+        }
+        if (w->writer != LUA_NOREF && (events & (std::to_underlying(net::bpoll_event::out) | failed))) {
+            s.ready.push_back(w->writer);
+            w->writer = LUA_NOREF;
+        }
+        update(s, fd, *w);
+    }
+
+    static void wake_timers(scheduler& s) {
+        s.fired.clear();
+        s.wheel.update(monotonic(), s.fired);
+        for (auto tid : s.fired) {
+            if (auto task = s.timers.find(tid)) {
+                s.ready.push_back(*task);
+                s.timers.erase(tid);
+            }
+        }
+    }
+
+    static void finish(scheduler& s, lua_State* co, int task) {
+        s.tasks.erase(co);
+        luaref_unref(s.ref, task);
+    }
+
+    static void resume(lua_State* L, scheduler& s, int task) {
+        luaref_get(s.ref, L, task);
+        lua_State* co = lua_tothread(L, -1);
+        lua_pop(L, 1);
+        int nargs = lua_status(co) == LUA_OK ? lua_gettop(co) - 1 : 0;
+        int nres;
+        s.parked   = false;
+        int status = lua_resume(co, L, nargs, &nres);
+        switch (status) {
+        case LUA_YIELD:
+            lua_pop(co, nres);
+            if (!s.parked) {
+                s.ready.push_back(task);
+            }
+            break;
+        case LUA_OK:
+            finish(s, co, task);
+            break;
+        default: {
+            const char* msg = lua_tostring(co, -1);
+            luaL_traceback(L, co, msg ? msg : "(error object is not a string)", 0);
+            lua_closethread(co, L);
+            finish(s, co, task);
+            lua_error(L);
+        }
+        }
+    }
+
+    static int loop(lua_State* L) {
+        auto& s = checksched(L);
+        while (!s.stopping && !s.tasks.empty()) {
+            wake_timers(s);
+            for (size_t n = s.ready.size(); n > 0 && !s.stopping; --n) {
+                int task = s.ready.front();
+                s.ready.pop_front();
+                resume(L, s, task);
+            }
+            if (s.stopping || s.tasks.empty()) {
+                break;
+            }
+            int timeout = 0;
+            if (s.ready.empty()) {
+                if (s.waiters.empty() && s.timers.empty()) {
+                    // every remaining task waits on something no one can wake.
+                    break;
+                }
+                int64_t next = s.wheel.next();
+                timeout      = next < 0 ? -1 : (int)std::min<int64_t>(next, INT32_MAX);
+            }
+            int n = net::bpoll_wait(s.fd, s.events, timeout);
+            if (n == -1) {
+                lua::push_net_error(L, "epoll_wait");
+                lua_error(L);
+            }
+            for (int i = 0; i < n; ++i) {
+                wake_fd(s, s.events[i]);
+            }
+        }
+        return 0;
+    }
+
+    static int run(lua_State* L) {
+        auto& s = checksched(L);
+        if (s.running) {
+            return luaL_error(L, "scheduler is already running.");
+        }
+        lua_settop(L, 1);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &kCurrent);
+        lua_pushlightuserdata(L, &s);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &kCurrent);
+        s.running  = true;
+        s.stopping = false;
+        lua_pushcfunction(L, loop);
+        lua_pushvalue(L, 1);
+        int status = lua_pcall(L, 1, 0, 0);
+        s.running  = false;
+        lua_pushvalue(L, 2);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &kCurrent);
+        if (status != LUA_OK) {
+            return lua_error(L);
+        }
+        lua_pushinteger(L, (lua_Integer)s.tasks.size());
+        return 1;
+    }
+
+    static int spawn(lua_State* L) {
+        auto& s = checksched(L);
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        int n         = lua_gettop(L) - 1;
+        lua_State* co = lua_newthread(L);
+        lua_rotate(L, 2, 1);
+        lua_xmove(L, co, n);
+        int task = luaref_ref(s.ref, L);
+        if (task == LUA_NOREF) {
+            return luaL_error(L, "Too many tasks.");
+        }
+        s.tasks.insert(co, task);
+        s.ready.push_back(task);
+        return 0;
+    }
+
+    static int stop(lua_State* L) {
+        auto& s    = checksched(L);
+        s.stopping = true;
+        return 0;
+    }
+
+    static int size(lua_State* L) {
+        auto& s = checksched(L);
+        lua_pushinteger(L, (lua_Integer)s.tasks.size());
+        return 1;
+    }
+
+    static void metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "spawn", spawn },
+            { "run", run },
+            { "stop", stop },
+            { "size", size },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+    }
+
+    static int create(lua_State* L) {
+        auto epfd = net::bpoll_create();
+        if (epfd == net::invalid_bpoll_handle) {
+            return lua::return_net_error(L, "epoll_create");
+        }
+        lua::newudata<scheduler>(L, L, epfd);
+        return 1;
+    }
+
+    static net::fd_t tofd(lua_State* L, int idx) {
+        if (lua_type(L, idx) == LUA_TLIGHTUSERDATA) {
+            return lua::tolightud<net::fd_t>(L, idx);
+        }
+        return lua_socket::checkfd(L, idx);
+    }
+
+    static int read_k(lua_State* L, int, lua_KContext) {
+        auto fd  = lua_socket::checkfd(L, 1);
+        auto len = lua::optinteger<int, LUAL_BUFFERSIZE>(L, 2);
+        luaL_argcheck(L, len > 0, 2, "length must be positive");
+        lua_settop(L, 2);
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        char* buf = luaL_prepbuffsize(&b, (size_t)len);
+        int rc;
+        switch (net::socket::recv(fd, rc, buf, len)) {
+        case net::socket::recv_status::close:
+            lua_pushnil(L);
+            return 1;
+        case net::socket::recv_status::wait:
+            lua_settop(L, 2);
+            return wait_fd(L, fd, false, 0, read_k);
+        case net::socket::recv_status::success:
+            luaL_pushresultsize(&b, rc);
+            return 1;
+        case net::socket::recv_status::failed:
+            return lua::return_net_error(L, "recv");
+        default:
+            std::unreachable();
+        }
+    }
+
+    static int read(lua_State* L) {
+        return read_k(L, LUA_OK, 0);
+    }
+
+    // The context carries how many bytes have been sent so far.
+    static int write_k(lua_State* L, int, lua_KContext ctx) {
+        auto fd    = lua_socket::checkfd(L, 1);
+        auto buf   = lua::checkstrview(L, 2);
+        size_t off = (size_t)ctx;
+        while (off < buf.size()) {
+            int rc;
+            switch (net::socket::send(fd, rc, buf.data() + off, (int)std::min(buf.size() - off, (size_t)INT_MAX))) {
+            case net::socket::status::success:
+                off += (size_t)rc;
+                break;
+            case net::socket::status::wait:
+                return wait_fd(L, fd, true, (lua_KContext)off, write_k);
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "send");
+            default:
+                std::unreachable();
+            }
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int write(lua_State* L) {
+        return write_k(L, LUA_OK, 0);
+    }
+
+    static int accept_k(lua_State* L, int, lua_KContext) {
+        auto fd = lua_socket::checkfd(L, 1);
+        net::fd_t newfd;
+        switch (net::socket::accept(fd, newfd)) {
+        case net::socket::status::success:
+            lua_socket::pushfd(L, newfd);
+            return 1;
+        case net::socket::status::wait:
+            return wait_fd(L, fd, false, 0, accept_k);
+        case net::socket::status::failed:
+            return lua::return_net_error(L, "accept");
+        default:
+            std::unreachable();
+        }
+    }
+
+    static int accept(lua_State* L) {
+        return accept_k(L, LUA_OK, 0);
+    }
+
+    // Calls fd:<name>() with the arguments above the fd, leaving two
+    // results on the stack.
+    static void callmethod(lua_State* L, const char* name) {
+        int n = lua_gettop(L);
+        lua_getfield(L, 1, name);
+        for (int i = 1; i <= n; ++i) {
+            lua_pushvalue(L, i);
+        }
+        lua_call(L, n, 2);
+    }
+
+    static int connect_k(lua_State* L, int, lua_KContext) {
+        lua_settop(L, 1);
+        callmethod(L, "status");
+        if (lua_isnil(L, -2)) {
+            return 2;
+        }
+        lua_pop(L, 1);
+        return 1;
+    }
+
+    static int connect(lua_State* L) {
+        auto fd = lua_socket::checkfd(L, 1);
+        callmethod(L, "connect");
+        if (lua_isnil(L, -2)) {
+            return 2;
+        }
+        if (lua_toboolean(L, -2)) {
+            lua_pop(L, 1);
+            return 1;
+        }
+        lua_settop(L, 1);
+        return wait_fd(L, fd, true, 0, connect_k);
+    }
+
+    static int pop_k(lua_State* L, int, lua_KContext) {
+        lua_settop(L, 1);
+        lua_getfield(L, 1, "pop");
+        lua_pushvalue(L, 1);
+        lua_call(L, 1, LUA_MULTRET);
+        if (lua_toboolean(L, 2)) {
+            return lua_gettop(L) - 2;
+        }
+        lua_settop(L, 1);
+        lua_getfield(L, 1, "fd");
+        lua_pushvalue(L, 1);
+        lua_call(L, 1, 1);
+        auto fd = lua::tolightud<net::fd_t>(L, 2);
+        lua_settop(L, 1);
+        return wait_fd(L, fd, false, 0, pop_k);
+    }
+
+    static int pop(lua_State* L) {
+        luaL_checktype(L, 1, LUA_TUSERDATA);
+        return pop_k(L, LUA_OK, 0);
+    }
+
+    static int readable(lua_State* L) {
+        return wait_fd(L, tofd(L, 1), false, 0, NULL);
+    }
+
+    static int writable(lua_State* L) {
+        return wait_fd(L, tofd(L, 1), true, 0, NULL);
+    }
+
+    static int sleep(lua_State* L) {
+        auto ms = lua::checkinteger<int64_t>(L, 1);
+        luaL_argcheck(L, ms >= 0, 1, "timeout must be non-negative");
+        int task;
+        auto& s      = current(L, task);
+        uint64_t now = monotonic();
+        uint64_t lag = now > s.wheel.now() ? now - s.wheel.now() : 0;
+        s.timers.insert(s.wheel.add((uint64_t)ms + lag), task);
+        s.parked = true;
+        return lua_yield(L, 0);
+    }
+
+    static int yield(lua_State* L) {
+        int task;
+        current(L, task);
+        return lua_yield(L, 0);
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "create", create },
+            { "read", read },
+            { "write", write },
+            { "accept", accept },
+            { "connect", connect },
+            { "pop", pop },
+            { "readable", readable },
+            { "writable", writable },
+            { "sleep", sleep },
+            { "yield", yield },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(async)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_async::scheduler> {
+        static inline auto metatable = bee::lua_async::metatable;
+    };
+}
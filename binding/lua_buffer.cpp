@@ -0,0 +1,246 @@
+#include <bee/lua/binding.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <binding/lua_buffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace bee::lua_buffer {
+    buffer::~buffer() noexcept {
+        std::free(storage);
+    }
+
+    char* buffer::prepare(size_t n) noexcept {
+        if (cap - wpos >= n) {
+            return storage + wpos;
+        }
+        size_t len = size();
+        if (cap - len >= n) {
+            std::memmove(storage, storage + rpos, len);
+            rpos = 0;
+            wpos = len;
+            return storage + wpos;
+        }
+        size_t newcap = std::max<size_t>(cap * 2, 64);
+        while (newcap - len < n) {
+            if (newcap > (SIZE_MAX / 2)) {
+                newcap = len + n;
+                if (newcap < len) {
+                    return nullptr;
+                }
+                break;
+            }
+            newcap *= 2;
+        }
+        char* newstorage = (char*)std::malloc(newcap);
+        if (!newstorage) {
+            return nullptr;
+        }
+        if (len > 0) {
+            std::memcpy(newstorage, storage + rpos, len);
+        }
+        std::free(storage);
+        storage = newstorage;
+        cap     = newcap;
+        rpos    = 0;
+        wpos    = len;
+        return storage + wpos;
+    }
+
+    void buffer::consume(size_t n) noexcept {
+        if (n >= size()) {
+            clear();
+            return;
+        }
+        rpos += n;
+    }
+
+    bool buffer::append(const char* str, size_t n) noexcept {
+        if (n == 0) {
+            return true;
+        }
+        char* p = prepare(n);
+        if (!p) {
+            return false;
+        }
+        std::memcpy(p, str, n);
+        commit(n);
+        return true;
+    }
+
+    buffer& checkbuffer(lua_State* L, int idx) {
+        return lua::checkudata<buffer>(L, idx);
+    }
+
+    static size_t optlength(lua_State* L, int idx, size_t def) {
+        if (lua_isnoneornil(L, idx)) {
+            return def;
+        }
+        lua_Integer n = luaL_checkinteger(L, idx);
+        luaL_argcheck(L, n >= 0, idx, "length must be non-negative");
+        return std::min((size_t)n, def);
+    }
+
+    static const char* search(const char* s, size_t len, const char* p, size_t plen) {
+        if (plen == 0) {
+            return s;
+        }
+        if (plen > len) {
+            return nullptr;
+        }
+        const char* last = s + (len - plen);
+        while (s <= last) {
+            s = (const char*)std::memchr(s, p[0], (size_t)(last - s) + 1);
+            if (!s) {
+                return nullptr;
+            }
+            if (std::memcmp(s + 1, p + 1, plen - 1) == 0) {
+                return s;
+            }
+            ++s;
+        }
+        return nullptr;
+    }
+
+    static int write(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        int n      = lua_gettop(L);
+        for (int i = 2; i <= n; ++i) {
+            auto str = lua::checkstrview(L, i);
+            if (!self.append(str.data(), str.size())) {
+                return luaL_error(L, "not enough memory");
+            }
+        }
+        return 0;
+    }
+
+    static int read(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        size_t n   = optlength(L, 2, self.size());
+        lua_pushlstring(L, self.data(), n);
+        self.consume(n);
+        return 1;
+    }
+
+    static int peek(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        size_t n   = optlength(L, 2, self.size());
+        lua_pushlstring(L, self.data(), n);
+        return 1;
+    }
+
+    static int consume(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        size_t n   = optlength(L, 2, self.size());
+        self.consume(n);
+        lua_pushinteger(L, (lua_Integer)n);
+        return 1;
+    }
+
+    static int find(lua_State* L) {
+        auto& self       = checkbuffer(L, 1);
+        auto pattern     = lua::checkstrview(L, 2);
+        lua_Integer init = luaL_optinteger(L, 3, 1);
+        luaL_argcheck(L, init >= 1, 3, "initial position must be positive");
+        size_t len = self.size();
+        if ((size_t)(init - 1) > len) {
+            return 0;
+        }
+        const char* s = self.data();
+        const char* r = search(s + (init - 1), len - (size_t)(init - 1), pattern.data(), pattern.size());
+        if (!r) {
+            return 0;
+        }
+        lua_pushinteger(L, (lua_Integer)(r - s) + 1);
+        lua_pushinteger(L, (lua_Integer)(r - s + pattern.size()));
+        return 2;
+    }
+
+    static int reserve(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        auto n     = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, n >= 0, 2, "length must be non-negative");
+        if (n > 0 && !self.prepare((size_t)n)) {
+            return luaL_error(L, "not enough memory");
+        }
+        return 0;
+    }
+
+    static int capacity(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        lua_pushinteger(L, (lua_Integer)self.capacity());
+        return 1;
+    }
+
+    static int clear(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        self.clear();
+        return 0;
+    }
+
+    static int mt_len(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        lua_pushinteger(L, (lua_Integer)self.size());
+        return 1;
+    }
+
+    static int mt_tostring(lua_State* L) {
+        auto& self = checkbuffer(L, 1);
+        lua_pushfstring(L, "buffer (%I)", (lua_Integer)self.size());
+        return 1;
+    }
+
+    static void metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "write", write },
+            { "read", read },
+            { "peek", peek },
+            { "consume", consume },
+            { "find", find },
+            { "reserve", reserve },
+            { "capacity", capacity },
+            { "clear", clear },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        luaL_Reg mt[] = {
+            { "__len", mt_len },
+            { "__tostring", mt_tostring },
+            { NULL, NULL },
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int create(lua_State* L) {
+        lua_Integer n = luaL_optinteger(L, 1, 0);
+        luaL_argcheck(L, n >= 0, 1, "capacity must be non-negative");
+        auto& self = lua::newudata<buffer>(L);
+        if (n > 0 && !self.prepare((size_t)n)) {
+            return luaL_error(L, "not enough memory");
+        }
+        return 1;
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "create", create },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(buffer)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_buffer::buffer> {
+        static inline auto metatable = bee::lua_buffer::metatable;
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <lua.hpp>
+
+#include <cstddef>
+
+namespace bee::lua_buffer {
+    // A growable byte buffer. Bytes in [rpos, wpos) are readable, bytes in
+    // [wpos, cap) are writable. The readable region is moved to the front
+    // before the storage grows.
+    class buffer {
+    public:
+        buffer() noexcept = default;
+        ~buffer() noexcept;
+        buffer(const buffer&)            = delete;
+        buffer& operator=(const buffer&) = delete;
+        const char* data() const noexcept {
+            return storage + rpos;
+        }
+        size_t size() const noexcept {
+            return wpos - rpos;
+        }
+        size_t capacity() const noexcept {
+            return cap;
+        }
+        size_t writable() const noexcept {
+            return cap - wpos;
+        }
+        char* prepare(size_t n) noexcept;
+        void commit(size_t n) noexcept {
+            wpos += n;
+        }
+        void consume(size_t n) noexcept;
+        bool append(const char* str, size_t n) noexcept;
+        void clear() noexcept {
+            rpos = wpos = 0;
+        }
+
+    private:
+        char* storage = nullptr;
+        size_t cap    = 0;
+        size_t rpos   = 0;
+        size_t wpos   = 0;
+    };
+
+    buffer& checkbuffer(lua_State* L, int idx);
+}
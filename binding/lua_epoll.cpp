@@ -1,19 +1,80 @@
+#include <3rd/lua-seri/lua-seri.h>
 #include <bee/lua/binding.h>
 #include <bee/lua/error.h>
 #include <bee/lua/luaref.h>
 #include <bee/lua/module.h>
 #include <bee/lua/udata.h>
 #include <bee/net/bpoll.h>
+#include <bee/net/event.h>
 #include <bee/nonstd/to_underlying.h>
 #include <bee/utility/dynarray.h>
+#include <bee/utility/flatmap.h>
+#include <binding/lua_epoll.h>
+#include <binding/lua_socket.h>
+
+#include <atomic>
+#include <mutex>
+#include <new>
 
 namespace bee::lua_epoll {
+    // A wakeup event shared between an epoll and the threads that notify
+    // it. Notifications are coalesced until the epoll reports the event.
+    struct waker;
+
+    // Wakers that have been packed, by id. A packed buffer only names its
+    // waker, so it may be unpacked any number of times; unpacking after the
+    // last handle is gone fails instead of touching freed memory.
+    namespace packed {
+        static std::mutex mutex;
+        static lua_Integer next = 0;
+        static flatmap<lua_Integer, waker *> wakers;
+    }
+
+    struct waker {
+        std::atomic<int> refs = 1;
+        lua_Integer id        = 0;
+        net::event ev;
+        void retain() noexcept {
+            refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool try_retain() noexcept {
+            int n = refs.load(std::memory_order_relaxed);
+            while (n > 0) {
+                if (refs.compare_exchange_weak(n, n + 1, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        void release() noexcept {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                if (id) {
+                    std::lock_guard<std::mutex> lk(packed::mutex);
+                    packed::wakers.erase(id);
+                }
+                delete this;
+            }
+        }
+    };
+
+    struct waker_handle {
+        waker *w;
+        waker_handle(waker *w) noexcept
+            : w(w) {}
+        ~waker_handle() noexcept {
+            w->release();
+        }
+    };
+
     struct lua_epoll {
         net::bpoll_handle fd;
         int i = 0;
         int n = 0;
         luaref ref;
+        flatmap<net::fd_t, int> refs;
         dynarray<net::bpoll_event_t> events;
+        waker *w      = nullptr;
+        int waker_ref = LUA_NOREF;
         lua_epoll(lua_State *L, net::bpoll_handle epfd, size_t max_events)
             : fd(epfd)
             , ref(luaref_init(L))
@@ -22,6 +83,57 @@ namespace bee::lua_epoll {
         ~lua_epoll() {
             close();
             luaref_close(ref);
+            if (w) {
+                w->release();
+            }
+        }
+        // The event data holds the ref of the registered object and, on
+        // Linux, the fd in the upper half, so that EPOLLERR can be passed
+        // on to lua_socket without a lookup.
+        static void setdata(net::bpoll_event_t &ev, net::fd_t fd, int r) {
+#if defined(__linux__)
+            ev.data.u64 = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)r;
+#else
+            (void)fd;
+            ev.data.u32 = r;
+#endif
+        }
+        static int getref(const net::bpoll_event_t &ev) {
+#if defined(__linux__)
+            return (int)(uint32_t)ev.data.u64;
+#else
+            return (int)ev.data.u32;
+#endif
+        }
+        // Drains the waker before it is reported, so that a notify that
+        // arrives afterwards wakes the next wait.
+        void check_waker(const net::bpoll_event_t &ev) {
+            if (w && getref(ev) == waker_ref) {
+                w->ev.clear();
+            }
+        }
+        // Zero-copy completions are signalled as EPOLLERR, so they are
+        // reaped here. Returns false for a socket that was closed and only
+        // lingers for its completions: the event is not reported, and the
+        // registration is narrowed to errors until the socket goes away.
+        bool check_zerocopy(lua_State *L, const net::bpoll_event_t &ev) {
+#if defined(__linux__)
+            if (!(ev.events & std::to_underlying(net::bpoll_event::err))) {
+                return true;
+            }
+            auto sock = (net::fd_t)(ev.data.u64 >> 32);
+            if (!lua_socket::reapzerocopy(L, sock)) {
+                return true;
+            }
+            net::bpoll_event_t narrow = ev;
+            narrow.events             = 0;
+            net::bpoll_ctl_mod(fd, sock, narrow);
+            return false;
+#else
+            (void)L;
+            (void)ev;
+            return true;
+#endif
         }
         bool close() {
             if (!net::bpoll_close(fd)) {
@@ -46,14 +158,17 @@ namespace bee::lua_epoll {
 
     static int ep_events(lua_State *L) {
         auto &ep = *(lua_epoll *)lua_touserdata(L, lua_upvalueindex(1));
-        if (ep.i >= ep.n) {
-            return 0;
-        }
-        const auto &ev = ep.events[ep.i];
-        luaref_get(ep.ref, L, ev.data.u32);
-        lua_pushinteger(L, static_cast<uint32_t>(ev.events));
-        ep.i++;
-        return 2;
+        while (ep.i < ep.n) {
+            const auto &ev = ep.events[ep.i++];
+            if (!ep.check_zerocopy(L, ev)) {
+                continue;
+            }
+            ep.check_waker(ev);
+            luaref_get(ep.ref, L, lua_epoll::getref(ev));
+            lua_pushinteger(L, static_cast<uint32_t>(ev.events));
+            return 2;
+        }
+        return 0;
     }
 
     static int ep_wait(lua_State *L) {
@@ -68,7 +183,38 @@ namespace bee::lua_epoll {
         }
         ep.i = 0;
         ep.n = n;
-        lua_getiuservalue(L, 1, 2);
+        lua_getiuservalue(L, 1, 1);
+        return 1;
+    }
+
+    static int ep_wait_into(lua_State *L) {
+        auto &ep = lua::checkudata<lua_epoll>(L, 1);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        luaL_checktype(L, 3, LUA_TTABLE);
+        if (ep.fd == net::invalid_bpoll_handle) {
+            return lua::return_error(L, "bad file descriptor");
+        }
+        int timeout = lua::optinteger<int, -1>(L, 4);
+        int n       = net::bpoll_wait(ep.fd, ep.events, timeout);
+        if (n == -1) {
+            return lua::return_net_error(L, "epoll_wait");
+        }
+        ep.i  = 0;
+        ep.n  = 0;
+        int j = 0;
+        for (int i = 0; i < n; ++i) {
+            const auto &ev = ep.events[i];
+            if (!ep.check_zerocopy(L, ev)) {
+                continue;
+            }
+            ep.check_waker(ev);
+            ++j;
+            luaref_get(ep.ref, L, lua_epoll::getref(ev));
+            lua_rawseti(L, 2, j);
+            lua_pushinteger(L, static_cast<uint32_t>(ev.events));
+            lua_rawseti(L, 3, j);
+        }
+        lua_pushinteger(L, j);
         return 1;
     }
 
@@ -87,65 +233,52 @@ namespace bee::lua_epoll {
         return 0;
     }
 
-    static void storeref(lua_State *L, int r) {
-        lua_getiuservalue(L, 1, 1);
-        lua_pushvalue(L, 2);
-        lua_pushinteger(L, r);
-        lua_rawset(L, -3);
-        lua_pop(L, 1);
-    }
-
-    static int cleanref(lua_State *L) {
-        lua_getiuservalue(L, 1, 1);
-        lua_pushvalue(L, 2);
-        if (LUA_TNUMBER != lua_rawget(L, -2)) {
-            lua_pop(L, 2);
-            return LUA_NOREF;
-        }
-        int r = (int)lua_tointeger(L, -1);
-        lua_pop(L, 1);
-        lua_pushvalue(L, 2);
-        lua_pushnil(L);
-        lua_rawset(L, -3);
-        lua_pop(L, 1);
-        return r;
-    }
-
-    static int findref(lua_State *L) {
-        lua_getiuservalue(L, 1, 1);
-        lua_pushvalue(L, 2);
-        if (LUA_TNUMBER != lua_rawget(L, -2)) {
-            lua_pop(L, 2);
-            return LUA_NOREF;
-        }
-        int r = (int)lua_tointeger(L, -1);
-        lua_pop(L, 2);
-        return r;
+    // Registers fd with the object on top of the stack, which is popped.
+    // On failure pushes the error message and returns false.
+    static bool ep_add(lua_State *L, lua_epoll &ep, net::fd_t fd, uint32_t events) {
+        if (ep.fd == net::invalid_bpoll_handle) {
+            lua_pop(L, 1);
+            lua_pushstring(L, "bad file descriptor");
+            return false;
+        }
+        int r = luaref_ref(ep.ref, L);
+        if (r == LUA_NOREF) {
+            lua_pop(L, 1);
+            lua_pushstring(L, "Too many events.");
+            return false;
+        }
+        net::bpoll_event_t ev;
+        ev.events = static_cast<decltype(ev.events)>(events);
+        lua_epoll::setdata(ev, fd, r);
+        if (!net::bpoll_ctl_add(ep.fd, fd, ev)) {
+            luaref_unref(ep.ref, r);
+            lua::push_net_error(L, "epoll_ctl");
+            return false;
+        }
+        if (auto old = ep.refs.find(fd)) {
+            // the fd was closed without event_del and its number reused.
+            luaref_unref(ep.ref, *old);
+            *old = r;
+        } else {
+            ep.refs.insert(fd, r);
+        }
+        return true;
     }
 
     static int ep_event_add(lua_State *L) {
-        auto &ep = lua::checkudata<lua_epoll>(L, 1);
-        if (ep.fd == net::invalid_bpoll_handle) {
-            return lua::return_error(L, "bad file descriptor");
-        }
+        auto &ep     = lua::checkudata<lua_epoll>(L, 1);
         net::fd_t fd = ep_tofd(L, 2);
+        auto events  = (uint32_t)luaL_checkinteger(L, 3);
         if (lua_isnoneornil(L, 4)) {
             lua_pushvalue(L, 2);
         } else {
             lua_pushvalue(L, 4);
         }
-        int r = luaref_ref(ep.ref, L);
-        if (r == LUA_NOREF) {
-            return lua::return_error(L, "Too many events.");
-        }
-        net::bpoll_event_t ev;
-        ev.events   = static_cast<decltype(ev.events)>(luaL_checkinteger(L, 3));
-        ev.data.u32 = r;
-        if (!net::bpoll_ctl_add(ep.fd, fd, ev)) {
-            luaref_unref(ep.ref, r);
-            return lua::return_net_error(L, "epoll_ctl");
+        if (!ep_add(L, ep, fd, events)) {
+            lua_pushnil(L);
+            lua_insert(L, -2);
+            return 2;
         }
-        storeref(L, r);
         lua_pushboolean(L, 1);
         return 1;
     }
@@ -156,19 +289,19 @@ namespace bee::lua_epoll {
             return lua::return_error(L, "bad file descriptor");
         }
         net::fd_t fd = ep_tofd(L, 2);
-        int r        = findref(L);
-        if (r == LUA_NOREF) {
+        auto r       = ep.refs.find(fd);
+        if (!r) {
             return lua::return_error(L, "event is not initialized.");
         }
         net::bpoll_event_t ev;
-        ev.events   = static_cast<decltype(ev.events)>(luaL_checkinteger(L, 3));
-        ev.data.u32 = r;
+        ev.events = static_cast<decltype(ev.events)>(luaL_checkinteger(L, 3));
+        lua_epoll::setdata(ev, fd, *r);
         if (!net::bpoll_ctl_mod(ep.fd, fd, ev)) {
             return lua::return_net_error(L, "epoll_ctl");
         }
         if (lua_gettop(L) >= 4) {
             lua_pushvalue(L, 4);
-            luaref_set(ep.ref, L, r);
+            luaref_set(ep.ref, L, *r);
         }
         lua_pushboolean(L, 1);
         return 1;
@@ -183,21 +316,114 @@ namespace bee::lua_epoll {
         if (!net::bpoll_ctl_del(ep.fd, fd)) {
             return lua::return_net_error(L, "epoll_ctl");
         }
-        int r = cleanref(L);
-        if (r != LUA_NOREF) {
-            luaref_unref(ep.ref, r);
+        if (auto r = ep.refs.find(fd)) {
+            luaref_unref(ep.ref, *r);
+            ep.refs.erase(fd);
         }
         lua_pushboolean(L, 1);
         return 1;
     }
 
+    static waker &checkwaker(lua_State *L, int idx) {
+        return *lua::checkudata<waker_handle>(L, idx).w;
+    }
+
+    static int waker_notify(lua_State *L) {
+        checkwaker(L, 1).ev.set();
+        return 0;
+    }
+
+    static int waker_mt_seri(lua_State *L) {
+        auto &w = checkwaker(L, 1);
+        std::lock_guard<std::mutex> lk(packed::mutex);
+        if (!w.id) {
+            w.id = ++packed::next;
+            packed::wakers.insert(w.id, &w);
+        }
+        lua_pushinteger(L, w.id);
+        return 1;
+    }
+
+    static int waker_mt_deseri(lua_State *L) {
+        auto id  = luaL_checkinteger(L, 1);
+        waker *w = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(packed::mutex);
+            if (auto p = packed::wakers.find(id); p && (*p)->try_retain()) {
+                w = *p;
+            }
+        }
+        if (!w) {
+            return luaL_error(L, "waker is already closed.");
+        }
+        lua::newudata<waker_handle>(L, w);
+        return 1;
+    }
+
+    static void waker_metatable(lua_State *L) {
+        seri_register(waker_mt_deseri);
+        static luaL_Reg lib[] = {
+            { "notify", waker_notify },
+            { NULL, NULL }
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        static luaL_Reg mt[] = {
+            { "__seri", waker_mt_seri },
+            { "__deseri", waker_mt_deseri },
+            { NULL, NULL }
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int ep_waker(lua_State *L) {
+        auto &ep = lua::checkudata<lua_epoll>(L, 1);
+        if (ep.w) {
+            luaref_get(ep.ref, L, ep.waker_ref);
+            return 1;
+        }
+        if (ep.fd == net::invalid_bpoll_handle) {
+            return lua::return_error(L, "bad file descriptor");
+        }
+        auto w = new (std::nothrow) waker;
+        if (!w) {
+            return luaL_error(L, "not enough memory");
+        }
+        if (!w->ev.open()) {
+            delete w;
+            return lua::return_net_error(L, "waker");
+        }
+        w->retain();
+        lua::newudata<waker_handle>(L, w);
+        lua_pushvalue(L, -1);
+        int r = luaref_ref(ep.ref, L);
+        if (r == LUA_NOREF) {
+            w->release();
+            return lua::return_error(L, "Too many events.");
+        }
+        net::bpoll_event_t ev;
+        ev.events = static_cast<decltype(ev.events)>(std::to_underlying(net::bpoll_event::in));
+        lua_epoll::setdata(ev, w->ev.fd(), r);
+        if (!net::bpoll_ctl_add(ep.fd, w->ev.fd(), ev)) {
+            luaref_unref(ep.ref, r);
+            w->release();
+            return lua::return_net_error(L, "epoll_ctl");
+        }
+        ep.w         = w;
+        ep.waker_ref = r;
+        return 1;
+    }
+
     static void metatable(lua_State *L) {
         static luaL_Reg lib[] = {
             { "wait", ep_wait },
+            { "wait_into", ep_wait_into },
             { "close", ep_close },
             { "event_add", ep_event_add },
             { "event_mod", ep_event_mod },
             { "event_del", ep_event_del },
+            { "waker", ep_waker },
             { NULL, NULL }
         };
         luaL_newlibtable(L, lib);
@@ -220,11 +446,9 @@ namespace bee::lua_epoll {
             return lua::return_net_error(L, "epoll_create");
         }
         lua::newudata<lua_epoll>(L, L, epfd, (size_t)max_events);
-        lua_newtable(L);
-        lua_setiuservalue(L, -2, 1);
         lua_pushvalue(L, -1);
         lua_pushcclosure(L, ep_events, 1);
-        lua_setiuservalue(L, -2, 2);
+        lua_setiuservalue(L, -2, 1);
         return 1;
     }
 
@@ -261,7 +485,17 @@ DEFINE_LUAOPEN(epoll)
 namespace bee::lua {
     template <>
     struct udata<lua_epoll::lua_epoll> {
-        static inline int nupvalue   = 2;
+        static inline int nupvalue   = 1;
         static inline auto metatable = bee::lua_epoll::metatable;
     };
+    template <>
+    struct udata<lua_epoll::waker_handle> {
+        static inline auto metatable = bee::lua_epoll::waker_metatable;
+    };
+}
+
+namespace bee::lua_epoll {
+    bool event_add(lua_State *L, int idx, net::fd_t fd, uint32_t events) {
+        return ep_add(L, lua::checkudata<lua_epoll>(L, idx), fd, events);
+    }
 }
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <bee/net/fd.h>
+#include <lua.hpp>
+
+#include <cstdint>
+
+namespace bee::lua_epoll {
+    // Registers fd with the epoll at idx, as epoll:event_add(fd, events, obj)
+    // does, with obj taken from the top of the stack and popped. On failure
+    // the error message is pushed instead and false is returned.
+    bool event_add(lua_State* L, int idx, net::fd_t fd, uint32_t events);
+}
@@ -1,3 +1,4 @@
+#include <3rd/lua-seri/lua-seri.h>
 #include <bee/lua/binding.h>
 #include <bee/lua/cxx_status.h>
 #include <bee/lua/error.h>
@@ -266,7 +267,22 @@ namespace bee::lua_filesystem {
             return 1;
         }
 
+        static int mt_seri(lua_State* L) {
+            const auto& self = lua::checkudata<fs::path>(L, 1);
+            const auto& str  = self.native();
+            lua_pushlstring(L, (const char*)str.data(), str.size() * sizeof(fs::path::value_type));
+            return 1;
+        }
+
+        static int mt_deseri(lua_State* L) {
+            size_t len      = 0;
+            const char* str = luaL_checklstring(L, 1, &len);
+            lua::newudata<fs::path>(L, fs::path::string_type { (const fs::path::value_type*)str, len / sizeof(fs::path::value_type) });
+            return 1;
+        }
+
         static void metatable(lua_State* L) {
+            seri_register(mt_deseri);
             static luaL_Reg lib[] = {
                 { "string", mt_tostring },
                 { "filename", filename },
@@ -290,6 +306,8 @@ namespace bee::lua_filesystem {
                 { "__eq", mt_eq },
                 { "__tostring", mt_tostring },
                 { "__debugger_tostring", mt_tostring },
+                { "__seri", mt_seri },
+                { "__deseri", mt_deseri },
                 { NULL, NULL },
             };
             luaL_setfuncs(L, mt, 0);
@@ -0,0 +1,640 @@
+#include <3rd/lua-patch/bee_newstate.h>
+#include <3rd/lua-seri/lua-seri.h>
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/luaref.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/net/bpoll.h>
+#include <bee/net/event.h>
+#include <bee/net/socket.h>
+#include <bee/nonstd/to_underlying.h>
+#include <bee/thread/setname.h>
+#include <bee/thread/simplethread.h>
+#include <bee/thread/spinlock.h>
+#include <bee/utility/dynarray.h>
+#include <bee/utility/flatmap.h>
+#include <bee/utility/timer_wheel.h>
+#include <binding/lua_socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace bee::lua_reactor {
+    // A posted message carries either a lua-seri buffer, or a connection
+    // handed off by another reactor's listener.
+    struct message {
+        void* data;
+        net::fd_t fd;
+    };
+
+    static void free_message(const message& m) noexcept {
+        if (m.data) {
+            free(m.data);
+        } else {
+            net::socket::close(m.fd);
+        }
+    }
+
+    struct mailbox {
+        spinlock mutex;
+        std::vector<message> queue;
+        net::event ev;
+        ~mailbox() noexcept {
+            for (auto& m : queue) {
+                free_message(m);
+            }
+        }
+        void push(const message& m) {
+            {
+                std::unique_lock<spinlock> lk(mutex);
+                queue.push_back(m);
+            }
+            ev.set();
+        }
+        void take(std::vector<message>& out) {
+            ev.clear();
+            std::unique_lock<spinlock> lk(mutex);
+            out.swap(queue);
+        }
+    };
+
+    struct runtime;
+
+    struct reactor_args {
+        runtime* rt;
+        int id;
+        void* params;
+    };
+
+    // Owns the reactor threads. Each reactor has its own bpoll handle, Lua
+    // state, timer wheel and mailbox; the runtime only shares the mailboxes.
+    struct runtime {
+        std::string source;
+        std::vector<std::unique_ptr<mailbox>> boxes;
+        std::vector<thread_handle> threads;
+        std::atomic<bool> stopping = false;
+        std::atomic<uint32_t> next = 0;
+        spinlock errmutex;
+        std::queue<std::string> errors;
+        ~runtime() noexcept {
+            stop();
+            wait();
+        }
+        int size() const noexcept {
+            return (int)boxes.size();
+        }
+        void stop() noexcept {
+            stopping = true;
+            for (auto& box : boxes) {
+                box->ev.set();
+            }
+        }
+        void wait() noexcept {
+            for (auto h : threads) {
+                thread_wait(h);
+            }
+            threads.clear();
+        }
+        void push_error(const char* msg) {
+            std::unique_lock<spinlock> lk(errmutex);
+            errors.push(msg);
+        }
+    };
+
+    constexpr uint32_t kMailboxTag = UINT32_MAX;
+
+    // The event data holds the fd in the upper half and its callback ref in
+    // the lower, so that an event for an fd deleted or re-added earlier in
+    // the same batch is told apart by one lookup in refs. Socket handles
+    // fit in 32 bits on every platform bee supports.
+    static uint64_t event_data(net::fd_t fd, uint32_t tag) noexcept {
+        return ((uint64_t)(uint32_t)fd << 32) | tag;
+    }
+    constexpr int kMaxEvents       = 256;
+    constexpr int kAcceptBatch     = 64;
+
+    static uint64_t monotonic() noexcept {
+        using namespace std::chrono;
+        return (uint64_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct reactor {
+        runtime& rt;
+        int id;
+        net::bpoll_handle fd;
+        luaref ref;
+        flatmap<net::fd_t, int> refs;
+        flatmap<int, bool> listeners;
+        flatmap<timer_wheel::id_t, int> timers;
+        dynarray<net::bpoll_event_t> events;
+        timer_wheel wheel;
+        std::vector<timer_wheel::id_t> fired;
+        std::vector<message> inbox;
+        size_t inbox_pos = 0;
+        int on_post      = LUA_NOREF;
+        int on_accept    = LUA_NOREF;
+        reactor(lua_State* L, runtime& rt, int id, net::bpoll_handle fd)
+            : rt(rt)
+            , id(id)
+            , fd(fd)
+            , ref(luaref_init(L))
+            , events(kMaxEvents)
+            , wheel(monotonic()) {}
+        ~reactor() {
+            for (size_t i = inbox_pos; i < inbox.size(); ++i) {
+                free_message(inbox[i]);
+            }
+            net::bpoll_close(fd);
+            luaref_close(ref);
+        }
+        mailbox& box() {
+            return *rt.boxes[(size_t)id - 1];
+        }
+    };
+
+    static reactor& checkreactor(lua_State* L) {
+        return lua::checkudata<reactor>(L, 1);
+    }
+
+    static net::fd_t tofd(lua_State* L, int idx) {
+        if (lua_type(L, idx) == LUA_TLIGHTUSERDATA) {
+            return lua::tolightud<net::fd_t>(L, idx);
+        }
+        return lua_socket::checkfd(L, idx);
+    }
+
+    static int checktarget(lua_State* L, runtime& rt, int idx) {
+        auto target = lua::checkinteger<int>(L, idx);
+        luaL_argcheck(L, target >= 1 && target <= rt.size(), idx, "invalid reactor");
+        return target;
+    }
+
+    static void post(lua_State* L, runtime& rt, int target, int from) {
+        void* data = seri_pack(L, from, NULL);
+        rt.boxes[(size_t)target - 1]->push({ data, net::retired_fd });
+    }
+
+    static void deliver_fd(lua_State* L, reactor& r, net::fd_t newfd) {
+        if (r.on_accept == LUA_NOREF) {
+            net::socket::close(newfd);
+            return;
+        }
+        luaref_get(r.ref, L, r.on_accept);
+        lua_socket::pushfd(L, newfd);
+        lua_call(L, 1, 0);
+    }
+
+    static void drain_mailbox(lua_State* L, reactor& r) {
+        r.inbox.clear();
+        r.inbox_pos = 0;
+        r.box().take(r.inbox);
+        while (r.inbox_pos < r.inbox.size()) {
+            auto m = r.inbox[r.inbox_pos++];
+            if (!m.data) {
+                deliver_fd(L, r, m.fd);
+                continue;
+            }
+            if (r.on_post == LUA_NOREF) {
+                free(m.data);
+                continue;
+            }
+            luaref_get(r.ref, L, r.on_post);
+            int n = seri_unpackptr(L, m.data);
+            lua_call(L, n, 0);
+        }
+    }
+
+    static void accept_all(lua_State* L, reactor& r, net::fd_t listener, bool spread) {
+        for (int i = 0; i < kAcceptBatch; ++i) {
+            net::fd_t newfd;
+            if (net::socket::accept(listener, newfd) != net::socket::status::success) {
+                return;
+            }
+            int target = spread ? (int)(r.rt.next.fetch_add(1, std::memory_order_relaxed) % (uint32_t)r.rt.size()) + 1 : r.id;
+            if (target == r.id) {
+                deliver_fd(L, r, newfd);
+            } else {
+                r.rt.boxes[(size_t)target - 1]->push({ nullptr, newfd });
+            }
+        }
+    }
+
+    static void fire_timers(lua_State* L, reactor& r) {
+        r.fired.clear();
+        r.wheel.update(monotonic(), r.fired);
+        for (auto tid : r.fired) {
+            auto cb = r.timers.find(tid);
+            if (!cb) {
+                continue;
+            }
+            int cbref = *cb;
+            r.timers.erase(tid);
+            luaref_get(r.ref, L, cbref);
+            luaref_unref(r.ref, cbref);
+            lua_call(L, 0, 0);
+        }
+    }
+
+    static void run(lua_State* L, reactor& r) {
+        while (!r.rt.stopping) {
+            fire_timers(L, r);
+            int64_t timeout = r.wheel.next();
+            int n           = net::bpoll_wait(r.fd, r.events, timeout < 0 ? -1 : (int)std::min<int64_t>(timeout, INT32_MAX));
+            if (n == -1) {
+                lua::push_net_error(L, "epoll_wait");
+                lua_error(L);
+            }
+            for (int i = 0; i < n && !r.rt.stopping; ++i) {
+                const auto& ev = r.events[i];
+                uint32_t tag   = (uint32_t)ev.data.u64;
+                if (tag == kMailboxTag) {
+                    drain_mailbox(L, r);
+                    continue;
+                }
+                auto cbref = r.refs.find((net::fd_t)(uint32_t)(ev.data.u64 >> 32));
+                if (!cbref || *cbref != (int)tag) {
+                    continue;
+                }
+                if (auto spread = r.listeners.find((int)tag)) {
+                    bool s = *spread;
+                    luaref_get(r.ref, L, (int)tag);
+                    net::fd_t listener = tofd(L, -1);
+                    lua_pop(L, 1);
+                    accept_all(L, r, listener, s);
+                    continue;
+                }
+                luaref_get(r.ref, L, (int)tag);
+                lua_pushinteger(L, static_cast<uint32_t>(ev.events));
+                lua_call(L, 1, 0);
+            }
+        }
+    }
+
+    static int ref_value(lua_State* L, reactor& r, int idx) {
+        lua_pushvalue(L, idx);
+        int cbref = luaref_ref(r.ref, L);
+        if (cbref == LUA_NOREF) {
+            luaL_error(L, "Too many events.");
+        }
+        return cbref;
+    }
+
+    static void unref_fd(reactor& r, net::fd_t fd) {
+        if (auto old = r.refs.find(fd)) {
+            r.listeners.erase(*old);
+            luaref_unref(r.ref, *old);
+            r.refs.erase(fd);
+        }
+    }
+
+    static int watch(lua_State* L, reactor& r, net::fd_t fd, uint32_t events, int value_idx, bool listener, bool spread) {
+        int cbref = ref_value(L, r, value_idx);
+        net::bpoll_event_t ev;
+        ev.events   = static_cast<decltype(ev.events)>(events);
+        ev.data.u64 = event_data(fd, (uint32_t)cbref);
+        if (!net::bpoll_ctl_add(r.fd, fd, ev)) {
+            luaref_unref(r.ref, cbref);
+            return lua::return_net_error(L, "epoll_ctl");
+        }
+        // the fd may have been closed without del and its number reused.
+        unref_fd(r, fd);
+        r.refs.insert(fd, cbref);
+        if (listener) {
+            r.listeners.insert(cbref, spread);
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int ctx_add(lua_State* L) {
+        auto& r     = checkreactor(L);
+        auto fd     = tofd(L, 2);
+        auto events = lua::checkinteger<uint32_t>(L, 3);
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+        return watch(L, r, fd, events, 4, false, false);
+    }
+
+    static int ctx_mod(lua_State* L) {
+        auto& r     = checkreactor(L);
+        auto fd     = tofd(L, 2);
+        auto events = lua::checkinteger<uint32_t>(L, 3);
+        auto cbref  = r.refs.find(fd);
+        if (!cbref) {
+            return lua::return_error(L, "event is not initialized.");
+        }
+        net::bpoll_event_t ev;
+        ev.events   = static_cast<decltype(ev.events)>(events);
+        ev.data.u64 = event_data(fd, (uint32_t)*cbref);
+        if (!net::bpoll_ctl_mod(r.fd, fd, ev)) {
+            return lua::return_net_error(L, "epoll_ctl");
+        }
+        if (!lua_isnoneornil(L, 4)) {
+            luaL_checktype(L, 4, LUA_TFUNCTION);
+            lua_pushvalue(L, 4);
+            luaref_set(r.ref, L, *cbref);
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int ctx_del(lua_State* L) {
+        auto& r = checkreactor(L);
+        auto fd = tofd(L, 2);
+        if (!net::bpoll_ctl_del(r.fd, fd)) {
+            return lua::return_net_error(L, "epoll_ctl");
+        }
+        unref_fd(r, fd);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int ctx_accept(lua_State* L) {
+        static const char* const opts[] = { "local", "roundrobin", NULL };
+        auto& r     = checkreactor(L);
+        auto fd     = lua_socket::checkfd(L, 2);
+        bool spread = luaL_checkoption(L, 3, "local", opts) == 1;
+        return watch(L, r, fd, std::to_underlying(net::bpoll_event::in), 2, true, spread);
+    }
+
+    static int ctx_on_post(lua_State* L) {
+        auto& r = checkreactor(L);
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        if (r.on_post != LUA_NOREF) {
+            luaref_unref(r.ref, r.on_post);
+        }
+        r.on_post = ref_value(L, r, 2);
+        return 0;
+    }
+
+    static int ctx_on_accept(lua_State* L) {
+        auto& r = checkreactor(L);
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        if (r.on_accept != LUA_NOREF) {
+            luaref_unref(r.ref, r.on_accept);
+        }
+        r.on_accept = ref_value(L, r, 2);
+        return 0;
+    }
+
+    static int ctx_timeout(lua_State* L) {
+        auto& r        = checkreactor(L);
+        lua_Integer ms = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, ms >= 0, 2, "timeout must be non-negative");
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+        int cbref = ref_value(L, r, 3);
+        // the wheel's clock only advances in the loop, so count from now.
+        uint64_t now = monotonic();
+        uint64_t lag = now > r.wheel.now() ? now - r.wheel.now() : 0;
+        auto tid     = r.wheel.add((uint64_t)ms + lag);
+        r.timers.insert(tid, cbref);
+        lua_pushinteger(L, (lua_Integer)tid);
+        return 1;
+    }
+
+    static int ctx_cancel(lua_State* L) {
+        auto& r  = checkreactor(L);
+        auto tid = (timer_wheel::id_t)luaL_checkinteger(L, 2);
+        auto cb  = r.timers.find(tid);
+        if (!cb || !r.wheel.cancel(tid)) {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        luaref_unref(r.ref, *cb);
+        r.timers.erase(tid);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int ctx_post(lua_State* L) {
+        auto& r    = checkreactor(L);
+        int target = checktarget(L, r.rt, 2);
+        post(L, r.rt, target, 2);
+        return 0;
+    }
+
+    static int ctx_id(lua_State* L) {
+        auto& r = checkreactor(L);
+        lua_pushinteger(L, r.id);
+        return 1;
+    }
+
+    static int ctx_size(lua_State* L) {
+        auto& r = checkreactor(L);
+        lua_pushinteger(L, r.rt.size());
+        return 1;
+    }
+
+    static int ctx_stop(lua_State* L) {
+        auto& r = checkreactor(L);
+        r.rt.stop();
+        return 0;
+    }
+
+    static void reactor_metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "add", ctx_add },
+            { "mod", ctx_mod },
+            { "del", ctx_del },
+            { "accept", ctx_accept },
+            { "on_post", ctx_on_post },
+            { "on_accept", ctx_on_accept },
+            { "timeout", ctx_timeout },
+            { "cancel", ctx_cancel },
+            { "post", ctx_post },
+            { "id", ctx_id },
+            { "size", ctx_size },
+            { "stop", ctx_stop },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+    }
+
+    static int reactor_luamain(lua_State* L) {
+        lua_pushboolean(L, 1);
+        lua_setfield(L, LUA_REGISTRYINDEX, "LUA_NOENV");
+        luaL_openlibs(L);
+        auto args    = lua::tolightud<reactor_args*>(L, 1);
+        auto& rt     = *args->rt;
+        int id       = args->id;
+        void* params = args->params;
+        delete args;
+        lua_settop(L, 0);
+        lua::preload_module(L);
+        lua_gc(L, LUA_GCGEN, 0, 0);
+        auto epfd = net::bpoll_create();
+        if (epfd == net::invalid_bpoll_handle) {
+            free(params);
+            lua::push_net_error(L, "epoll_create");
+            return lua_error(L);
+        }
+        auto& r  = lua::newudata<reactor>(L, L, rt, id, epfd);
+        int self = lua_gettop(L);
+        net::bpoll_event_t ev;
+        ev.events   = static_cast<decltype(ev.events)>(std::to_underlying(net::bpoll_event::in));
+        ev.data.u64 = event_data(r.box().ev.fd(), kMailboxTag);
+        if (!net::bpoll_ctl_add(r.fd, r.box().ev.fd(), ev)) {
+            free(params);
+            lua::push_net_error(L, "epoll_ctl");
+            return lua_error(L);
+        }
+        if (luaL_loadbuffer(L, rt.source.data(), rt.source.size(), rt.source.c_str()) != LUA_OK) {
+            free(params);
+            return lua_error(L);
+        }
+        lua_pushvalue(L, self);
+        int n = seri_unpackptr(L, params);
+        lua_call(L, n + 1, 0);
+        run(L, r);
+        return 0;
+    }
+
+    static int msghandler(lua_State* L) {
+        const char* msg = lua_tostring(L, 1);
+        if (msg == NULL) {
+            msg = lua_pushfstring(L, "(error object is a %s value)", luaL_typename(L, 1));
+        }
+        luaL_traceback(L, L, msg, 1);
+        return 1;
+    }
+
+    static void reactor_main(void* ud) noexcept {
+        auto args = (reactor_args*)ud;
+        auto& rt  = *args->rt;
+        thread_setname("bee reactor");
+        lua_State* L = bee_lua_newstate();
+        lua_pushcfunction(L, msghandler);
+        lua_pushcfunction(L, reactor_luamain);
+        lua_pushlightuserdata(L, ud);
+        if (lua_pcall(L, 1, 0, 1) != LUA_OK) {
+            rt.push_error(lua_tostring(L, -1));
+            rt.stop();
+        }
+        lua_close(L);
+    }
+
+    static runtime& checkruntime(lua_State* L) {
+        return *lua::checkudata<std::unique_ptr<runtime>>(L, 1);
+    }
+
+    static int rt_post(lua_State* L) {
+        auto& rt   = checkruntime(L);
+        int target = checktarget(L, rt, 2);
+        post(L, rt, target, 2);
+        return 0;
+    }
+
+    static int rt_size(lua_State* L) {
+        auto& rt = checkruntime(L);
+        lua_pushinteger(L, rt.size());
+        return 1;
+    }
+
+    static int rt_stop(lua_State* L) {
+        auto& rt = checkruntime(L);
+        rt.stop();
+        return 0;
+    }
+
+    static int rt_wait(lua_State* L) {
+        auto& rt = checkruntime(L);
+        rt.wait();
+        return 0;
+    }
+
+    static int rt_errlog(lua_State* L) {
+        auto& rt = checkruntime(L);
+        std::unique_lock<spinlock> lk(rt.errmutex);
+        if (rt.errors.empty()) {
+            return 0;
+        }
+        auto& msg = rt.errors.front();
+        lua_pushlstring(L, msg.data(), msg.size());
+        rt.errors.pop();
+        return 1;
+    }
+
+    static void runtime_metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "post", rt_post },
+            { "size", rt_size },
+            { "stop", rt_stop },
+            { "wait", rt_wait },
+            { "errlog", rt_errlog },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        luaL_Reg mt[] = {
+            { "__close", rt_stop },
+            { NULL, NULL },
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int start(lua_State* L) {
+        auto n      = lua::checkinteger<int>(L, 1);
+        auto source = lua::checkstrview(L, 2);
+        luaL_argcheck(L, n > 0, 1, "reactor count must be positive");
+        auto& holder = lua::newudata<std::unique_ptr<runtime>>(L, std::make_unique<runtime>());
+        lua_replace(L, 1);
+        auto& rt  = *holder;
+        rt.source = std::string { source.data(), source.size() };
+        for (int i = 0; i < n; ++i) {
+            auto box = std::make_unique<mailbox>();
+            if (!box->ev.open()) {
+                return lua::return_net_error(L, "reactor");
+            }
+            rt.boxes.push_back(std::move(box));
+        }
+        int top = lua_gettop(L);
+        for (int i = 1; i <= n; ++i) {
+            // every reactor gets its own copy, so sockets are duplicated.
+            void* params         = seri_pack(L, 2, NULL);
+            auto args            = new reactor_args { &rt, i, params };
+            lua_settop(L, top);
+            thread_handle handle = thread_create(reactor_main, args);
+            if (!handle) {
+                free(params);
+                delete args;
+                rt.stop();
+                return lua::return_sys_error(L, "thread_create");
+            }
+            rt.threads.push_back(handle);
+        }
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "start", start },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(reactor)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_reactor::reactor> {
+        static inline auto metatable = bee::lua_reactor::reactor_metatable;
+    };
+    template <>
+    struct udata<std::unique_ptr<lua_reactor::runtime>> {
+        static inline auto metatable = bee::lua_reactor::runtime_metatable;
+    };
+}
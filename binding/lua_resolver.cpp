@@ -0,0 +1,156 @@
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/luaref.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/net/resolver.h>
+#include <binding/lua_socket.h>
+
+namespace bee::lua_resolver {
+    struct lua_resolver {
+        net::resolver r;
+        luaref ref;
+        bool closed = false;
+        lua_resolver(lua_State* L)
+            : ref(luaref_init(L)) {}
+        ~lua_resolver() {
+            r.close();
+            luaref_close(ref);
+        }
+    };
+
+    static lua_resolver& checkresolver(lua_State* L) {
+        return lua::checkudata<lua_resolver>(L, 1);
+    }
+
+    static int resolve(lua_State* L) {
+        auto& self = checkresolver(L);
+        auto name  = lua::checkstrview(L, 2);
+        auto port  = lua::checkinteger<uint16_t>(L, 3);
+        if (self.closed) {
+            return lua::return_error(L, "resolver is closed.");
+        }
+        lua_pushvalue(L, lua_isnoneornil(L, 4) ? 2 : 4);
+        int id = luaref_ref(self.ref, L);
+        if (id == LUA_NOREF) {
+            return luaL_error(L, "Too many resolve requests.");
+        }
+        if (!self.r.submit((uint64_t)id, name, port)) {
+            luaref_unref(self.ref, id);
+            return lua::return_error(L, "resolver is closed.");
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int next_result(lua_State* L) {
+        auto& self = checkresolver(L);
+        net::resolve_result res;
+        if (!self.r.pop(res)) {
+            return 0;
+        }
+        int id = (int)res.id;
+        luaref_get(self.ref, L, id);
+        luaref_unref(self.ref, id);
+        if (!res.ok) {
+            lua_pushnil(L);
+            lua_pushstring(L, "unable to resolve hostname.");
+            return 3;
+        }
+        lua_socket::pushendpoint(L, res.ep);
+        return 2;
+    }
+
+    static int results(lua_State* L) {
+        checkresolver(L);
+        lua_pushcfunction(L, next_result);
+        lua_pushvalue(L, 1);
+        return 2;
+    }
+
+    static int fd(lua_State* L) {
+        auto& self = checkresolver(L);
+        lua_pushlightuserdata(L, (void*)(intptr_t)self.r.fd());
+        return 1;
+    }
+
+    static int close(lua_State* L) {
+        auto& self = checkresolver(L);
+        self.r.close();
+        self.closed = true;
+        return 0;
+    }
+
+    static void metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "resolve", resolve },
+            { "results", results },
+            { "fd", fd },
+            { "close", close },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        luaL_Reg mt[] = {
+            { "__close", close },
+            { NULL, NULL },
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int create(lua_State* L) {
+        auto nthreads = lua::optinteger<int, 2>(L, 1);
+        luaL_argcheck(L, nthreads > 0, 1, "thread count must be positive");
+        auto& self = lua::newudata<lua_resolver>(L, L);
+        if (!self.r.open(nthreads)) {
+            return lua::return_sys_error(L, "resolver");
+        }
+        return 1;
+    }
+
+    static int ttl(lua_State* L) {
+        if (!lua_isnoneornil(L, 1)) {
+            net::resolve_cache::set_ttl(lua::checkinteger<int>(L, 1));
+        }
+        lua_pushinteger(L, net::resolve_cache::get_ttl());
+        return 1;
+    }
+
+    static int lookup(lua_State* L) {
+        auto name = lua::checkstrview(L, 1);
+        auto port = lua::checkinteger<uint16_t>(L, 2);
+        net::endpoint ep;
+        if (!net::resolve_cache::lookup(ep, name, port)) {
+            return 0;
+        }
+        lua_socket::pushendpoint(L, ep);
+        return 1;
+    }
+
+    static int flush(lua_State*) {
+        net::resolve_cache::clear();
+        return 0;
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "create", create },
+            { "ttl", ttl },
+            { "lookup", lookup },
+            { "flush", flush },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(resolver)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_resolver::lua_resolver> {
+        static inline auto metatable = bee::lua_resolver::metatable;
+    };
+}
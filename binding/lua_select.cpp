@@ -4,13 +4,15 @@
 #if defined(_WIN32)
 #    include <winsock.h>
 #else
-#    include <sys/select.h>
+#    include <poll.h>
 #endif
 #include <bee/lua/error.h>
 #include <bee/net/socket.h>
 #include <bee/thread/simplethread.h>
+#include <bee/utility/flatmap.h>
 
 #include <set>
+#include <vector>
 
 namespace bee::lua_select {
 #if defined(_WIN32)
@@ -53,21 +55,105 @@ namespace bee::lua_select {
 #endif
 
     struct select_ctx {
+#if defined(_WIN32)
         std::set<net::fd_t> readset;
         std::set<net::fd_t> writeset;
-#if defined(_WIN32)
         socket_set readfds;
         socket_set writefds;
         unsigned int i;
 #else
-        fd_set readfds;
-        fd_set writefds;
-        int maxfd;
-        int i;
+        // poll() takes a dense array; index maps each fd to its slot so
+        // that add, mod and del stay O(1), and there is no FD_SETSIZE cap.
+        // del leaves a hole (fd -1, which poll skips) so that no slot moves
+        // while the events are walked; holes are filled before each poll.
+        std::vector<pollfd> fds;
+        flatmap<net::fd_t, size_t> index;
+        size_t i;
+        int nready;
 #endif
     };
     constexpr lua_Integer SELECT_READ  = 1;
     constexpr lua_Integer SELECT_WRITE = 2;
+
+#if defined(_WIN32)
+    static bool empty(select_ctx& ctx) {
+        return ctx.readset.empty() && ctx.writeset.empty();
+    }
+    static void clear(select_ctx& ctx) {
+        ctx.readset.clear();
+        ctx.writeset.clear();
+    }
+    static void remove(select_ctx& ctx, net::fd_t fd) {
+        ctx.readset.erase(fd);
+        ctx.writeset.erase(fd);
+    }
+    static void setevents(select_ctx& ctx, net::fd_t fd, lua_Integer events) {
+        if (events & SELECT_READ) {
+            ctx.readset.insert(fd);
+        } else {
+            ctx.readset.erase(fd);
+        }
+        if (events & SELECT_WRITE) {
+            ctx.writeset.insert(fd);
+        } else {
+            ctx.writeset.erase(fd);
+        }
+    }
+#else
+    static bool empty(select_ctx& ctx) {
+        return ctx.index.empty();
+    }
+    static void clear(select_ctx& ctx) {
+        ctx.fds.clear();
+        ctx.index.clear();
+    }
+    static void remove(select_ctx& ctx, net::fd_t fd) {
+        auto pos = ctx.index.find(fd);
+        if (!pos) {
+            return;
+        }
+        auto& p   = ctx.fds[*pos];
+        p.fd      = -1;
+        p.revents = 0;
+        ctx.index.erase(fd);
+    }
+    static void compact(select_ctx& ctx) {
+        if (ctx.fds.size() == ctx.index.size()) {
+            return;
+        }
+        size_t n = 0;
+        for (size_t i = 0; i < ctx.fds.size(); ++i) {
+            if (ctx.fds[i].fd == -1) {
+                continue;
+            }
+            if (i != n) {
+                ctx.fds[n] = ctx.fds[i];
+                ctx.index.insert_or_assign(ctx.fds[n].fd, n);
+            }
+            ++n;
+        }
+        ctx.fds.resize(n);
+    }
+    static void setevents(select_ctx& ctx, net::fd_t fd, lua_Integer events) {
+        short mask = 0;
+        if (events & SELECT_READ) {
+            mask |= POLLIN;
+        }
+        if (events & SELECT_WRITE) {
+            mask |= POLLOUT;
+        }
+        if (mask == 0) {
+            remove(ctx, fd);
+            return;
+        }
+        if (auto pos = ctx.index.find(fd)) {
+            ctx.fds[*pos].events = mask;
+            return;
+        }
+        ctx.index.insert(fd, ctx.fds.size());
+        ctx.fds.push_back({ fd, mask, 0 });
+    }
+#endif
     static void storeref(lua_State* L, net::fd_t k) {
         if (lua_isnoneornil(L, 4)) {
             lua_getiuservalue(L, 1, 1);
@@ -127,16 +213,31 @@ namespace bee::lua_select {
             return 2;
         }
 #else
-        for (; ctx.i <= ctx.maxfd; ++ctx.i) {
+        // stops after the last ready fd instead of scanning the whole array.
+        for (; ctx.nready > 0 && ctx.i < ctx.fds.size(); ++ctx.i) {
+            const auto& p = ctx.fds[ctx.i];
+            if (!p.revents) {
+                continue;
+            }
             lua_Integer event = 0;
-            if (FD_ISSET(ctx.i, &ctx.readfds)) {
+            if (p.revents & POLLIN) {
                 event |= SELECT_READ;
             }
-            if (FD_ISSET(ctx.i, &ctx.writefds)) {
+            if (p.revents & POLLOUT) {
                 event |= SELECT_WRITE;
             }
+            if (p.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                // select reports a failed fd in every set it was in.
+                if (p.events & POLLIN) {
+                    event |= SELECT_READ;
+                }
+                if (p.events & POLLOUT) {
+                    event |= SELECT_WRITE;
+                }
+            }
+            --ctx.nready;
             if (event) {
-                findref(L, lua_upvalueindex(1), (net::fd_t)ctx.i);
+                findref(L, lua_upvalueindex(1), p.fd);
                 lua_pushinteger(L, event);
                 ++ctx.i;
                 return 2;
@@ -151,7 +252,7 @@ namespace bee::lua_select {
     static int wait(lua_State* L) {
         auto& ctx = lua::checkudata<select_ctx>(L, 1);
         int msec  = lua::optinteger<int, -1>(L, 2);
-        if (ctx.readset.empty() && ctx.writeset.empty()) {
+        if (empty(ctx)) {
             if (msec < 0) {
                 return luaL_error(L, "no open sockets to check and no timeout set");
             } else {
@@ -160,6 +261,7 @@ namespace bee::lua_select {
                 return 1;
             }
         }
+#if defined(_WIN32)
         struct timeval timeout, *timeop = &timeout;
         if (msec < 0) {
             timeop = NULL;
@@ -167,7 +269,6 @@ namespace bee::lua_select {
             timeout.tv_sec  = (long)msec / 1000;
             timeout.tv_usec = (long)(msec % 1000 * 1000);
         }
-#if defined(_WIN32)
         ctx.i = 0;
         ctx.readfds.reset(ctx.readset.size());
         for (auto fd : ctx.readset) {
@@ -179,32 +280,27 @@ namespace bee::lua_select {
         }
         int ok = ::select(0, ctx.readfds.ptr(), ctx.writefds.ptr(), ctx.writefds.ptr(), timeop);
 #else
-        ctx.i     = 1;
-        ctx.maxfd = 0;
-        FD_ZERO(&ctx.readfds);
-        for (auto fd : ctx.readset) {
-            FD_SET(fd, &ctx.readfds);
-            ctx.maxfd = std::max(ctx.maxfd, fd);
-        }
-        FD_ZERO(&ctx.writefds);
-        for (auto fd : ctx.writeset) {
-            FD_SET(fd, &ctx.writefds);
-            ctx.maxfd = std::max(ctx.maxfd, fd);
-        }
+        compact(ctx);
+        ctx.i = 0;
         int ok;
-        if (timeop == NULL) {
+        if (msec < 0) {
             do
-                ok = ::select(ctx.maxfd + 1, &ctx.readfds, &ctx.writefds, NULL, NULL);
+                ok = ::poll(ctx.fds.data(), (nfds_t)ctx.fds.size(), -1);
             while (ok == -1 && errno == EINTR);
         } else {
-            ok = ::select(ctx.maxfd + 1, &ctx.readfds, &ctx.writefds, NULL, timeop);
+            ok = ::poll(ctx.fds.data(), (nfds_t)ctx.fds.size(), msec);
             if (ok == -1 && errno == EINTR) {
                 ok = 0;
             }
         }
+        ctx.nready = ok > 0 ? ok : 0;
 #endif
         if (ok < 0) {
+#if defined(_WIN32)
             lua::push_net_error(L, "select");
+#else
+            lua::push_net_error(L, "poll");
+#endif
             return lua_error(L);
         }
         lua_getiuservalue(L, 1, 3);
@@ -212,8 +308,7 @@ namespace bee::lua_select {
     }
     static int close(lua_State* L) {
         auto& ctx = lua::checkudata<select_ctx>(L, 1);
-        ctx.readset.clear();
-        ctx.writeset.clear();
+        clear(ctx);
         return 0;
     }
     static net::fd_t tofd(lua_State* L, int idx) {
@@ -232,16 +327,7 @@ namespace bee::lua_select {
         auto fd     = tofd(L, 2);
         auto events = luaL_checkinteger(L, 3);
         storeref(L, fd);
-        if (events & SELECT_READ) {
-            ctx.readset.insert(fd);
-        } else {
-            ctx.readset.erase(fd);
-        }
-        if (events & SELECT_WRITE) {
-            ctx.writeset.insert(fd);
-        } else {
-            ctx.writeset.erase(fd);
-        }
+        setevents(ctx, fd, events);
         lua_pushboolean(L, 1);
         return 1;
     }
@@ -249,16 +335,7 @@ namespace bee::lua_select {
         auto& ctx   = lua::checkudata<select_ctx>(L, 1);
         auto fd     = tofd(L, 2);
         auto events = luaL_checkinteger(L, 3);
-        if (events & SELECT_READ) {
-            ctx.readset.insert(fd);
-        } else {
-            ctx.readset.erase(fd);
-        }
-        if (events & SELECT_WRITE) {
-            ctx.writeset.insert(fd);
-        } else {
-            ctx.writeset.erase(fd);
-        }
+        setevents(ctx, fd, events);
         lua_pushboolean(L, 1);
         return 1;
     }
@@ -266,8 +343,7 @@ namespace bee::lua_select {
         auto& ctx = lua::checkudata<select_ctx>(L, 1);
         auto fd   = tofd(L, 2);
         cleanref(L, fd);
-        ctx.readset.erase(fd);
-        ctx.writeset.erase(fd);
+        remove(ctx, fd);
         lua_pushboolean(L, 1);
         return 1;
     }
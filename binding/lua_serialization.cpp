@@ -2,7 +2,23 @@
 #include <bee/lua/binding.h>
 #include <bee/lua/module.h>
 
+#include <cstring>
+
 namespace bee::lua_serialization {
+    static void* checkstring(lua_State* L, int idx) {
+        size_t sz       = 0;
+        const char* str = lua_tolstring(L, idx, &sz);
+        uint32_t len    = 0;
+        if (sz < sizeof(len)) {
+            luaL_error(L, "Invalid serialize stream");
+        }
+        memcpy(&len, str, sizeof(len));
+        if (len > sz - sizeof(len)) {
+            luaL_error(L, "Invalid serialize stream");
+        }
+        return (void*)str;
+    }
+
     static int unpack(lua_State* L) {
         switch (lua_type(L, 1)) {
         case LUA_TLIGHTUSERDATA:
@@ -12,7 +28,7 @@ namespace bee::lua_serialization {
             return seri_unpack(L, lua::tolightud<void*>(L, 1));
         case LUA_TSTRING:
             lua_settop(L, 1);
-            return seri_unpack(L, (void*)lua_tostring(L, 1));
+            return seri_unpack(L, checkstring(L, 1));
         case LUA_TFUNCTION: {
             lua_settop(L, 1);
             lua_call(L, 0, 3);
@@ -27,6 +43,17 @@ namespace bee::lua_serialization {
         }
     }
 
+    static int view(lua_State* L) {
+        switch (lua_type(L, 1)) {
+        case LUA_TLIGHTUSERDATA:
+            return seri_view(L, lua::tolightud<void*>(L, 1), 0);
+        case LUA_TSTRING:
+            return seri_view(L, checkstring(L, 1), 1);
+        default:
+            return luaL_error(L, "unsupported type %s", luaL_typename(L, 1));
+        }
+    }
+
     static int pack(lua_State* L) {
         void* data = seri_pack(L, 0, NULL);
         lua_pushlightuserdata(L, data);
@@ -39,6 +66,10 @@ namespace bee::lua_serialization {
         free(data);
         return 1;
     }
+    static int enable_function(lua_State* L) {
+        seri_enablefunction(L, lua_toboolean(L, 1));
+        return 0;
+    }
     static int lightuserdata(lua_State* L) {
         luaL_checktype(L, 1, LUA_TUSERDATA);
         lua_pushlightuserdata(L, lua_touserdata(L, 1));
@@ -47,8 +78,10 @@ namespace bee::lua_serialization {
     static int luaopen(lua_State* L) {
         luaL_Reg lib[] = {
             { "unpack", unpack },
+            { "view", view },
             { "pack", pack },
             { "packstring", packstring },
+            { "enable_function", enable_function },
             { "lightuserdata", lightuserdata },
             { NULL, NULL }
         };
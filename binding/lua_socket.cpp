@@ -1,10 +1,24 @@
-﻿#include <bee/lua/binding.h>
+﻿#include <3rd/lua-seri/lua-seri.h>
+#include <bee/lua/binding.h>
 #include <bee/lua/error.h>
+#include <bee/lua/file.h>
 #include <bee/lua/module.h>
 #include <bee/lua/udata.h>
 #include <bee/net/endpoint.h>
 #include <bee/net/socket.h>
 #include <bee/nonstd/unreachable.h>
+#include <bee/sys/file_handle.h>
+#include <bee/utility/dynarray.h>
+#include <binding/lua_buffer.h>
+#include <binding/lua_epoll.h>
+#include <binding/lua_socket.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_map>
 
 namespace bee::lua_socket {
     namespace endpoint {
@@ -66,7 +80,23 @@ namespace bee::lua_socket {
             lua_pushboolean(L, a == b);
             return 1;
         }
+        static int mt_seri(lua_State* L) {
+            const auto& ep = lua::checkudata<net::endpoint>(L, 1);
+            lua_pushlstring(L, (const char*)ep.addr(), ep.addrlen());
+            return 1;
+        }
+        static int mt_deseri(lua_State* L) {
+            auto addr = lua::checkstrview(L, 1);
+            if (addr.size() > net::kMaxEndpointSize) {
+                return luaL_error(L, "invalid endpoint");
+            }
+            auto& ep = lua::newudata<net::endpoint>(L);
+            memcpy(ep.out_addr(), addr.data(), addr.size());
+            *ep.out_addrlen() = (net::socklen_t)addr.size();
+            return 1;
+        }
         static void metatable(lua_State* L) {
+            seri_register(mt_deseri);
             luaL_Reg lib[] = {
                 { "value", value },
                 { NULL, NULL },
@@ -77,12 +107,65 @@ namespace bee::lua_socket {
             luaL_Reg mt[] = {
                 { "__tostring", mt_tostring },
                 { "__eq", mt_eq },
+                { "__seri", mt_seri },
+                { "__deseri", mt_deseri },
                 { NULL, NULL },
             };
             luaL_setfuncs(L, mt, 0);
         }
     }
 
+    // Byte and call counters of a socket, kept in a full userdata stored as
+    // the socket's user value and created on first use, so they follow the
+    // socket object across detach, close and threads. A call that would
+    // block counts as a call and a wait. The socket is at stack index 1.
+    namespace traffic {
+        struct counters {
+            uint64_t recv_bytes = 0;
+            uint64_t send_bytes = 0;
+            uint64_t recv_calls = 0;
+            uint64_t send_calls = 0;
+            uint64_t recv_waits = 0;
+            uint64_t send_waits = 0;
+        };
+        static counters* find(lua_State* L) {
+            counters* c = nullptr;
+            if (lua_getiuservalue(L, 1, 1) == LUA_TUSERDATA) {
+                c = (counters*)lua_touserdata(L, -1);
+            }
+            lua_pop(L, 1);
+            return c;
+        }
+        static counters& get(lua_State* L) {
+            if (auto c = find(L)) {
+                return *c;
+            }
+            auto c = new (lua_newuserdatauv(L, sizeof(counters), 0)) counters;
+            lua_setiuservalue(L, 1, 1);
+            return *c;
+        }
+        static void recv(lua_State* L, size_t bytes) {
+            auto& c = get(L);
+            ++c.recv_calls;
+            c.recv_bytes += bytes;
+        }
+        static void send(lua_State* L, size_t bytes) {
+            auto& c = get(L);
+            ++c.send_calls;
+            c.send_bytes += bytes;
+        }
+        static void recv_wait(lua_State* L) {
+            auto& c = get(L);
+            ++c.recv_calls;
+            ++c.recv_waits;
+        }
+        static void send_wait(lua_State* L) {
+            auto& c = get(L);
+            ++c.send_calls;
+            ++c.send_waits;
+        }
+    }
+
     struct fd_no_ownership {
         net::fd_t v;
         fd_no_ownership(net::fd_t v) noexcept
@@ -130,6 +213,53 @@ namespace bee::lua_socket {
                 std::unreachable();
             }
         }
+        // Drains up to max pending connections. When an epoll is given, each
+        // new fd is registered with it, as by epoll:event_add(fd, events).
+        static int accept_many(lua_State* L, net::fd_t fd) {
+            auto max = lua::checkinteger<int>(L, 2);
+            luaL_argcheck(L, max > 0, 2, "count must be positive");
+            lua_settop(L, 5);
+            if (lua_isnil(L, 3)) {
+                lua_createtable(L, max, 0);
+                lua_replace(L, 3);
+            } else {
+                luaL_checktype(L, 3, LUA_TTABLE);
+            }
+            bool reg        = !lua_isnil(L, 4);
+            uint32_t events = reg ? (uint32_t)luaL_checkinteger(L, 5) : 0;
+            int n = 0;
+            while (n < max) {
+                net::fd_t newfd;
+                auto status = net::socket::accept(fd, newfd);
+                if (status == net::socket::status::wait) {
+                    break;
+                }
+                if (status == net::socket::status::failed) {
+                    if (n == 0) {
+                        return lua::return_net_error(L, "accept");
+                    }
+                    break;
+                }
+                lua::newudata<net::fd_t>(L, newfd);
+                if (reg) {
+                    lua_pushvalue(L, -1);
+                    if (!lua_epoll::event_add(L, 4, newfd, events)) {
+                        // the fd is closed, accepted ones are still returned.
+                        auto& failed = lua::toudata<net::fd_t>(L, -2);
+                        net::socket::close(failed);
+                        failed = net::retired_fd;
+                        lua_pushinteger(L, n);
+                        lua_pushvalue(L, 3);
+                        lua_pushvalue(L, -3);
+                        return 3;
+                    }
+                }
+                lua_rawseti(L, 3, ++n);
+            }
+            lua_pushinteger(L, n);
+            lua_pushvalue(L, 3);
+            return 2;
+        }
         static int recv(lua_State* L, net::fd_t fd) {
             auto len = lua::optinteger<int, LUAL_BUFFERSIZE>(L, 2);
             luaL_Buffer b;
@@ -141,9 +271,11 @@ namespace bee::lua_socket {
                 lua_pushnil(L);
                 return 1;
             case net::socket::recv_status::wait:
+                traffic::recv_wait(L);
                 lua_pushboolean(L, 0);
                 return 1;
             case net::socket::recv_status::success:
+                traffic::recv(L, (size_t)rc);
                 luaL_pushresultsize(&b, rc);
                 return 1;
             case net::socket::recv_status::failed:
@@ -157,9 +289,110 @@ namespace bee::lua_socket {
             int rc;
             switch (net::socket::send(fd, rc, buf.data(), (int)buf.size())) {
             case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                lua_pushinteger(L, rc);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "send");
+            default:
+                std::unreachable();
+            }
+        }
+        static int sendv(lua_State* L, net::fd_t fd) {
+            int nparts = lua_gettop(L) - 1;
+            net::socket::iobuf bufs[net::socket::kMaxSendv];
+            size_t n = std::min((size_t)nparts, net::socket::kMaxSendv);
+            for (size_t i = 0; i < n; ++i) {
+                auto str    = lua::checkstrview(L, (int)i + 2);
+                bufs[i].buf = str.data();
+                bufs[i].len = str.size();
+            }
+            for (int i = (int)n; i < nparts; ++i) {
+                luaL_checkstring(L, i + 2);
+            }
+            int rc;
+            switch (net::socket::sendv(fd, rc, { bufs, n })) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                break;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "sendv");
+            default:
+                std::unreachable();
+            }
+            lua_pushinteger(L, rc);
+            // on a partial send, also return the index of the first part
+            // that was not fully sent and the bytes of it already sent.
+            size_t left = (size_t)rc;
+            for (size_t i = 0; i < (size_t)nparts; ++i) {
+                size_t len = i < n ? bufs[i].len : lua_rawlen(L, (int)i + 2);
+                if (left < len) {
+                    lua_pushinteger(L, (lua_Integer)i + 1);
+                    lua_pushinteger(L, (lua_Integer)left);
+                    return 3;
+                }
+                left -= len;
+            }
+            return 1;
+        }
+        static int recv_into(lua_State* L, net::fd_t fd) {
+            auto& b    = lua_buffer::checkbuffer(L, 2);
+            size_t def = std::max<size_t>(b.writable(), LUAL_BUFFERSIZE);
+            auto len   = (size_t)luaL_optinteger(L, 3, (lua_Integer)std::min<size_t>(def, INT_MAX));
+            luaL_argcheck(L, len > 0 && len <= INT_MAX, 3, "length out of range");
+            char* buf = b.prepare(len);
+            if (!buf) {
+                return luaL_error(L, "not enough memory");
+            }
+            int rc;
+            switch (net::socket::recv(fd, rc, buf, (int)len)) {
+            case net::socket::recv_status::close:
+                lua_pushnil(L);
+                return 1;
+            case net::socket::recv_status::wait:
+                traffic::recv_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::recv_status::success:
+                traffic::recv(L, (size_t)rc);
+                b.commit((size_t)rc);
+                lua_pushinteger(L, rc);
+                return 1;
+            case net::socket::recv_status::failed:
+                return lua::return_net_error(L, "recv");
+            default:
+                std::unreachable();
+            }
+        }
+        static int send_from(lua_State* L, net::fd_t fd) {
+            auto& b    = lua_buffer::checkbuffer(L, 2);
+            size_t len = std::min<size_t>(b.size(), INT_MAX);
+            if (!lua_isnoneornil(L, 3)) {
+                auto n = luaL_checkinteger(L, 3);
+                luaL_argcheck(L, n >= 0, 3, "length must be non-negative");
+                len = std::min<size_t>(len, (size_t)n);
+            }
+            if (len == 0) {
+                lua_pushinteger(L, 0);
+                return 1;
+            }
+            int rc;
+            switch (net::socket::send(fd, rc, b.data(), (int)len)) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
                 lua_pushboolean(L, 0);
                 return 1;
             case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                b.consume((size_t)rc);
                 lua_pushinteger(L, rc);
                 return 1;
             case net::socket::status::failed:
@@ -177,10 +410,12 @@ namespace bee::lua_socket {
             int rc;
             switch (net::socket::recvfrom(fd, rc, ep, buf, len)) {
             case net::socket::status::success:
+                traffic::recv(L, (size_t)rc);
                 luaL_pushresultsize(&b, rc);
                 lua_insert(L, -2);
                 return 2;
             case net::socket::status::wait:
+                traffic::recv_wait(L);
                 lua_pushboolean(L, 0);
                 return 1;
             case net::socket::status::failed:
@@ -196,9 +431,11 @@ namespace bee::lua_socket {
             int rc;
             switch (net::socket::sendto(fd, rc, buf.data(), (int)buf.size(), ep)) {
             case net::socket::status::wait:
+                traffic::send_wait(L);
                 lua_pushboolean(L, 0);
                 return 1;
             case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
                 lua_pushinteger(L, rc);
                 return 1;
             case net::socket::status::failed:
@@ -207,6 +444,216 @@ namespace bee::lua_socket {
                 std::unreachable();
             }
         }
+        static net::endpoint* pooled_endpoint(lua_State* L, int t, lua_Integer i) {
+            lua_rawgeti(L, t, i);
+            auto ep = (net::endpoint*)luaL_testudata(L, -1, reflection::name_v<net::endpoint>.data());
+            if (!ep) {
+                lua_pop(L, 1);
+                ep = &lua::newudata<net::endpoint>(L);
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, t, i);
+            }
+            lua_pop(L, 1);
+            return ep;
+        }
+        static int recvmmsg(lua_State* L, net::fd_t fd) {
+            auto n   = std::min((size_t)lua::checkinteger<uint32_t>(L, 2), net::socket::kMaxMmsg);
+            auto len = lua::optinteger<int, LUAL_BUFFERSIZE>(L, 3);
+            luaL_argcheck(L, n > 0, 2, "count must be positive");
+            luaL_argcheck(L, len > 0, 3, "length must be positive");
+            lua_settop(L, 5);
+            for (int t = 4; t <= 5; ++t) {
+                if (lua_isnil(L, t)) {
+                    lua_createtable(L, (int)n, 0);
+                    lua_replace(L, t);
+                } else {
+                    luaL_checktype(L, t, LUA_TTABLE);
+                }
+            }
+            dynarray<char> storage(n * (size_t)len);
+            net::socket::datagram msgs[net::socket::kMaxMmsg];
+            for (size_t i = 0; i < n; ++i) {
+                msgs[i].buf = storage.data() + i * (size_t)len;
+                msgs[i].len = (size_t)len;
+                msgs[i].ep  = pooled_endpoint(L, 5, (lua_Integer)i + 1);
+            }
+            int rc;
+            switch (net::socket::recvmmsg(fd, rc, { msgs, n })) {
+            case net::socket::status::success:
+                break;
+            case net::socket::status::wait:
+                traffic::recv_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "recvmmsg");
+            default:
+                std::unreachable();
+            }
+            size_t bytes = 0;
+            for (int i = 0; i < rc; ++i) {
+                bytes += msgs[i].len;
+                lua_pushlstring(L, msgs[i].buf, msgs[i].len);
+                lua_rawseti(L, 4, i + 1);
+            }
+            traffic::recv(L, bytes);
+            lua_pushinteger(L, rc);
+            lua_insert(L, 4);
+            return 3;
+        }
+        static int sendmmsg(lua_State* L, net::fd_t fd) {
+            luaL_checktype(L, 2, LUA_TTABLE);
+            bool multi        = lua_type(L, 3) == LUA_TTABLE;
+            net::endpoint* ep = multi ? nullptr : &lua::checkudata<net::endpoint>(L, 3);
+            lua_Integer count = luaL_optinteger(L, 4, (lua_Integer)lua_rawlen(L, 2));
+            luaL_argcheck(L, count >= 0, 4, "count must be non-negative");
+            auto n = std::min((size_t)count, net::socket::kMaxMmsg);
+            net::socket::datagram msgs[net::socket::kMaxMmsg];
+            for (size_t i = 0; i < n; ++i) {
+                lua_rawgeti(L, 2, (lua_Integer)i + 1);
+                size_t sz;
+                const char* data = lua_tolstring(L, -1, &sz);
+                if (!data) {
+                    return luaL_error(L, "datagram #%d is not a string", (int)i + 1);
+                }
+                lua_pop(L, 1);
+                msgs[i].buf = (char*)data;
+                msgs[i].len = sz;
+                if (multi) {
+                    lua_rawgeti(L, 3, (lua_Integer)i + 1);
+                    msgs[i].ep = (net::endpoint*)luaL_testudata(L, -1, reflection::name_v<net::endpoint>.data());
+                    if (!msgs[i].ep) {
+                        return luaL_error(L, "endpoint #%d is not an endpoint", (int)i + 1);
+                    }
+                    lua_pop(L, 1);
+                } else {
+                    msgs[i].ep = ep;
+                }
+            }
+            int rc;
+            switch (net::socket::sendmmsg(fd, rc, { msgs, n })) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success: {
+                size_t bytes = 0;
+                for (int i = 0; i < rc; ++i) {
+                    bytes += msgs[i].len;
+                }
+                traffic::send(L, bytes);
+                lua_pushinteger(L, rc);
+                return 1;
+            }
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "sendmmsg");
+            default:
+                std::unreachable();
+            }
+        }
+        static int sendfile(lua_State* L, net::fd_t fd) {
+            luaL_Stream* p = lua::tofile(L, 2);
+            if (!p->closef) {
+                return lua::return_error(L, "bad file descriptor");
+            }
+            auto offset = luaL_checkinteger(L, 3);
+            auto len    = lua::checkinteger<int>(L, 4);
+            luaL_argcheck(L, offset >= 0, 3, "offset must be non-negative");
+            luaL_argcheck(L, len >= 0, 4, "length must be non-negative");
+            if (len == 0) {
+                lua_pushinteger(L, 0);
+                return 1;
+            }
+            int rc;
+            switch (net::socket::sendfile(fd, rc, file_handle::from_file(p->f), (int64_t)offset, len)) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                lua_pushinteger(L, rc);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "sendfile");
+            default:
+                std::unreachable();
+            }
+        }
+#if !defined(_WIN32)
+        static net::fd_t topassfd(lua_State* L, int idx) {
+            if (lua_type(L, idx) == LUA_TLIGHTUSERDATA) {
+                return lua::tolightud<net::fd_t>(L, idx);
+            }
+            return checkfd(L, idx);
+        }
+        // Passes one socket, or a table of them, along with data. The data
+        // must not be empty: stream sockets only deliver the descriptors
+        // together with at least one byte.
+        static int sendfd(lua_State* L, net::fd_t fd) {
+            net::fd_t fds[net::socket::kMaxFds];
+            size_t n = 0;
+            if (lua_type(L, 2) == LUA_TTABLE) {
+                lua_Integer len = luaL_len(L, 2);
+                luaL_argcheck(L, len > 0 && (size_t)len <= net::socket::kMaxFds, 2, "invalid descriptor count");
+                for (lua_Integer i = 1; i <= len; ++i) {
+                    lua_geti(L, 2, i);
+                    fds[n++] = topassfd(L, -1);
+                    lua_pop(L, 1);
+                }
+            } else {
+                fds[n++] = topassfd(L, 2);
+            }
+            auto buf = lua::checkstrview(L, 3);
+            luaL_argcheck(L, !buf.empty(), 3, "data must not be empty");
+            int rc;
+            switch (net::socket::sendfd(fd, rc, buf.data(), (int)std::min(buf.size(), (size_t)INT_MAX), { fds, n })) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                lua_pushinteger(L, rc);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "sendmsg");
+            default:
+                std::unreachable();
+            }
+        }
+        static int recvfd(lua_State* L, net::fd_t fd) {
+            auto len = lua::optinteger<int, LUAL_BUFFERSIZE>(L, 2);
+            luaL_Buffer b;
+            luaL_buffinit(L, &b);
+            char* buf = luaL_prepbuffsize(&b, (size_t)len);
+            net::fd_t fds[net::socket::kMaxFds];
+            size_t n;
+            int rc;
+            switch (net::socket::recvfd(fd, rc, buf, len, fds, n)) {
+            case net::socket::recv_status::close:
+                lua_pushnil(L);
+                return 1;
+            case net::socket::recv_status::wait:
+                traffic::recv_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::recv_status::success:
+                traffic::recv(L, (size_t)rc);
+                luaL_pushresultsize(&b, rc);
+                lua_createtable(L, (int)n, 0);
+                for (size_t i = 0; i < n; ++i) {
+                    lua::newudata<net::fd_t>(L, fds[i]);
+                    lua_rawseti(L, -2, (lua_Integer)i + 1);
+                }
+                return 2;
+            case net::socket::recv_status::failed:
+                return lua::return_net_error(L, "recvmsg");
+            default:
+                std::unreachable();
+            }
+        }
+#endif
         static int shutdown(lua_State* L, net::fd_t fd, net::socket::shutdown_flag flag) {
             if (!net::socket::shutdown(fd, flag)) {
                 return lua::return_net_error(L, "shutdown");
@@ -256,21 +703,331 @@ namespace bee::lua_socket {
             }
             return 0;
         }
+        static void setfield(lua_State* L, const char* name, uint64_t v) {
+            lua_pushinteger(L, (lua_Integer)v);
+            lua_setfield(L, -2, name);
+        }
+        static int tcpinfo(lua_State* L, net::fd_t fd) {
+            net::socket::connection_info ci;
+            if (!net::socket::tcpinfo(fd, ci)) {
+                return lua::return_net_error(L, "tcpinfo");
+            }
+            lua_createtable(L, 0, 9);
+            setfield(L, "rtt", ci.rtt);
+            setfield(L, "rttvar", ci.rttvar);
+            setfield(L, "cwnd", ci.cwnd);
+            setfield(L, "mss", ci.mss);
+            setfield(L, "retransmits", ci.retransmits);
+            setfield(L, "unacked", ci.unacked);
+            setfield(L, "inflight", ci.inflight);
+            setfield(L, "sendq", ci.sendq);
+            setfield(L, "recvq", ci.recvq);
+            return 1;
+        }
+        static int stats(lua_State* L, net::fd_t fd) {
+            traffic::counters c;
+            if (auto p = traffic::find(L)) {
+                c = *p;
+            }
+            lua_createtable(L, 0, 6);
+            setfield(L, "recv_bytes", c.recv_bytes);
+            setfield(L, "send_bytes", c.send_bytes);
+            setfield(L, "recv_calls", c.recv_calls);
+            setfield(L, "send_calls", c.send_calls);
+            setfield(L, "recv_waits", c.recv_waits);
+            setfield(L, "send_waits", c.send_waits);
+            return 1;
+        }
         static int handle(lua_State* L, net::fd_t fd) {
             lua_pushlightuserdata(L, (void*)(intptr_t)fd);
             return 1;
         }
         static int option(lua_State* L, net::fd_t fd) {
-            static const char* const opts[] = { "reuseaddr", "sndbuf", "rcvbuf", NULL };
-            auto opt                        = (net::socket::option)luaL_checkoption(L, 2, NULL, opts);
-            auto value                      = lua::checkinteger<int>(L, 3);
-            bool ok                         = net::socket::setoption(fd, opt, value);
+            static const char* const opts[] = {
+                "reuseaddr", "sndbuf", "rcvbuf", "reuseport",
+                "nodelay", "keepalive", "keepidle", "keepintvl",
+                "keepcnt", "defer_accept", "busy_poll", "cork", NULL
+            };
+            auto opt   = (net::socket::option)luaL_checkoption(L, 2, NULL, opts);
+            auto value = lua::checkinteger<int>(L, 3);
+            bool ok    = net::socket::setoption(fd, opt, value);
             if (!ok) {
                 return lua::return_net_error(L, "setsockopt");
             }
             lua_pushboolean(L, 1);
             return 1;
         }
+        // While corked, small writes are held back and coalesced into full
+        // segments; uncork sends whatever is left.
+        static int cork(lua_State* L, net::fd_t fd) {
+            if (!net::socket::setoption(fd, net::socket::option::cork, 1)) {
+                return lua::return_net_error(L, "setsockopt");
+            }
+            lua_pushboolean(L, 1);
+            return 1;
+        }
+        static int uncork(lua_State* L, net::fd_t fd) {
+            if (!net::socket::setoption(fd, net::socket::option::cork, 0)) {
+                return lua::return_net_error(L, "setsockopt");
+            }
+            lua_pushboolean(L, 1);
+            return 1;
+        }
+#if defined(__linux__)
+        // Below this size pinning the pages costs more than copying them,
+        // so send_zc falls back to a plain send.
+        constexpr size_t kZerocopyMin = 10240;
+        static int kZerocopyKey       = 0;
+        // The zerocopy records of this Lua state, by fd. A record holds the
+        // strings still read by the kernel keyed by completion id, the next
+        // id, the pending count, and the error-queue entries that were not
+        // completions until reap_zc returns them. Completions arrive on the
+        // socket itself, so a socket closed with sends pending lingers: its
+        // record is marked closing and the fd stays open until the last
+        // completion is reaped, or until the Lua state is closed.
+        static int zerocopy_records_gc(lua_State* L) {
+            lua_pushnil(L);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &kZerocopyKey);
+            lua_pushnil(L);
+            while (lua_next(L, 1)) {
+                if (lua_type(L, -2) == LUA_TNUMBER) {
+                    lua_getfield(L, -1, "closing");
+                    if (lua_toboolean(L, -1)) {
+                        net::socket::close((net::fd_t)lua_tointeger(L, -3));
+                    }
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+            return 0;
+        }
+        static bool zerocopy_records(lua_State* L, bool create) {
+            if (lua_rawgetp(L, LUA_REGISTRYINDEX, &kZerocopyKey) == LUA_TTABLE) {
+                return true;
+            }
+            if (!create) {
+                return false;
+            }
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, zerocopy_records_gc);
+            lua_setfield(L, -2, "__gc");
+            lua_setmetatable(L, -2);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &kZerocopyKey);
+            return true;
+        }
+        // Pushes the zerocopy record of fd, or nil.
+        static int zerocopy_record(lua_State* L, net::fd_t fd, bool create) {
+            if (!zerocopy_records(L, create)) {
+                return LUA_TNIL;
+            }
+            int t = lua_rawgeti(L, -1, fd);
+            if (t == LUA_TNIL && create) {
+                lua_pop(L, 1);
+                lua_createtable(L, 0, 2);
+                lua_pushinteger(L, 0);
+                lua_setfield(L, -2, "next");
+                lua_pushinteger(L, 0);
+                lua_setfield(L, -2, "pending");
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, -3, fd);
+                t = LUA_TTABLE;
+            }
+            lua_remove(L, -2);
+            return t;
+        }
+        static lua_Integer addfield(lua_State* L, int idx, const char* name, lua_Integer delta) {
+            lua_getfield(L, idx, name);
+            lua_Integer v = lua_tointeger(L, -1) + delta;
+            lua_pop(L, 1);
+            lua_pushinteger(L, v);
+            lua_setfield(L, idx, name);
+            return v;
+        }
+        // Reaps the error queue of fd into the record at index rec: drops
+        // the strings of completed sends and keeps any other entry in the
+        // record's errors list. Returns false when recvmsg failed.
+        static bool zerocopy_reap(lua_State* L, net::fd_t fd, int rec, lua_Integer& done, bool& copied) {
+            for (;;) {
+                net::socket::errqueue_entry e;
+                auto status = net::socket::reap_zerocopy(fd, e);
+                if (status == net::socket::status::wait) {
+                    return true;
+                }
+                if (status == net::socket::status::failed) {
+                    return false;
+                }
+                if (!e.zerocopy) {
+                    if (lua_getfield(L, rec, "errors") != LUA_TTABLE) {
+                        lua_pop(L, 1);
+                        lua_newtable(L);
+                        lua_pushvalue(L, -1);
+                        lua_setfield(L, rec, "errors");
+                    }
+                    lua_createtable(L, 0, 2);
+                    lua_pushinteger(L, e.origin);
+                    lua_setfield(L, -2, "origin");
+                    lua_pushinteger(L, e.error);
+                    lua_setfield(L, -2, "errno");
+                    lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+                    lua_pop(L, 1);
+                    continue;
+                }
+                copied             = copied || e.copied;
+                lua_Integer before = done;
+                for (uint32_t id = e.lo;; ++id) {
+                    lua_pushnil(L);
+                    lua_rawseti(L, rec, id);
+                    ++done;
+                    if (id == e.hi) {
+                        break;
+                    }
+                }
+                addfield(L, rec, "pending", before - done);
+            }
+        }
+        // Reaps a lingering fd, given its record at index rec in the records
+        // at index recs, and closes it once nothing is pending.
+        static void zerocopy_settle(lua_State* L, net::fd_t fd, int recs, int rec) {
+            lua_Integer done = 0;
+            bool copied      = false;
+            bool ok          = zerocopy_reap(L, fd, rec, done, copied);
+            lua_getfield(L, rec, "pending");
+            lua_Integer pending = lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            if (ok && pending > 0) {
+                return;
+            }
+            net::socket::close(fd);
+            lua_pushnil(L);
+            lua_rawseti(L, recs, fd);
+            addfield(L, recs, "lingering", -1);
+        }
+        // Reaps every lingering fd of this Lua state.
+        static void zerocopy_sweep(lua_State* L) {
+            int top = lua_gettop(L);
+            if (zerocopy_records(L, false)) {
+                lua_getfield(L, top + 1, "lingering");
+                bool any = lua_tointeger(L, -1) > 0;
+                lua_pop(L, 1);
+                lua_pushnil(L);
+                while (any && lua_next(L, top + 1)) {
+                    if (lua_type(L, -2) == LUA_TNUMBER) {
+                        lua_getfield(L, -1, "closing");
+                        bool closing = lua_toboolean(L, -1);
+                        lua_pop(L, 1);
+                        if (closing) {
+                            zerocopy_settle(L, (net::fd_t)lua_tointeger(L, -2), top + 1, lua_gettop(L));
+                        }
+                    }
+                    lua_pop(L, 1);
+                }
+            }
+            lua_settop(L, top);
+        }
+        // Called when the socket of fd is closed. Returns true when sends
+        // are still pending: the fd is then left open, lingering until
+        // they complete.
+        static bool zerocopy_linger(lua_State* L, net::fd_t fd) {
+            int top = lua_gettop(L);
+            if (zerocopy_records(L, false) && lua_rawgeti(L, top + 1, fd) == LUA_TTABLE) {
+                lua_Integer done = 0;
+                bool copied      = false;
+                bool ok          = zerocopy_reap(L, fd, top + 2, done, copied);
+                lua_getfield(L, top + 2, "pending");
+                bool pending = ok && lua_tointeger(L, -1) > 0;
+                lua_pop(L, 1);
+                if (pending) {
+                    lua_pushboolean(L, 1);
+                    lua_setfield(L, top + 2, "closing");
+                    addfield(L, top + 1, "lingering", 1);
+                    lua_settop(L, top);
+                    return true;
+                }
+                lua_pushnil(L);
+                lua_rawseti(L, top + 1, fd);
+            }
+            lua_settop(L, top);
+            return false;
+        }
+        static int zerocopy(lua_State* L, net::fd_t fd) {
+            if (!net::socket::setoption(fd, net::socket::option::zerocopy, 1)) {
+                return lua::return_net_error(L, "setsockopt");
+            }
+            zerocopy_record(L, fd, true);
+            lua_pushboolean(L, 1);
+            return 1;
+        }
+        // Sends data from offset without copying it. The string stays
+        // referenced until its completion is reaped, which the kernel
+        // signals as EPOLLERR on the socket; bee.epoll reaps then, and
+        // reap_zc can be called at any time.
+        static int send_zc(lua_State* L, net::fd_t fd) {
+            auto buf = lua::checkstrview(L, 2);
+            auto off = luaL_optinteger(L, 3, 0);
+            luaL_argcheck(L, off >= 0 && (size_t)off <= buf.size(), 3, "offset out of range");
+            lua_settop(L, 3);
+            zerocopy_sweep(L);
+            if (zerocopy_record(L, fd, false) != LUA_TTABLE) {
+                return luaL_error(L, "zerocopy is not enabled.");
+            }
+            const char* data = buf.data() + off;
+            int len          = (int)std::min(buf.size() - (size_t)off, (size_t)INT_MAX);
+            int rc;
+            auto status = (size_t)len < kZerocopyMin
+                              ? net::socket::send(fd, rc, data, len)
+                              : net::socket::send_zerocopy(fd, rc, data, len);
+            switch (status) {
+            case net::socket::status::wait:
+                traffic::send_wait(L);
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::success:
+                traffic::send(L, (size_t)rc);
+                if ((size_t)len >= kZerocopyMin) {
+                    auto id = addfield(L, 4, "next", 1) - 1;
+                    lua_pushvalue(L, 2);
+                    lua_rawseti(L, 4, id);
+                    if (id == UINT32_MAX) {
+                        lua_pushinteger(L, 0);
+                        lua_setfield(L, 4, "next");
+                    }
+                    addfield(L, 4, "pending", 1);
+                }
+                lua_pushinteger(L, rc);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "send");
+            default:
+                std::unreachable();
+            }
+        }
+        // Releases the strings of completed zero-copy sends. Returns how
+        // many completed, how many are still pending, whether the kernel
+        // had to copy any of them, and the other entries of the error
+        // queue as a list of { origin, errno }, or nil if there were none.
+        static int reap_zc(lua_State* L, net::fd_t fd) {
+            lua_settop(L, 1);
+            zerocopy_sweep(L);
+            if (zerocopy_record(L, fd, false) != LUA_TTABLE) {
+                return luaL_error(L, "zerocopy is not enabled.");
+            }
+            lua_Integer done = 0;
+            bool copied      = false;
+            if (!zerocopy_reap(L, fd, 2, done, copied)) {
+                return lua::return_net_error(L, "recvmsg");
+            }
+            lua_pushinteger(L, done);
+            lua_getfield(L, 2, "pending");
+            lua_pushboolean(L, copied);
+            lua_getfield(L, 2, "errors");
+            lua_pushnil(L);
+            lua_setfield(L, 2, "errors");
+            return 4;
+        }
+#endif
         static int connect(lua_State* L, net::fd_t fd) {
             net::endpoint stack_ep;
             const auto& ep = to_endpoint(L, 2, stack_ep);
@@ -333,10 +1090,19 @@ namespace bee::lua_socket {
             lua_pushfstring(L, "socket (%d) (no ownership)", fd);
             return 1;
         }
+        // Closes fd, unless zero-copy sends on it are still pending.
+        static bool closefd(lua_State* L, net::fd_t fd) {
+#if defined(__linux__)
+            if (zerocopy_linger(L, fd)) {
+                return true;
+            }
+#endif
+            return net::socket::close(fd);
+        }
         static int close(lua_State* L) {
             auto& fd = lua::checkudata<net::fd_t>(L, 1);
             if (fd != net::retired_fd) {
-                if (!net::socket::close(fd)) {
+                if (!closefd(L, fd)) {
                     fd = net::retired_fd;
                     return lua::return_net_error(L, "close");
                 }
@@ -348,7 +1114,7 @@ namespace bee::lua_socket {
         static int mt_close(lua_State* L) {
             auto& fd = lua::checkudata<net::fd_t>(L, 1);
             if (fd != net::retired_fd) {
-                net::socket::close(fd);
+                closefd(L, fd);
                 fd = net::retired_fd;
             }
             return 0;
@@ -356,10 +1122,62 @@ namespace bee::lua_socket {
         static int mt_gc(lua_State* L) {
             auto fd = lua::checkudata<net::fd_t>(L, 1);
             if (fd != net::retired_fd) {
-                net::socket::close(fd);
+                closefd(L, fd);
             }
             return 0;
         }
+        // Packing dup()s the handle and parks it under a fresh id; the first
+        // unpack takes it, so unpacking the same buffer again fails instead
+        // of sharing one handle between two owners. A buffer that is never
+        // unpacked keeps its handle open.
+        namespace transit {
+            static std::mutex mutex;
+            static lua_Integer next = 0;
+            static std::unordered_map<lua_Integer, net::fd_t> pending;
+        }
+        static int mt_seri(lua_State* L) {
+            auto fd = lua::checkudata<net::fd_t>(L, 1);
+            if (fd == net::retired_fd) {
+                return luaL_error(L, "socket is already closed.");
+            }
+            net::fd_t newfd = net::socket::dup(fd);
+            if (newfd == net::retired_fd) {
+                lua::push_net_error(L, "dup");
+                return lua_error(L);
+            }
+            std::lock_guard<std::mutex> lk(transit::mutex);
+            lua_Integer id       = ++transit::next;
+            transit::pending[id] = newfd;
+            lua_pushinteger(L, id);
+            return 1;
+        }
+        static int mt_deseri(lua_State* L) {
+            auto id      = luaL_checkinteger(L, 1);
+            net::fd_t fd = net::retired_fd;
+            {
+                std::lock_guard<std::mutex> lk(transit::mutex);
+                auto it = transit::pending.find(id);
+                if (it != transit::pending.end()) {
+                    fd = it->second;
+                    transit::pending.erase(it);
+                }
+            }
+            if (fd == net::retired_fd) {
+                return luaL_error(L, "socket is already unpacked.");
+            }
+            lua::newudata<net::fd_t>(L, fd);
+            return 1;
+        }
+        static int mt_seri_no_ownership(lua_State* L) {
+            auto fd = (net::fd_t)lua::checkudata<fd_no_ownership>(L, 1);
+            lua_pushlightuserdata(L, (void*)(intptr_t)fd);
+            return 1;
+        }
+        static int mt_deseri_no_ownership(lua_State* L) {
+            auto fd = lua::checklightud<net::fd_t>(L, 1);
+            lua::newudata<fd_no_ownership>(L, fd);
+            return 1;
+        }
         using socket_func = int (*)(lua_State*, net::fd_t);
         template <socket_func func, typename T = net::fd_t>
         static int call_socket(lua_State* L) {
@@ -370,20 +1188,41 @@ namespace bee::lua_socket {
             return func(L, fd);
         }
         static void metatable(lua_State* L) {
+            seri_register(mt_deseri);
             luaL_Reg lib[] = {
                 { "connect", call_socket<connect> },
                 { "bind", call_socket<bind> },
                 { "listen", call_socket<listen> },
                 { "accept", call_socket<accept> },
+                { "accept_many", call_socket<accept_many> },
                 { "recv", call_socket<recv> },
                 { "send", call_socket<send> },
+                { "sendv", call_socket<sendv> },
+                { "recv_into", call_socket<recv_into> },
+                { "send_from", call_socket<send_from> },
                 { "recvfrom", call_socket<recvfrom> },
                 { "sendto", call_socket<sendto> },
+                { "recvmmsg", call_socket<recvmmsg> },
+                { "sendmmsg", call_socket<sendmmsg> },
+                { "sendfile", call_socket<sendfile> },
+#if !defined(_WIN32)
+                { "sendfd", call_socket<sendfd> },
+                { "recvfd", call_socket<recvfd> },
+#endif
                 { "shutdown", call_socket<shutdown> },
                 { "status", call_socket<status> },
                 { "info", call_socket<info> },
                 { "option", call_socket<option> },
+                { "tcpinfo", call_socket<tcpinfo> },
+                { "stats", call_socket<stats> },
                 { "handle", call_socket<handle> },
+                { "cork", call_socket<cork> },
+                { "uncork", call_socket<uncork> },
+#if defined(__linux__)
+                { "zerocopy", call_socket<zerocopy> },
+                { "send_zc", call_socket<send_zc> },
+                { "reap_zc", call_socket<reap_zc> },
+#endif
                 { "detach", detach },
                 { "close", close },
                 { NULL, NULL },
@@ -395,25 +1234,48 @@ namespace bee::lua_socket {
                 { "__tostring", mt_tostring },
                 { "__close", mt_close },
                 { "__gc", mt_gc },
+                { "__seri", mt_seri },
+                { "__deseri", mt_deseri },
                 { NULL, NULL },
             };
             luaL_setfuncs(L, mt, 0);
         }
         static void metatable_no_ownership(lua_State* L) {
+            seri_register(mt_deseri_no_ownership);
             luaL_Reg lib[] = {
                 { "connect", call_socket<connect, fd_no_ownership> },
                 { "bind", call_socket<bind, fd_no_ownership> },
                 { "listen", call_socket<listen, fd_no_ownership> },
                 { "accept", call_socket<accept, fd_no_ownership> },
+                { "accept_many", call_socket<accept_many, fd_no_ownership> },
                 { "recv", call_socket<recv, fd_no_ownership> },
                 { "send", call_socket<send, fd_no_ownership> },
+                { "sendv", call_socket<sendv, fd_no_ownership> },
+                { "recv_into", call_socket<recv_into, fd_no_ownership> },
+                { "send_from", call_socket<send_from, fd_no_ownership> },
                 { "recvfrom", call_socket<recvfrom, fd_no_ownership> },
                 { "sendto", call_socket<sendto, fd_no_ownership> },
+                { "recvmmsg", call_socket<recvmmsg, fd_no_ownership> },
+                { "sendmmsg", call_socket<sendmmsg, fd_no_ownership> },
+                { "sendfile", call_socket<sendfile, fd_no_ownership> },
+#if !defined(_WIN32)
+                { "sendfd", call_socket<sendfd, fd_no_ownership> },
+                { "recvfd", call_socket<recvfd, fd_no_ownership> },
+#endif
                 { "shutdown", call_socket<shutdown, fd_no_ownership> },
                 { "status", call_socket<status, fd_no_ownership> },
                 { "info", call_socket<info, fd_no_ownership> },
                 { "option", call_socket<option, fd_no_ownership> },
+                { "tcpinfo", call_socket<tcpinfo, fd_no_ownership> },
+                { "stats", call_socket<stats, fd_no_ownership> },
                 { "handle", call_socket<handle, fd_no_ownership> },
+                { "cork", call_socket<cork, fd_no_ownership> },
+                { "uncork", call_socket<uncork, fd_no_ownership> },
+#if defined(__linux__)
+                { "zerocopy", call_socket<zerocopy, fd_no_ownership> },
+                { "send_zc", call_socket<send_zc, fd_no_ownership> },
+                { "reap_zc", call_socket<reap_zc, fd_no_ownership> },
+#endif
                 { NULL, NULL },
             };
             luaL_newlibtable(L, lib);
@@ -421,6 +1283,8 @@ namespace bee::lua_socket {
             lua_setfield(L, -2, "__index");
             luaL_Reg mt[] = {
                 { "__tostring", mt_tostring_no_ownership },
+                { "__seri", mt_seri_no_ownership },
+                { "__deseri", mt_deseri_no_ownership },
                 { NULL, NULL },
             };
             luaL_setfuncs(L, mt, 0);
@@ -514,6 +1378,103 @@ namespace bee::lua_socket {
         return 1;
     }
 
+    // Opens n listeners bound to the same address with SO_REUSEPORT, so that
+    // each worker thread can accept on its own socket. Port 0 is resolved
+    // by the first listener and shared by the rest.
+    static int l_listen_shards(lua_State* L) {
+        constexpr int kBackLog          = 511;
+        static const char* const opts[] = {
+            "tcp", "tcp6",
+            NULL
+        };
+        static const net::socket::protocol protocols[] = {
+            net::socket::protocol::tcp,
+            net::socket::protocol::tcp6,
+        };
+        auto protocol = protocols[luaL_checkoption(L, 1, NULL, opts)];
+        auto n        = lua::checkinteger<int>(L, 2);
+        luaL_argcheck(L, n > 0, 2, "listener count must be positive");
+        net::endpoint stack_ep;
+        net::endpoint ep = fd::to_endpoint(L, 3, stack_ep);
+        lua_settop(L, 3);
+        lua_createtable(L, n, 0);
+        for (int i = 1; i <= n; ++i) {
+            auto newfd = net::socket::open(protocol);
+            if (newfd == net::retired_fd) {
+                return lua::return_net_error(L, "socket");
+            }
+            lua::newudata<net::fd_t>(L, newfd);
+            lua_rawseti(L, 4, i);
+            if (!net::socket::setoption(newfd, net::socket::option::reuseport, 1)) {
+                return lua::return_net_error(L, "setsockopt");
+            }
+            if (!net::socket::bind(newfd, ep)) {
+                return lua::return_net_error(L, "bind");
+            }
+            if (!net::socket::listen(newfd, kBackLog)) {
+                return lua::return_net_error(L, "listen");
+            }
+            if (i == 1 && !net::socket::getsockname(newfd, ep)) {
+                return lua::return_net_error(L, "getsockname");
+            }
+        }
+        return 1;
+    }
+
+#if defined(__linux__)
+    struct splice_pipe {
+        net::fd_t fds[2] = { net::retired_fd, net::retired_fd };
+        size_t pending   = 0;
+        static void metatable(lua_State*) {}
+        ~splice_pipe() {
+            if (fds[0] != net::retired_fd) {
+                net::socket::close(fds[0]);
+                net::socket::close(fds[1]);
+            }
+        }
+    };
+    static int l_splice(lua_State* L) {
+        net::fd_t from = checkfd(L, 1);
+        net::fd_t to   = checkfd(L, 2);
+        auto len       = lua::optinteger<int, 65536>(L, 3);
+        luaL_argcheck(L, len > 0, 3, "length must be positive");
+        if (from == net::retired_fd || to == net::retired_fd) {
+            return luaL_error(L, "socket is already closed.");
+        }
+        // the pipe belongs to the destination, so bytes stuck in it are
+        // delivered to the same socket no matter where they came from.
+        lua_pushvalue(L, 2);
+        if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TUSERDATA) {
+            lua_pop(L, 1);
+            auto& sp = lua::newudata<splice_pipe>(L);
+            if (!net::socket::pipe(sp.fds)) {
+                return lua::return_net_error(L, "pipe");
+            }
+            lua_pushvalue(L, 2);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, lua_upvalueindex(1));
+        }
+        auto& sp = lua::toudata<splice_pipe>(L, -1);
+        int rc;
+        switch (net::socket::splice(from, to, sp.fds, sp.pending, rc, len)) {
+        case net::socket::recv_status::success:
+            lua_pushinteger(L, rc);
+            return 1;
+        case net::socket::recv_status::wait:
+            lua_pushboolean(L, 0);
+            lua_pushinteger(L, (lua_Integer)sp.pending);
+            return 2;
+        case net::socket::recv_status::close:
+            lua_pushnil(L);
+            return 1;
+        case net::socket::recv_status::failed:
+            return lua::return_net_error(L, "splice");
+        default:
+            std::unreachable();
+        }
+    }
+#endif
+
     static int luaopen(lua_State* L) {
         if (!net::socket::initialize()) {
             lua::push_sys_error(L, "initialize");
@@ -524,10 +1485,20 @@ namespace bee::lua_socket {
             { "endpoint", l_endpoint },
             { "pair", l_pair },
             { "fd", l_fd },
+            { "listen_shards", l_listen_shards },
             { NULL, NULL }
         };
         luaL_newlibtable(L, lib);
         luaL_setfuncs(L, lib, 0);
+#if defined(__linux__)
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushstring(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushcclosure(L, l_splice, 1);
+        lua_setfield(L, -2, "splice");
+#endif
         return 1;
     }
 }
@@ -537,14 +1508,57 @@ DEFINE_LUAOPEN(socket)
 namespace bee::lua {
     template <>
     struct udata<net::fd_t> {
+        static inline int nupvalue   = 1;
         static inline auto metatable = bee::lua_socket::fd::metatable;
     };
     template <>
     struct udata<lua_socket::fd_no_ownership> {
+        static inline int nupvalue   = 1;
         static inline auto metatable = bee::lua_socket::fd::metatable_no_ownership;
     };
     template <>
     struct udata<net::endpoint> {
         static inline auto metatable = bee::lua_socket::endpoint::metatable;
     };
+#if defined(__linux__)
+    template <>
+    struct udata<lua_socket::splice_pipe> {
+        static inline auto metatable = bee::lua_socket::splice_pipe::metatable;
+    };
+#endif
+}
+
+namespace bee::lua_socket {
+    void pushfd(lua_State* L, net::fd_t fd) {
+        lua::newudata<net::fd_t>(L, fd);
+    }
+    void pushendpoint(lua_State* L, const net::endpoint& ep) {
+        lua::newudata<net::endpoint>(L, ep);
+    }
+    net::fd_t& checkfd(lua_State* L, int idx) {
+        if (auto fd = (net::fd_t*)luaL_testudata(L, idx, reflection::name_v<net::fd_t>.data())) {
+            return *fd;
+        }
+        return lua::checkudata<fd_no_ownership>(L, idx).v;
+    }
+#if defined(__linux__)
+    bool reapzerocopy(lua_State* L, net::fd_t fd) {
+        int top     = lua_gettop(L);
+        bool linger = false;
+        if (fd::zerocopy_records(L, false) && lua_rawgeti(L, top + 1, fd) == LUA_TTABLE) {
+            lua_getfield(L, top + 2, "closing");
+            linger = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+            if (linger) {
+                fd::zerocopy_settle(L, fd, top + 1, top + 2);
+            } else {
+                lua_Integer done = 0;
+                bool copied      = false;
+                fd::zerocopy_reap(L, fd, top + 2, done, copied);
+            }
+        }
+        lua_settop(L, top);
+        return linger;
+    }
+#endif
 }
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <bee/net/fd.h>
+#include <lua.hpp>
+
+namespace bee::net {
+    struct endpoint;
+}
+
+namespace bee::lua_socket {
+    void pushfd(lua_State* L, net::fd_t fd);
+    void pushendpoint(lua_State* L, const net::endpoint& ep);
+    // Returns the fd stored in a socket userdata, owned or not. The
+    // reference stays valid as long as the userdata is alive.
+    net::fd_t& checkfd(lua_State* L, int idx);
+#if defined(__linux__)
+    // Reaps the zero-copy completions queued on fd, as bee.epoll does when
+    // it reports EPOLLERR. Returns true when fd belongs to a socket that is
+    // already closed and only lingers until those completions arrive.
+    bool reapzerocopy(lua_State* L, net::fd_t fd);
+#endif
+}
@@ -0,0 +1,383 @@
+#include <3rd/lua-seri/lua-seri.h>
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/net/socket.h>
+#include <bee/nonstd/unreachable.h>
+#include <binding/lua_buffer.h>
+#include <binding/lua_socket.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+namespace bee::lua_stream {
+    // Buffers a nonblocking socket. Reads pull from the socket only when the
+    // buffered data cannot satisfy the request; writes are queued until
+    // flush. The socket userdata is kept alive as the stream's user value.
+    struct stream {
+        net::fd_t* fd;
+        lua_buffer::buffer rbuf;
+        lua_buffer::buffer wbuf;
+        size_t scanned = 0;
+        bool eof       = false;
+        stream(net::fd_t* fd)
+            : fd(fd) {}
+    };
+
+    constexpr size_t kReadSize     = 16384;
+    constexpr size_t kMaxFrameSize = 16 * 1024 * 1024;
+
+    enum class fill_status {
+        success,
+        wait,
+        close,
+        failed,
+    };
+
+    static stream& checkstream(lua_State* L) {
+        auto& s = lua::checkudata<stream>(L, 1);
+        if (*s.fd == net::retired_fd) {
+            luaL_error(L, "socket is already closed.");
+        }
+        return s;
+    }
+
+    static fill_status fill(stream& s) {
+        if (s.eof) {
+            return fill_status::close;
+        }
+        size_t len = std::max(kReadSize, s.rbuf.writable());
+        char* buf  = s.rbuf.prepare(len);
+        if (!buf) {
+            return fill_status::failed;
+        }
+        len = std::min(s.rbuf.writable(), (size_t)INT_MAX);
+        int rc;
+        switch (net::socket::recv(*s.fd, rc, buf, (int)len)) {
+        case net::socket::recv_status::success:
+            s.rbuf.commit((size_t)rc);
+            return fill_status::success;
+        case net::socket::recv_status::wait:
+            return fill_status::wait;
+        case net::socket::recv_status::close:
+            s.eof = true;
+            return fill_status::close;
+        case net::socket::recv_status::failed:
+            return fill_status::failed;
+        default:
+            std::unreachable();
+        }
+    }
+
+    static void pushdata(lua_State* L, stream& s, size_t n) {
+        lua_pushlstring(L, s.rbuf.data(), n);
+        s.rbuf.consume(n);
+        s.scanned = 0;
+    }
+
+    // Pushes the result of a read that could not complete: false while
+    // more data may arrive, nil once the peer has closed.
+    static int pushpending(lua_State* L, fill_status status) {
+        switch (status) {
+        case fill_status::wait:
+            lua_pushboolean(L, 0);
+            return 1;
+        case fill_status::close:
+            lua_pushnil(L);
+            return 1;
+        case fill_status::failed:
+            return lua::return_net_error(L, "recv");
+        default:
+            std::unreachable();
+        }
+    }
+
+    static int readline(lua_State* L) {
+        auto& s       = checkstream(L);
+        bool keep_eol = lua_toboolean(L, 2);
+        auto maxlen   = lua::optinteger<size_t, kMaxFrameSize>(L, 3);
+        for (;;) {
+            const char* data = s.rbuf.data();
+            size_t size      = s.rbuf.size();
+            if (size > s.scanned) {
+                if (auto eol = (const char*)std::memchr(data + s.scanned, '\n', size - s.scanned)) {
+                    size_t n = (size_t)(eol - data) + 1;
+                    if (n - 1 > maxlen) {
+                        return luaL_error(L, "line too large (%I bytes)", (lua_Integer)(n - 1));
+                    }
+                    lua_pushlstring(L, data, keep_eol ? n : n - 1);
+                    s.rbuf.consume(n);
+                    s.scanned = 0;
+                    return 1;
+                }
+            }
+            if (size > maxlen) {
+                return luaL_error(L, "line too large (%I bytes)", (lua_Integer)size);
+            }
+            s.scanned = size;
+            auto status = fill(s);
+            if (status == fill_status::success) {
+                continue;
+            }
+            if (status == fill_status::close && s.rbuf.size() > 0) {
+                pushdata(L, s, s.rbuf.size());
+                return 1;
+            }
+            return pushpending(L, status);
+        }
+    }
+
+    static int read(lua_State* L) {
+        auto& s = checkstream(L);
+        if (lua_isnoneornil(L, 2)) {
+            if (s.rbuf.size() == 0) {
+                auto status = fill(s);
+                if (status != fill_status::success) {
+                    return pushpending(L, status);
+                }
+            }
+            pushdata(L, s, s.rbuf.size());
+            return 1;
+        }
+        auto n = lua::checkinteger<size_t>(L, 2);
+        while (s.rbuf.size() < n) {
+            auto status = fill(s);
+            if (status == fill_status::success) {
+                continue;
+            }
+            if (status == fill_status::close && s.rbuf.size() > 0) {
+                pushdata(L, s, s.rbuf.size());
+                return 1;
+            }
+            return pushpending(L, status);
+        }
+        pushdata(L, s, n);
+        return 1;
+    }
+
+    static int checklenbytes(lua_State* L, int idx) {
+        auto lenbytes = lua::checkinteger<int>(L, idx);
+        luaL_argcheck(L, lenbytes == 1 || lenbytes == 2 || lenbytes == 4, idx, "length must be 1, 2 or 4 bytes");
+        return lenbytes;
+    }
+
+    static size_t decodelen(const char* p, int lenbytes) {
+        size_t len = 0;
+        for (int i = 0; i < lenbytes; ++i) {
+            len = (len << 8) | (uint8_t)p[i];
+        }
+        return len;
+    }
+
+    static int read_frame(lua_State* L) {
+        auto& s       = checkstream(L);
+        auto lenbytes = (size_t)checklenbytes(L, 2);
+        auto maxlen   = lua::optinteger<size_t, kMaxFrameSize>(L, 3);
+        for (;;) {
+            if (s.rbuf.size() >= lenbytes) {
+                size_t len = decodelen(s.rbuf.data(), (int)lenbytes);
+                if (len > maxlen) {
+                    return luaL_error(L, "frame too large (%I bytes)", (lua_Integer)len);
+                }
+                if (s.rbuf.size() - lenbytes >= len) {
+                    lua_pushlstring(L, s.rbuf.data() + lenbytes, len);
+                    s.rbuf.consume(lenbytes + len);
+                    s.scanned = 0;
+                    return 1;
+                }
+                if (!s.rbuf.prepare(lenbytes + len - s.rbuf.size())) {
+                    return luaL_error(L, "not enough memory");
+                }
+            }
+            auto status = fill(s);
+            if (status != fill_status::success) {
+                return pushpending(L, status);
+            }
+        }
+    }
+
+    static int write(lua_State* L) {
+        auto& s = checkstream(L);
+        int n   = lua_gettop(L);
+        for (int i = 2; i <= n; ++i) {
+            size_t len;
+            const char* str = luaL_checklstring(L, i, &len);
+            if (!s.wbuf.append(str, len)) {
+                return luaL_error(L, "not enough memory");
+            }
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int write_frame(lua_State* L) {
+        auto& s       = checkstream(L);
+        auto lenbytes = checklenbytes(L, 2);
+        size_t len;
+        const char* str = luaL_checklstring(L, 3, &len);
+        if (lenbytes < 4 && len >= ((size_t)1 << (lenbytes * 8))) {
+            return luaL_argerror(L, 3, "frame too large");
+        }
+        if (len > UINT32_MAX) {
+            return luaL_argerror(L, 3, "frame too large");
+        }
+        char* p = s.wbuf.prepare(lenbytes + len);
+        if (!p) {
+            return luaL_error(L, "not enough memory");
+        }
+        for (int i = lenbytes - 1; i >= 0; --i) {
+            p[i] = (char)(len >> ((lenbytes - 1 - i) * 8));
+        }
+        std::memcpy(p + lenbytes, str, len);
+        s.wbuf.commit(lenbytes + len);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int flush(lua_State* L) {
+        auto& s = checkstream(L);
+        while (s.wbuf.size() > 0) {
+            int rc;
+            switch (net::socket::send(*s.fd, rc, s.wbuf.data(), (int)std::min(s.wbuf.size(), (size_t)INT_MAX))) {
+            case net::socket::status::success:
+                s.wbuf.consume((size_t)rc);
+                break;
+            case net::socket::status::wait:
+                lua_pushboolean(L, 0);
+                return 1;
+            case net::socket::status::failed:
+                return lua::return_net_error(L, "send");
+            default:
+                std::unreachable();
+            }
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static void* msg_alloc(void* ud, int sz) {
+        auto& s = *(stream*)ud;
+        char* p = s.wbuf.prepare((size_t)sz);
+        if (p) {
+            s.wbuf.commit((size_t)sz);
+        }
+        return p;
+    }
+
+    // Messages are lua-seri buffers, which already start with their length
+    // as a 4 byte native-endian integer. The peer is not trusted: recv_msg
+    // only rebuilds plain data and refuses messages larger than its limit.
+    static int send_msg(lua_State* L) {
+        auto& s = checkstream(L);
+        if (!seri_packto(L, 1, msg_alloc, &s)) {
+            return luaL_error(L, "not enough memory");
+        }
+        lua_settop(L, 1);
+        return flush(L);
+    }
+
+    static int recv_msg(lua_State* L) {
+        auto& s     = checkstream(L);
+        auto maxlen = lua::optinteger<size_t, kMaxFrameSize>(L, 2);
+        for (;;) {
+            if (s.rbuf.size() >= 4) {
+                int len;
+                std::memcpy(&len, s.rbuf.data(), 4);
+                if (len < 0) {
+                    return luaL_error(L, "invalid message length %d", len);
+                }
+                if ((size_t)len > maxlen) {
+                    return luaL_error(L, "message too large (%d bytes)", len);
+                }
+                size_t total = (size_t)len + 4;
+                if (s.rbuf.size() >= total) {
+                    // consumed bytes stay in place until the next read, so
+                    // a malformed message is dropped even if unpack fails.
+                    void* data = (void*)s.rbuf.data();
+                    s.rbuf.consume(total);
+                    s.scanned = 0;
+                    lua_settop(L, 1);
+                    lua_pushboolean(L, 1);
+                    int n = seri_unpackplain(L, data);
+                    lua_remove(L, -(n + 1));
+                    return 1 + n;
+                }
+                if (!s.rbuf.prepare(total - s.rbuf.size())) {
+                    return luaL_error(L, "not enough memory");
+                }
+            }
+            auto status = fill(s);
+            if (status != fill_status::success) {
+                return pushpending(L, status);
+            }
+        }
+    }
+
+    static int pending(lua_State* L) {
+        auto& s = lua::checkudata<stream>(L, 1);
+        lua_pushinteger(L, (lua_Integer)s.wbuf.size());
+        return 1;
+    }
+
+    static int buffered(lua_State* L) {
+        auto& s = lua::checkudata<stream>(L, 1);
+        lua_pushinteger(L, (lua_Integer)s.rbuf.size());
+        return 1;
+    }
+
+    static int fd(lua_State* L) {
+        lua::checkudata<stream>(L, 1);
+        lua_getiuservalue(L, 1, 1);
+        return 1;
+    }
+
+    static void metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "readline", readline },
+            { "read", read },
+            { "read_frame", read_frame },
+            { "write", write },
+            { "write_frame", write_frame },
+            { "flush", flush },
+            { "send_msg", send_msg },
+            { "recv_msg", recv_msg },
+            { "pending", pending },
+            { "buffered", buffered },
+            { "fd", fd },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+    }
+
+    static int create(lua_State* L) {
+        auto& fd = lua_socket::checkfd(L, 1);
+        lua::newudata<stream>(L, &fd);
+        lua_pushvalue(L, 1);
+        lua_setiuservalue(L, -2, 1);
+        return 1;
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "create", create },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(stream)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_stream::stream> {
+        static inline int nupvalue   = 1;
+        static inline auto metatable = bee::lua_stream::metatable;
+    };
+}
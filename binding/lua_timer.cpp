@@ -0,0 +1,210 @@
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/utility/timer_wheel.h>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__)
+#    include <sys/timerfd.h>
+#    include <unistd.h>
+#endif
+
+namespace bee::lua_timer {
+    struct lua_timer {
+        timer_wheel wheel;
+        std::vector<timer_wheel::id_t> fired;
+#if defined(__linux__)
+        int tfd       = -1;
+        int64_t armed = 0;
+#endif
+        lua_timer(uint64_t now)
+            : wheel(now) {}
+        ~lua_timer() {
+            close();
+        }
+        void close() {
+#if defined(__linux__)
+            if (tfd != -1) {
+                ::close(tfd);
+                tfd = -1;
+            }
+#endif
+        }
+#if defined(__linux__)
+        // Arms the timerfd at the next deadline. Deadlines are absolute
+        // CLOCK_MONOTONIC milliseconds, the clock of bee.time.monotonic.
+        bool rearm() {
+            if (tfd == -1) {
+                return true;
+            }
+            int64_t next     = wheel.next();
+            int64_t deadline = next < 0 ? 0 : (int64_t)wheel.now() + next;
+            if (deadline == armed) {
+                return true;
+            }
+            struct itimerspec its = {};
+            its.it_value.tv_sec   = deadline / 1000;
+            its.it_value.tv_nsec  = (deadline % 1000) * 1000000;
+            if (::timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+                return false;
+            }
+            armed = deadline;
+            return true;
+        }
+#endif
+    };
+
+    static lua_timer& checktimer(lua_State* L) {
+        return lua::checkudata<lua_timer>(L, 1);
+    }
+
+    static int add(lua_State* L) {
+        auto& t        = checktimer(L);
+        lua_Integer ms = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, ms >= 0, 2, "timeout must be non-negative");
+        auto id = t.wheel.add((uint64_t)ms);
+#if defined(__linux__)
+        if (!t.rearm()) {
+            return lua::return_sys_error(L, "timerfd_settime");
+        }
+#endif
+        lua_pushinteger(L, (lua_Integer)id);
+        return 1;
+    }
+
+    static int cancel(lua_State* L) {
+        auto& t = checktimer(L);
+        auto id = (timer_wheel::id_t)luaL_checkinteger(L, 2);
+        lua_pushboolean(L, t.wheel.cancel(id));
+        return 1;
+    }
+
+    static int update(lua_State* L) {
+        auto& t         = checktimer(L);
+        lua_Integer now = luaL_checkinteger(L, 2);
+        if (lua_isnoneornil(L, 3)) {
+            lua_settop(L, 2);
+            lua_newtable(L);
+        } else {
+            luaL_checktype(L, 3, LUA_TTABLE);
+            lua_settop(L, 3);
+        }
+#if defined(__linux__)
+        if (t.tfd != -1) {
+            uint64_t expirations;
+            (void)!::read(t.tfd, &expirations, sizeof(expirations));
+        }
+#endif
+        t.fired.clear();
+        if (now >= 0) {
+            t.wheel.update((uint64_t)now, t.fired);
+        }
+#if defined(__linux__)
+        if (!t.rearm()) {
+            return lua::return_sys_error(L, "timerfd_settime");
+        }
+#endif
+        lua_Integer n = (lua_Integer)t.fired.size();
+        for (lua_Integer i = 0; i < n; ++i) {
+            lua_pushinteger(L, (lua_Integer)t.fired[(size_t)i]);
+            lua_rawseti(L, 3, i + 1);
+        }
+        lua_pushinteger(L, n);
+        lua_insert(L, 3);
+        return 2;
+    }
+
+    static int next(lua_State* L) {
+        auto& t = checktimer(L);
+        lua_pushinteger(L, (lua_Integer)t.wheel.next());
+        return 1;
+    }
+
+    static int now(lua_State* L) {
+        auto& t = checktimer(L);
+        lua_pushinteger(L, (lua_Integer)t.wheel.now());
+        return 1;
+    }
+
+#if defined(__linux__)
+    static int fd(lua_State* L) {
+        auto& t = checktimer(L);
+        if (t.tfd == -1) {
+            t.tfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (t.tfd == -1) {
+                return lua::return_sys_error(L, "timerfd_create");
+            }
+            t.armed = 0;
+            if (!t.rearm()) {
+                return lua::return_sys_error(L, "timerfd_settime");
+            }
+        }
+        lua_pushlightuserdata(L, (void*)(intptr_t)t.tfd);
+        return 1;
+    }
+#endif
+
+    static int close(lua_State* L) {
+        auto& t = checktimer(L);
+        t.close();
+        return 0;
+    }
+
+    static int mt_len(lua_State* L) {
+        auto& t = checktimer(L);
+        lua_pushinteger(L, (lua_Integer)t.wheel.size());
+        return 1;
+    }
+
+    static void metatable(lua_State* L) {
+        luaL_Reg lib[] = {
+            { "add", add },
+            { "cancel", cancel },
+            { "update", update },
+            { "next", next },
+            { "now", now },
+#if defined(__linux__)
+            { "fd", fd },
+#endif
+            { "close", close },
+            { NULL, NULL },
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        luaL_Reg mt[] = {
+            { "__len", mt_len },
+            { "__close", close },
+            { NULL, NULL },
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int create(lua_State* L) {
+        lua_Integer now = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, now >= 0, 1, "time must be non-negative");
+        lua::newudata<lua_timer>(L, (uint64_t)now);
+        return 1;
+    }
+
+    static int luaopen(lua_State* L) {
+        luaL_Reg l[] = {
+            { "create", create },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(timer)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_timer::lua_timer> {
+        static inline auto metatable = bee::lua_timer::metatable;
+    };
+}
@@ -0,0 +1,332 @@
+#include <bee/lua/binding.h>
+#include <bee/lua/error.h>
+#include <bee/lua/luaref.h>
+#include <bee/lua/module.h>
+#include <bee/lua/udata.h>
+#include <bee/net/endpoint.h>
+#include <bee/net/uring.h>
+#include <bee/nonstd/unreachable.h>
+#include <bee/utility/dynarray.h>
+#include <binding/lua_socket.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bee::lua_uring {
+    struct operation {
+        net::uring_op op;
+        int ref  = LUA_NOREF;
+        int next = -1;
+        std::string buf;
+        net::endpoint ep;
+    };
+
+    struct lua_uring {
+        net::uring ring;
+        luaref ref;
+        std::unique_ptr<operation[]> ops;
+        int freelist = -1;
+        int i        = 0;
+        int n        = 0;
+        dynarray<net::uring_completion> completions;
+        lua_uring(lua_State* L, size_t max_ops)
+            : ref(luaref_init(L))
+            , ops(std::make_unique<operation[]>(max_ops))
+            , completions(max_ops) {
+            for (size_t j = 0; j < max_ops; ++j) {
+                ops[j].next = (j + 1 < max_ops) ? (int)(j + 1) : -1;
+            }
+            freelist = 0;
+        }
+        ~lua_uring() {
+            close();
+            luaref_close(ref);
+        }
+        // ring.close() cancels and waits for in-flight operations, so their
+        // buffers in ops are no longer referenced by the kernel. If that
+        // wait gave up, the buffers are leaked instead.
+        bool close() {
+            if (ring.close()) {
+                return true;
+            }
+            if (ring.backend() == net::uring_backend::none) {
+                (void)ops.release();
+                freelist = -1;
+                i        = 0;
+                n        = 0;
+            }
+            return false;
+        }
+        operation* alloc(lua_State* L, net::uring_op op, int token) {
+            if (freelist < 0) {
+                return nullptr;
+            }
+            lua_pushvalue(L, token);
+            int r = luaref_ref(ref, L);
+            if (r == LUA_NOREF) {
+                return nullptr;
+            }
+            auto& o  = ops[freelist];
+            freelist = o.next;
+            o.op     = op;
+            o.ref    = r;
+            return &o;
+        }
+        void free(operation& o) {
+            luaref_unref(ref, o.ref);
+            o.ref = LUA_NOREF;
+            o.buf.clear();
+            o.buf.shrink_to_fit();
+            o.next   = freelist;
+            freelist = (int)(&o - ops.get());
+        }
+        uint64_t id(const operation& o) const {
+            return (uint64_t)(&o - ops.get());
+        }
+    };
+
+    static net::fd_t ur_tofd(lua_State* L, int idx) {
+        switch (lua_type(L, idx)) {
+        case LUA_TLIGHTUSERDATA:
+            return lua::tolightud<net::fd_t>(L, idx);
+        case LUA_TUSERDATA:
+            return lua::toudata<net::fd_t>(L, idx);
+        default:
+            luaL_checktype(L, idx, LUA_TUSERDATA);
+            std::unreachable();
+        }
+    }
+
+    static lua_uring& ur_check(lua_State* L) {
+        auto& ur = lua::checkudata<lua_uring>(L, 1);
+        if (ur.ring.backend() == net::uring_backend::none) {
+            luaL_error(L, "uring is closed.");
+        }
+        return ur;
+    }
+
+    static int ur_submit(lua_State* L, lua_uring& ur, operation& o, net::fd_t fd, size_t len) {
+        net::uring_request req;
+        req.op   = o.op;
+        req.fd   = fd;
+        req.buf  = o.buf.data();
+        req.len  = len;
+        req.ep   = &o.ep;
+        req.data = ur.id(o);
+        if (!ur.ring.submit(req)) {
+            ur.free(o);
+            return lua::return_error(L, "Submission queue is full.");
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int token_index(lua_State* L, int idx) {
+        return lua_isnoneornil(L, idx) ? 2 : idx;
+    }
+
+    static int ur_recv(lua_State* L) {
+        auto& ur     = ur_check(L);
+        net::fd_t fd = ur_tofd(L, 2);
+        auto len     = lua::optinteger<int, LUAL_BUFFERSIZE>(L, 3);
+        luaL_argcheck(L, len > 0, 3, "length must be positive");
+        auto o = ur.alloc(L, net::uring_op::recv, token_index(L, 4));
+        if (!o) {
+            return lua::return_error(L, "Too many operations.");
+        }
+        o->buf.resize((size_t)len);
+        return ur_submit(L, ur, *o, fd, (size_t)len);
+    }
+
+    static int ur_send(lua_State* L) {
+        auto& ur     = ur_check(L);
+        net::fd_t fd = ur_tofd(L, 2);
+        auto data    = lua::checkstrview(L, 3);
+        auto o       = ur.alloc(L, net::uring_op::send, token_index(L, 4));
+        if (!o) {
+            return lua::return_error(L, "Too many operations.");
+        }
+        o->buf.assign(data.data(), data.size());
+        return ur_submit(L, ur, *o, fd, data.size());
+    }
+
+    static int ur_accept(lua_State* L) {
+        auto& ur     = ur_check(L);
+        net::fd_t fd = ur_tofd(L, 2);
+        auto o       = ur.alloc(L, net::uring_op::accept, token_index(L, 3));
+        if (!o) {
+            return lua::return_error(L, "Too many operations.");
+        }
+        return ur_submit(L, ur, *o, fd, 0);
+    }
+
+    static int ur_connect(lua_State* L) {
+        auto& ur       = ur_check(L);
+        net::fd_t fd   = ur_tofd(L, 2);
+        const auto& ep = lua::checkudata<net::endpoint>(L, 3);
+        auto o         = ur.alloc(L, net::uring_op::connect, token_index(L, 4));
+        if (!o) {
+            return lua::return_error(L, "Too many operations.");
+        }
+        o->ep = ep;
+        return ur_submit(L, ur, *o, fd, 0);
+    }
+
+    static const char* opname(net::uring_op op) {
+        switch (op) {
+        case net::uring_op::recv:
+            return "recv";
+        case net::uring_op::send:
+            return "send";
+        case net::uring_op::accept:
+            return "accept";
+        case net::uring_op::connect:
+            return "connect";
+        default:
+            std::unreachable();
+        }
+    }
+
+    static int ur_completions(lua_State* L) {
+        auto& ur = *(lua_uring*)lua_touserdata(L, lua_upvalueindex(1));
+        if (ur.i >= ur.n) {
+            return 0;
+        }
+        const auto& c = ur.completions[ur.i++];
+        auto& o       = ur.ops[c.data];
+        luaref_get(ur.ref, L, o.ref);
+        int nresults = 2;
+        if (c.res < 0) {
+            nresults = 1 + lua::return_net_error(L, opname(o.op), (int)-c.res);
+        } else {
+            switch (o.op) {
+            case net::uring_op::recv:
+                if (c.res == 0) {
+                    lua_pushnil(L);
+                } else {
+                    lua_pushlstring(L, o.buf.data(), (size_t)c.res);
+                }
+                break;
+            case net::uring_op::send:
+                lua_pushinteger(L, (lua_Integer)c.res);
+                break;
+            case net::uring_op::accept:
+                lua_socket::pushfd(L, (net::fd_t)c.res);
+                break;
+            case net::uring_op::connect:
+                lua_pushboolean(L, 1);
+                break;
+            default:
+                std::unreachable();
+            }
+        }
+        ur.free(o);
+        return nresults;
+    }
+
+    static int ur_wait(lua_State* L) {
+        auto& ur    = ur_check(L);
+        int timeout = lua::optinteger<int, -1>(L, 2);
+        if (ur.i < ur.n) {
+            // deliver the remaining completions before waiting again.
+            lua_getiuservalue(L, 1, 1);
+            return 1;
+        }
+        int n = ur.ring.wait(ur.completions, timeout);
+        if (n == -1) {
+            return lua::return_net_error(L, "uring_wait");
+        }
+        ur.i = 0;
+        ur.n = n;
+        lua_getiuservalue(L, 1, 1);
+        return 1;
+    }
+
+    static int ur_backend(lua_State* L) {
+        auto& ur = lua::checkudata<lua_uring>(L, 1);
+        switch (ur.ring.backend()) {
+        case net::uring_backend::io_uring:
+            lua_pushstring(L, "io_uring");
+            return 1;
+        case net::uring_backend::bpoll:
+            lua_pushstring(L, "epoll");
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    static int ur_close(lua_State* L) {
+        auto& ur = lua::checkudata<lua_uring>(L, 1);
+        if (!ur.close()) {
+            return lua::return_net_error(L, "uring_close");
+        }
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int ur_mt_close(lua_State* L) {
+        auto& ur = lua::checkudata<lua_uring>(L, 1);
+        ur.close();
+        return 0;
+    }
+
+    static void metatable(lua_State* L) {
+        static luaL_Reg lib[] = {
+            { "recv", ur_recv },
+            { "send", ur_send },
+            { "accept", ur_accept },
+            { "connect", ur_connect },
+            { "wait", ur_wait },
+            { "backend", ur_backend },
+            { "close", ur_close },
+            { NULL, NULL }
+        };
+        luaL_newlibtable(L, lib);
+        luaL_setfuncs(L, lib, 0);
+        lua_setfield(L, -2, "__index");
+        static luaL_Reg mt[] = {
+            { "__close", ur_mt_close },
+            { NULL, NULL }
+        };
+        luaL_setfuncs(L, mt, 0);
+    }
+
+    static int ur_create(lua_State* L) {
+        lua_Integer max_ops = luaL_checkinteger(L, 1);
+        if (max_ops <= 0) {
+            return lua::return_error(L, "entries is less than or equal to zero.");
+        }
+        static const char* const opts[] = { "io_uring", "epoll", NULL };
+        auto prefer                     = luaL_checkoption(L, 2, "io_uring", opts) == 0 ? net::uring_backend::io_uring : net::uring_backend::bpoll;
+        auto& ur                        = lua::newudata<lua_uring>(L, L, (size_t)max_ops);
+        if (!ur.ring.open((unsigned)std::min<lua_Integer>(max_ops, UINT32_MAX), prefer)) {
+            return lua::return_net_error(L, "uring_create");
+        }
+        lua_pushvalue(L, -1);
+        lua_pushcclosure(L, ur_completions, 1);
+        lua_setiuservalue(L, -2, 1);
+        return 1;
+    }
+
+    static int luaopen(lua_State* L) {
+        struct luaL_Reg l[] = {
+            { "create", ur_create },
+            { NULL, NULL },
+        };
+        luaL_newlib(L, l);
+        return 1;
+    }
+}
+
+DEFINE_LUAOPEN(uring)
+
+namespace bee::lua {
+    template <>
+    struct udata<lua_uring::lua_uring> {
+        static inline int nupvalue   = 1;
+        static inline auto metatable = bee::lua_uring::metatable;
+    };
+}
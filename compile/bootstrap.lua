@@ -86,3 +86,25 @@ if not lm.notest then
         outputs = "$obj/test.stamp",
     }
 end
+
+if lm.bench then
+    local exe = lm.os == "windows" and ".exe" or ""
+    local benches = {
+        { "bench", "bench_serialization.lua", "Run benchmark." },
+        { "bench_udp", "bench_udp.lua", "Run UDP benchmark." },
+        { "bench_echo", "bench_echo.lua", "Run echo benchmark." },
+    }
+    for _, b in ipairs(benches) do
+        local name, script, description = b[1], b[2], b[3]
+        lm:rule(name) {
+            args = { "$bin/bootstrap"..exe, "@bench/"..script },
+            description = description,
+            pool = "console",
+        }
+        lm:build(name) {
+            rule = name,
+            deps = { "bootstrap", "copy_script" },
+            outputs = "$obj/"..name..".stamp",
+        }
+    end
+end
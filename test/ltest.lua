@@ -1063,6 +1063,19 @@ function m.skip(name)
     setMark(name, _SKIP_)
 end
 
+-- Pins math.random to a fixed sequence until the returned value, meant for
+-- a <close> local, goes out of scope. It then reseeds from the stream it
+-- interrupted, so the shuffle and later tests do not inherit the seed.
+function m.randomseed(seed)
+    local a, b = math.random(0), math.random(0)
+    math.randomseed(seed)
+    return setmetatable({}, {
+        __close = function()
+            math.randomseed(a, b)
+        end,
+    })
+end
+
 function m.moduleCoverage(name)
     if not coverage then
         return
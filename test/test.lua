@@ -38,10 +38,17 @@ require "test_filesystem"
 require "test_thread"
 require "test_subprocess"
 require "test_socket"
+require "test_buffer"
+require "test_stream"
+require "test_resolver"
 require "test_epoll"
+require "test_uring"
 require "test_filewatch"
 require "test_time"
+require "test_timer"
 require "test_channel"
+require "test_reactor"
+require "test_async"
 require "test_sys"
 
 do
@@ -0,0 +1,136 @@
+local lt = require "ltest"
+local async = require "bee.async"
+local socket = require "bee.socket"
+local channel = require "bee.channel"
+local thread = require "bee.thread"
+local m = lt.test "async"
+
+function m.test_spawn()
+    local s = async.create()
+    local log = {}
+    s:spawn(function (a, b)
+        log[#log + 1] = a
+        async.yield()
+        log[#log + 1] = b
+    end, 1, 3)
+    s:spawn(function ()
+        log[#log + 1] = 2
+        coroutine.yield()
+        log[#log + 1] = 4
+    end)
+    lt.assertEquals(s:size(), 2)
+    lt.assertEquals(s:run(), 0)
+    lt.assertEquals(log, { 1, 2, 3, 4 })
+    lt.assertError(async.yield)
+    lt.assertError(async.sleep, 0)
+end
+
+function m.test_sleep()
+    local s = async.create()
+    local log = {}
+    for _, ms in ipairs { 30, 10, 20 } do
+        s:spawn(function ()
+            async.sleep(ms)
+            log[#log + 1] = ms
+        end)
+    end
+    s:run()
+    lt.assertEquals(log, { 10, 20, 30 })
+end
+
+function m.test_read_write()
+    local s = async.create()
+    local a, b = assert(socket.pair())
+    local big = ("x"):rep(1024 * 1024)
+    local received = {}
+    s:spawn(function ()
+        while true do
+            local data = async.read(b, 65536)
+            if not data then
+                break
+            end
+            received[#received + 1] = data
+        end
+        b:close()
+    end)
+    s:spawn(function ()
+        lt.assertEquals(async.write(a, big), true)
+        a:close()
+    end)
+    lt.assertEquals(s:run(), 0)
+    lt.assertEquals(#table.concat(received), #big)
+end
+
+function m.test_accept_connect()
+    local s = async.create()
+    local server = assert(socket.create "tcp")
+    assert(server:bind("127.0.0.1", 0))
+    assert(server:listen())
+    local _, port = server:info "socket":value()
+    local reply
+    s:spawn(function ()
+        local fd = assert(async.accept(server))
+        local req = async.read(fd)
+        async.write(fd, req:upper())
+        fd:close()
+    end)
+    s:spawn(function ()
+        local fd = assert(socket.create "tcp")
+        lt.assertEquals(async.connect(fd, "127.0.0.1", port), true)
+        async.write(fd, "ping")
+        reply = async.read(fd)
+        lt.assertEquals(async.read(fd), nil)
+        fd:close()
+    end)
+    s:run()
+    server:close()
+    lt.assertEquals(reply, "PING")
+end
+
+function m.test_pop()
+    local s = async.create()
+    local chan = channel.create "async_pop"
+    local got
+    s:spawn(function ()
+        got = table.pack(async.pop(chan))
+    end)
+    local th = thread.create [[
+        require "bee.thread".sleep(20)
+        require "bee.channel".query "async_pop":push(1, "two")
+    ]]
+    s:run()
+    thread.wait(th)
+    channel.destroy "async_pop"
+    lt.assertEquals(got.n, 2)
+    lt.assertEquals(got[1], 1)
+    lt.assertEquals(got[2], "two")
+end
+
+function m.test_stop_and_error()
+    local s = async.create()
+    s:spawn(function ()
+        s:stop()
+        async.yield()
+        error "oops"
+    end)
+    lt.assertEquals(s:run(), 1)
+    local ok, err = pcall(s.run, s)
+    lt.assertEquals(ok, false)
+    lt.assertEquals(err:match "oops" ~= nil, true)
+    lt.assertEquals(s:size(), 0)
+end
+
+function m.test_busy()
+    local s = async.create()
+    local a, b = assert(socket.pair())
+    s:spawn(function ()
+        async.read(b)
+    end)
+    s:spawn(function ()
+        lt.assertError(async.read, b)
+        a:send "x"
+    end)
+    s:run()
+    a:close()
+    b:close()
+end
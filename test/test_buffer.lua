@@ -0,0 +1,103 @@
+local lt = require "ltest"
+local buffer = require "bee.buffer"
+local socket = require "bee.socket"
+local m = lt.test "buffer"
+
+function m.test_write_read()
+    local buf = buffer.create()
+    lt.assertEquals(#buf, 0)
+    lt.assertEquals(buf:read(), "")
+    buf:write("hello", " ", "world")
+    lt.assertEquals(#buf, 11)
+    lt.assertEquals(buf:peek(5), "hello")
+    lt.assertEquals(#buf, 11)
+    lt.assertEquals(buf:read(6), "hello ")
+    lt.assertEquals(buf:read(100), "world")
+    lt.assertEquals(#buf, 0)
+    lt.assertError(buf.read, buf, -1)
+    lt.assertError(buf.write, buf, {})
+end
+
+function m.test_consume()
+    local buf = buffer.create(16)
+    lt.assertEquals(buf:capacity() >= 16, true)
+    buf:write "0123456789"
+    lt.assertEquals(buf:consume(4), 4)
+    lt.assertEquals(buf:peek(), "456789")
+    lt.assertEquals(buf:consume(100), 6)
+    lt.assertEquals(#buf, 0)
+    buf:write "abc"
+    buf:clear()
+    lt.assertEquals(#buf, 0)
+    lt.assertEquals(buf:peek(), "")
+end
+
+function m.test_find()
+    local buf = buffer.create()
+    buf:write "GET / HTTP/1.1\r\nHost: x\r\n\r\nbody"
+    lt.assertEquals({ buf:find "\r\n" }, { 15, 16 })
+    lt.assertEquals({ buf:find("\r\n", 17) }, { 24, 25 })
+    lt.assertEquals({ buf:find "\r\n\r\n" }, { 24, 27 })
+    lt.assertEquals(buf:find "\n\n", nil)
+    lt.assertEquals({ buf:find "" }, { 1, 0 })
+    lt.assertEquals(buf:find("body", 100), nil)
+    buf:consume(16)
+    lt.assertEquals({ buf:find "Host" }, { 1, 4 })
+    lt.assertEquals({ buf:find "y" }, { 15, 15 })
+    lt.assertError(buf.find, buf, "x", 0)
+end
+
+function m.test_grow()
+    local buf = buffer.create(8)
+    local expected = {}
+    for i = 1, 1000 do
+        local s = tostring(i) .. ","
+        buf:write(s)
+        expected[#expected + 1] = s
+        if i % 7 == 0 then
+            local n = #expected[1]
+            lt.assertEquals(buf:read(n), table.remove(expected, 1))
+        end
+    end
+    lt.assertEquals(buf:read(), table.concat(expected))
+    buf:reserve(4096)
+    lt.assertEquals(buf:capacity() >= 4096, true)
+end
+
+function m.test_socket()
+    local a, b = assert(socket.pair())
+    local rbuf = buffer.create()
+    local wbuf = buffer.create()
+    lt.assertEquals(a:recv_into(rbuf), false)
+    lt.assertEquals(b:send_from(wbuf), 0)
+
+    wbuf:write "line1\nline2\n"
+    lt.assertEquals(b:send_from(wbuf, 6), 6)
+    lt.assertEquals(#wbuf, 6)
+    lt.assertEquals(b:send_from(wbuf), 6)
+    lt.assertEquals(#wbuf, 0)
+
+    local n = 0
+    while n < 12 do
+        local r = a:recv_into(rbuf, 4)
+        if r then
+            lt.assertEquals(r <= 4, true)
+            n = n + r
+        end
+    end
+    local e = rbuf:find "\n"
+    lt.assertEquals(rbuf:read(e), "line1\n")
+    lt.assertEquals(rbuf:peek(), "line2\n")
+
+    b:close()
+    while true do
+        local r = a:recv_into(rbuf)
+        if r == nil then
+            break
+        end
+        lt.assertEquals(r, false)
+    end
+    lt.assertEquals(rbuf:read(), "line2\n")
+    a:close()
+    lt.assertError(a.recv_into, a, rbuf)
+end
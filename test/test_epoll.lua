@@ -91,6 +91,73 @@ function m.test_wait()
     end
 end
 
+function m.test_wait_into()
+    do
+        local epfd = epoll.create(16)
+        epfd:close()
+        lt.assertIsNil(epfd:wait_into({}, {}))
+    end
+    local epfd <close> = epoll.create(16)
+    local objs, masks = {}, {}
+    lt.assertEquals(epfd:wait_into(objs, masks, 0), 0)
+    lt.assertEquals(objs, {})
+    local fds = {}
+    for i = 1, 8 do
+        local sfd <close> = SimpleServer("tcp", "127.0.0.1", 0)
+        local cfd = SimpleClient("tcp", sfd:info "socket")
+        fds[i] = cfd
+        epfd:event_add(cfd, epoll.EPOLLOUT, "client"..i)
+    end
+    local n = 0
+    local start = time.monotonic()
+    while n < 8 and time.monotonic() - start < 1000 do
+        n = epfd:wait_into(objs, masks, 1)
+    end
+    lt.assertEquals(n, 8)
+    local found = {}
+    for i = 1, n do
+        lt.assertEquals(masks[i] & epoll.EPOLLOUT, epoll.EPOLLOUT)
+        found[objs[i]] = true
+    end
+    for i = 1, 8 do
+        lt.assertEquals(found["client"..i], true)
+    end
+    for i = 1, 8 do
+        epfd:event_del(fds[i])
+        fds[i]:close()
+    end
+    lt.assertEquals(epfd:wait_into(objs, masks, 0), 0)
+    lt.assertEquals(#objs, 8)
+end
+
+function m.test_event_churn()
+    local epfd <close> = epoll.create(16)
+    for i = 1, 100 do
+        local cfd, peer = socket.pair()
+        lt.assertEquals(epfd:event_add(cfd, epoll.EPOLLOUT, i), true)
+        if i % 2 == 0 then
+            lt.assertEquals(epfd:event_del(cfd), true)
+        end
+        cfd:close()
+        peer:close()
+    end
+    local cfd <close>, peer = socket.pair()
+    local _ <close> = peer
+    lt.assertEquals(epfd:event_add(cfd, epoll.EPOLLOUT, "last"), true)
+    local start = time.monotonic()
+    local found
+    while not found and time.monotonic() - start < 1000 do
+        for token in epfd:wait(1) do
+            lt.assertEquals(token, "last")
+            found = true
+        end
+    end
+    lt.assertEquals(found, true)
+    lt.assertEquals(epfd:event_mod(cfd, epoll.EPOLLIN, "mod"), true)
+    lt.assertEquals(epfd:event_del(cfd), true)
+    lt.assertIsNil(epfd:event_mod(cfd, epoll.EPOLLIN))
+end
+
 local events = {
     "EPOLLIN",
     "EPOLLPRI",
@@ -464,3 +531,91 @@ function m.test_pingpong()
     end
     epfd:close()
 end
+
+function m.test_waker()
+    local epfd <close> = epoll.create(16)
+    local waker = epfd:waker()
+    lt.assertEquals(epfd:waker(), waker)
+    for _ in epfd:wait(0) do
+        lt.assertEquals(true, false)
+    end
+    waker:notify()
+    waker:notify()
+    local n = 0
+    for obj in epfd:wait(0) do
+        lt.assertEquals(obj, waker)
+        n = n + 1
+    end
+    lt.assertEquals(n, 1)
+    for _ in epfd:wait(0) do
+        lt.assertEquals(true, false)
+    end
+    waker:notify()
+    local objs, evs = {}, {}
+    lt.assertEquals(epfd:wait_into(objs, evs, 0), 1)
+    lt.assertEquals(objs[1], waker)
+    lt.assertEquals(epfd:wait_into(objs, evs, 0), 0)
+end
+
+function m.test_waker_thread()
+    local thread = require "bee.thread"
+    local epfd <close> = epoll.create(16)
+    local waker = epfd:waker()
+    local thd = thread.create([[
+        local waker = ...
+        local thread = require "bee.thread"
+        thread.sleep(10)
+        waker:notify()
+    ]], waker)
+    local start = time.monotonic()
+    local woke = false
+    for obj in epfd:wait(5000) do
+        lt.assertEquals(obj, waker)
+        woke = true
+    end
+    thread.wait(thd)
+    lt.assertEquals(woke, true)
+    lt.assertEquals(time.monotonic() - start < 5000, true)
+end
+
+function m.test_waker_outlives_epoll()
+    local thread = require "bee.thread"
+    local epfd = epoll.create(16)
+    local waker = epfd:waker()
+    local thd = thread.create([[
+        local waker = ...
+        waker:notify()
+    ]], waker)
+    epfd:close()
+    epfd = nil
+    collectgarbage()
+    thread.wait(thd)
+    waker:notify()
+end
+
+function m.test_waker_seri()
+    local seri = require "bee.serialization"
+    local function notify_twice()
+        local epfd <close> = epoll.create(16)
+        local buf = seri.packstring(epfd:waker())
+        local a = seri.unpack(buf)
+        local b = seri.unpack(buf)
+        lt.assertEquals(a ~= b, true)
+        collectgarbage()
+        a:notify()
+        a = nil
+        collectgarbage()
+        b:notify()
+        local n = 0
+        for _ in epfd:wait(0) do
+            n = n + 1
+        end
+        lt.assertEquals(n, 1)
+        return buf
+    end
+    local buf = notify_twice()
+    -- the epoll's own handle is only dropped once the epoll is collected.
+    collectgarbage()
+    collectgarbage()
+    lt.assertErrorMsgEquals("waker is already closed.", seri.unpack, buf)
+end
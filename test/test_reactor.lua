@@ -0,0 +1,229 @@
+local lt = require "ltest"
+local reactor = require "bee.reactor"
+local channel = require "bee.channel"
+local socket = require "bee.socket"
+local epoll = require "bee.epoll"
+local m = lt.test "reactor"
+
+local function assertNoError(rt)
+    lt.assertEquals(rt:errlog(), nil)
+end
+
+local function pop(chan)
+    local ep <close> = epoll.create(4)
+    ep:event_add(chan:fd(), epoll.EPOLLIN)
+    for _ = 1, 500 do
+        local r = table.pack(chan:pop())
+        if r[1] then
+            return table.unpack(r, 2, r.n)
+        end
+        for _ in ep:wait(10) do
+        end
+    end
+    error "timeout"
+end
+
+function m.test_post()
+    local chan = channel.create "reactor_post"
+    local rt = reactor.start(3, [[
+        local ctx, tag = ...
+        local chan = require "bee.channel".query "reactor_post"
+        ctx:on_post(function (cmd, a, b)
+            if cmd == "add" then
+                chan:push(ctx:id(), tag, a + b)
+            elseif cmd == "relay" then
+                ctx:post(a, "add", b, ctx:id())
+            end
+        end)
+    ]], "tag")
+    lt.assertEquals(rt:size(), 3)
+    rt:post(2, "add", 1, 2)
+    lt.assertEquals({ pop(chan) }, { 2, "tag", 3 })
+    rt:post(1, "relay", 3, 10)
+    lt.assertEquals({ pop(chan) }, { 3, "tag", 11 })
+    lt.assertError(rt.post, rt, 4, "add")
+    rt:stop()
+    rt:wait()
+    assertNoError(rt)
+    channel.destroy "reactor_post"
+end
+
+function m.test_timer()
+    local chan = channel.create "reactor_timer"
+    local rt = reactor.start(1, [[
+        local ctx = ...
+        local time = require "bee.time"
+        local chan = require "bee.channel".query "reactor_timer"
+        local start = time.monotonic()
+        local order = {}
+        ctx:timeout(30, function ()
+            order[#order + 1] = 30
+            chan:push(order, time.monotonic() - start >= 25)
+        end)
+        ctx:timeout(10, function ()
+            order[#order + 1] = 10
+        end)
+        local id = ctx:timeout(20, function ()
+            order[#order + 1] = 20
+        end)
+        assert(ctx:cancel(id) == true)
+        assert(ctx:cancel(id) == false)
+    ]])
+    local order, late = pop(chan)
+    lt.assertEquals(order, { 10, 30 })
+    lt.assertEquals(late, true)
+    rt:stop()
+    rt:wait()
+    assertNoError(rt)
+    channel.destroy "reactor_timer"
+end
+
+local echo = [[
+    local ctx, listener, mode = ...
+    local chan = require "bee.channel".query "reactor_echo"
+    local epoll = require "bee.epoll"
+    ctx:on_accept(function (fd)
+        ctx:add(fd, epoll.EPOLLIN, function ()
+            local data = fd:recv()
+            if data then
+                fd:send(ctx:id() .. ":" .. data)
+            elseif data == nil then
+                ctx:del(fd)
+                fd:close()
+            end
+        end)
+    end)
+    ctx:on_post(function (l)
+        ctx:accept(l, mode)
+    end)
+    if listener and ctx:id() == 1 then
+        ctx:accept(listener, mode)
+    end
+]]
+
+local function connect_clients(port, count)
+    local ids = {}
+    local clients = {}
+    for i = 1, count do
+        local c = assert(socket.create "tcp")
+        c:connect("127.0.0.1", port)
+        clients[i] = c
+    end
+    local ep <close> = epoll.create(count)
+    for i, c in ipairs(clients) do
+        ep:event_add(c, epoll.EPOLLOUT, i)
+    end
+    local sent = 0
+    while sent < count do
+        for i in ep:wait(1000) do
+            assert(clients[i]:send("ping") == 4)
+            ep:event_mod(clients[i], epoll.EPOLLIN)
+            sent = sent + 1
+        end
+    end
+    local received = 0
+    while received < count do
+        for i in ep:wait(1000) do
+            local data = clients[i]:recv()
+            if data then
+                local id = assert(data:match "^(%d+):ping$")
+                ids[tonumber(id)] = (ids[tonumber(id)] or 0) + 1
+                ep:event_del(clients[i])
+                received = received + 1
+            end
+        end
+    end
+    for _, c in ipairs(clients) do
+        c:close()
+    end
+    return ids
+end
+
+function m.test_roundrobin()
+    local chan = channel.create "reactor_echo"
+    local listener = assert(socket.create "tcp")
+    assert(listener:bind("127.0.0.1", 0))
+    assert(listener:listen(64))
+    local _, port = listener:info "socket":value()
+    local rt = reactor.start(2, echo, listener, "roundrobin")
+    listener:close()
+    local ids = connect_clients(port, 8)
+    lt.assertEquals(ids, { 4, 4 })
+    rt:stop()
+    rt:wait()
+    assertNoError(rt)
+    channel.destroy "reactor_echo"
+end
+
+if socket.listen_shards and require "bee.platform".os ~= "windows" then
+    function m.test_reuseport()
+        local chan = channel.create "reactor_echo"
+        local shards = assert(socket.listen_shards("tcp", 2, "127.0.0.1", 0))
+        local _, port = shards[1]:info "socket":value()
+        local rt = reactor.start(2, echo)
+        for i, fd in ipairs(shards) do
+            rt:post(i, fd)
+            fd:close()
+        end
+        local ids = connect_clients(port, 32)
+        lt.assertEquals((ids[1] or 0) + (ids[2] or 0), 32)
+        rt:stop()
+        rt:wait()
+        assertNoError(rt)
+        channel.destroy "reactor_echo"
+    end
+end
+
+function m.test_stale_event()
+    local chan = channel.create "reactor_stale"
+    local rt = reactor.start(1, [[
+        local ctx = ...
+        local socket = require "bee.socket"
+        local epoll = require "bee.epoll"
+        local chan = require "bee.channel".query "reactor_stale"
+        local a1, b1 = assert(socket.pair())
+        local a2, b2 = assert(socket.pair())
+        local a3 = assert(socket.pair())
+        assert(b1:send "x" == 1)
+        assert(b2:send "x" == 1)
+        local log = {}
+        local function on(name, fd, other)
+            return function ()
+                log[#log + 1] = name
+                fd:recv()
+                if #log == 1 then
+                    -- both fds are ready in this batch: drop the other one
+                    -- and hand its ref to an fd that never becomes ready.
+                    ctx:del(other)
+                    ctx:add(a3, epoll.EPOLLIN, function ()
+                        log[#log + 1] = "3"
+                    end)
+                end
+            end
+        end
+        ctx:add(a1, epoll.EPOLLIN, on("1", a1, a2))
+        ctx:add(a2, epoll.EPOLLIN, on("2", a2, a1))
+        ctx:timeout(50, function ()
+            chan:push(log)
+        end)
+    ]])
+    local log = pop(chan)
+    lt.assertEquals(#log, 1)
+    rt:stop()
+    rt:wait()
+    assertNoError(rt)
+    channel.destroy "reactor_stale"
+end
+
+function m.test_error()
+    local rt = reactor.start(1, [[
+        local ctx = ...
+        ctx:timeout(0, function ()
+            error "oops"
+        end)
+    ]])
+    rt:wait()
+    local msg = rt:errlog()
+    lt.assertEquals(msg:match "oops" ~= nil, true)
+    lt.assertEquals(rt:errlog(), nil)
+end
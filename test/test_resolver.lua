@@ -0,0 +1,88 @@
+local lt = require "ltest"
+local resolver = require "bee.resolver"
+local epoll = require "bee.epoll"
+local m = lt.test "resolver"
+
+local function wait_results(r, count)
+    local ep <close> = assert(epoll.create(4))
+    assert(ep:event_add(r:fd(), epoll.EPOLLIN, r))
+    local res = {}
+    local n = 0
+    while n < count do
+        for obj in ep:wait(5000) do
+            lt.assertEquals(obj, r)
+            for token, endpoint, err in r:results() do
+                res[token] = endpoint or err
+                n = n + 1
+            end
+        end
+    end
+    return res
+end
+
+function m.test_resolve()
+    resolver.flush()
+    lt.assertEquals(resolver.lookup("localhost", 80), nil)
+    local r <close> = assert(resolver.create(2))
+    assert(r:resolve("localhost", 80))
+    assert(r:resolve("localhost", 81, "other"))
+    -- numeric, so it fails without asking a name server.
+    assert(r:resolve("1.2.3.4.5", 80))
+    local res = wait_results(r, 3)
+    lt.assertEquals(type(res.localhost), "userdata")
+    local addr, port = res.localhost:value()
+    lt.assertEquals(port, 80)
+    local _, port2 = res.other:value()
+    lt.assertEquals(port2, 81)
+    lt.assertEquals(type(res["1.2.3.4.5"]), "string")
+    local cached = resolver.lookup("localhost", 8080)
+    lt.assertEquals(cached ~= nil, true)
+    local caddr, cport = cached:value()
+    lt.assertEquals(caddr, addr)
+    lt.assertEquals(cport, 8080)
+    lt.assertEquals(resolver.lookup("1.2.3.4.5", 80), nil)
+end
+
+function m.test_cache_hit()
+    resolver.flush()
+    local r <close> = assert(resolver.create(1))
+    assert(r:resolve("localhost", 80))
+    wait_results(r, 1)
+    assert(r:resolve("localhost", 90, 1))
+    local token, ep = r:results()(r)
+    lt.assertEquals(token, 1)
+    local _, port = ep:value()
+    lt.assertEquals(port, 90)
+end
+
+function m.test_ttl()
+    local old = resolver.ttl()
+    lt.assertEquals(old > 0, true)
+    local r <close> = assert(resolver.create(1))
+    assert(r:resolve("localhost", 80))
+    wait_results(r, 1)
+    lt.assertEquals(resolver.lookup("localhost", 80) ~= nil, true)
+    lt.assertEquals(resolver.ttl(0), 0)
+    lt.assertEquals(resolver.lookup("localhost", 80), nil)
+    assert(r:resolve("localhost", 80))
+    wait_results(r, 1)
+    lt.assertEquals(resolver.lookup("localhost", 80), nil)
+    lt.assertEquals(resolver.ttl(old), old)
+end
+
+function m.test_close()
+    local r = assert(resolver.create(1))
+    r:close()
+    lt.assertEquals(r:resolve("localhost", 80), nil)
+end
+
+function m.test_close_pending()
+    -- Workers still inside a lookup outlive the resolver that queued it.
+    for _ = 1, 8 do
+        resolver.flush()
+        local r <close> = assert(resolver.create(2))
+        assert(r:resolve("localhost", 80))
+        assert(r:resolve("1.2.3.4.5", 80))
+    end
+    collectgarbage()
+end
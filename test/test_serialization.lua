@@ -45,6 +45,17 @@ end
 
 function test_seri:test_err_3()
     TestErr("Unsupport type userdata to serialize", io.stdout)
+    -- __deseri must be a C function registered with seri_register.
+    local f <close> = io.tmpfile()
+    local mt = getmetatable(f)
+    debug.setmetatable(f, {
+        __seri = function () return 1 end,
+        __deseri = function () end,
+    })
+    TestErr("Unsupport type userdata to serialize", f)
+    debug.setmetatable(f, { __seri = function () return 1 end, __deseri = os.clock })
+    TestErr("Unsupport type userdata to serialize", f)
+    debug.setmetatable(f, mt)
 end
 
 function test_seri:test_ref()
@@ -65,3 +76,298 @@ function test_seri:test_ref()
         end
     end
 end
+
+function test_seri:test_number_array()
+    local function array(n, f)
+        local t = {}
+        for i = 1, n do
+            t[i] = f(i)
+        end
+        return t
+    end
+    TestEq(array(100, function (i) return i end))
+    TestEq(array(100, function (i) return i * 1000 end))
+    TestEq(array(100, function (i) return -i end))
+    TestEq(array(100, function (i) return i * 0x100000000 end))
+    TestEq(array(100, function (i) return math.mininteger + i end))
+    TestEq(array(100, function (i) return i / 3 end))
+    TestEq(array(100, function (i) return i % 2 == 0 and i or i + 0.5 end))
+    TestEq(array(100, function (i) return i % 2 == 0 and i or tostring(i) end))
+    TestEq(array(7, function (i) return i end))
+    local t = array(100, function (i) return i end)
+    t.n = 100
+    TestEq(t)
+    TestEq({ array(8, function (i) return i end), array(8, function (i) return i + 0.5 end) })
+    local newt = seri.unpack(seri.pack(array(100, function (i) return i + 0.0 end)))
+    for i = 1, 100 do
+        lt.assertEquals(math.type(newt[i]), "float")
+    end
+end
+
+function test_seri:test_hash_size()
+    local t = {}
+    for i = 1, 200 do
+        local v = { i, tostring(i) }
+        for j = 1, i % 7 do
+            v["k"..j] = j
+        end
+        t[i] = v
+    end
+    t.a = 1
+    t[0] = 0
+    t[-1] = -1
+    t[1.5] = 1.5
+    TestEq(t)
+    local d = {}
+    for i = 1, 10000 do
+        d["key"..i] = i
+    end
+    TestEq(d)
+end
+
+function test_seri:test_view()
+    local data = {
+        name = "bee",
+        n = 1,
+        x = 0.5,
+        [1.5] = "float",
+        [true] = "true",
+        list = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 },
+        mixed = { "a", { b = "b" }, false },
+        nested = { a = { b = { c = "d" } } },
+        "first",
+        "second",
+    }
+    data.self = data
+    data.nested.parent = data
+    data.alias = data.nested.a
+    local function check(buf)
+        local v = seri.view(buf)
+        lt.assertIsUserdata(v)
+        lt.assertEquals(v.name, "bee")
+        lt.assertEquals(v.n, 1)
+        lt.assertEquals(v.x, 0.5)
+        lt.assertEquals(v[1.5], "float")
+        lt.assertEquals(v[true], "true")
+        lt.assertEquals(v[1], "first")
+        lt.assertEquals(v[2.0], "second")
+        lt.assertEquals(v[3], nil)
+        lt.assertEquals(v.missing, nil)
+        lt.assertEquals(#v, 2)
+        lt.assertEquals(#v.list, 10)
+        lt.assertEquals(v.list[7], 7)
+        lt.assertEquals(v.list[11], nil)
+        lt.assertEquals(v.mixed[1], "a")
+        lt.assertEquals(v.mixed[2].b, "b")
+        lt.assertEquals(v.mixed[3], false)
+        lt.assertEquals(v.nested.a.b.c, "d")
+        lt.assertEquals(v.self.self.name, "bee")
+        lt.assertEquals(v.nested.parent.name, "bee")
+        lt.assertEquals(v.alias.b.c, "d")
+        lt.assertEquals(v.nested.a(), { b = { c = "d" } })
+        lt.assertEquals(v.list(), data.list)
+        local t = v()
+        lt.assertEquals(t.self, t)
+        lt.assertEquals(t.nested.parent, t)
+        lt.assertEquals(t.alias, t.nested.a)
+        local nested = v.nested()
+        lt.assertEquals(nested.a.b.c, "d")
+        lt.assertEquals(nested.parent.name, "bee")
+    end
+    check(seri.packstring(data))
+    check(seri.pack(data))
+    lt.assertEquals(seri.view(seri.packstring(1, 2)), 1)
+    lt.assertEquals(seri.view(seri.packstring("bee")), "bee")
+    lt.assertEquals(select("#", seri.view(seri.packstring())), 0)
+end
+
+function test_seri:test_function()
+    seri.enable_function(true)
+    local ok, err = pcall(function ()
+        local n = 10
+        local function add(a, b)
+            return a + b + n
+        end
+        local f = seri.unpack(seri.pack(add))
+        lt.assertEquals(f(1, 2), 13)
+        local g = seri.unpack(seri.pack(function (s)
+            return string.format("%s!", s)
+        end))
+        lt.assertEquals(g "bee", "bee!")
+        local function fib(i)
+            if i < 2 then
+                return i
+            end
+            return fib(i - 1) + fib(i - 2)
+        end
+        local h = seri.unpack(seri.pack(fib))
+        lt.assertEquals(h(10), 55)
+        local t = seri.unpack(seri.pack { add = add, list = { add, add } })
+        lt.assertEquals(t.add(0, 0), 10)
+        lt.assertEquals(t.list[1](1, 1), 12)
+        lt.assertEquals(t.list[2](2, 2), 14)
+        lt.assertEquals(seri.unpack(seri.pack(print)), print)
+    end)
+    seri.enable_function(false)
+    lt.assertEquals(ok, true, err)
+    TestErr("Only light C function can be serialized", function () end)
+end
+
+function test_seri:test_userdata()
+    local fs = require "bee.filesystem"
+    local socket = require "bee.socket"
+    local path = seri.unpack(seri.pack(fs.path "a/b/c.lua"))
+    lt.assertEquals(path:string(), "a/b/c.lua")
+    local t = seri.unpack(seri.pack { fs.current_path(), fs.path "" })
+    lt.assertEquals(t[1], fs.current_path())
+    lt.assertEquals(t[2]:string(), "")
+    local ep = socket.endpoint("inet", "127.0.0.1", 8080)
+    lt.assertEquals(seri.unpack(seri.pack(ep)), ep)
+    local fd <close> = socket.create "tcp"
+    lt.assertEquals(fd:bind("127.0.0.1", 0), true)
+    local newfd <close> = seri.unpack(seri.pack(fd))
+    lt.assertEquals(newfd ~= fd, true)
+    lt.assertEquals(newfd:info "socket", fd:info "socket")
+    local buf = seri.packstring(fd)
+    local once <close> = seri.unpack(buf)
+    lt.assertEquals(once:info "socket", fd:info "socket")
+    lt.assertErrorMsgEquals("socket is already unpacked.", seri.unpack, buf)
+    lt.assertEquals(once:close(), true)
+    local handle = fd:handle()
+    lt.assertEquals(seri.unpack(seri.pack(socket.fd(handle, true))):handle(), handle)
+    TestErr("Unsupport type userdata to serialize", io.stdout)
+end
+
+local function isomorphic(a, b, visited)
+    if type(a) ~= type(b) then
+        return false
+    end
+    if type(a) ~= "table" then
+        if a ~= a then
+            return b ~= b
+        end
+        return a == b and math.type(a) == math.type(b)
+    end
+    if visited[a] ~= nil then
+        return visited[a] == b
+    end
+    visited[a] = b
+    for k, v in pairs(a) do
+        if type(k) == "table" or not isomorphic(v, rawget(b, k), visited) then
+            return false
+        end
+    end
+    for k in pairs(b) do
+        if rawget(a, k) == nil then
+            return false
+        end
+    end
+    return true
+end
+
+local function random_value(depth, pool)
+    local r = math.random(1, depth > 0 and 14 or 10)
+    if r == 1 then
+        return math.random(0, 1) == 1
+    elseif r == 2 then
+        return math.random(-0x100, 0x100)
+    elseif r == 3 then
+        local edges = { 0, -1, 0x7fff, 0x8000, 0xffff, 0x10000, 0x7fffffff, -0x80000000, math.maxinteger, math.mininteger }
+        return edges[math.random(1, #edges)]
+    elseif r == 4 then
+        return math.random(math.mininteger, math.maxinteger)
+    elseif r == 5 then
+        local edges = { 0.0, -0.5, 1e308, -1e-308, math.huge, -math.huge, 0/0 }
+        return edges[math.random(1, #edges)]
+    elseif r == 6 then
+        return math.random() * 1e6
+    elseif r == 7 then
+        local lens = { 0, 1, 31, 32, 0xffff, 0x10000 }
+        return ("b"):rep(lens[math.random(1, #lens)])
+    elseif r == 8 then
+        return tostring(math.random(1, 100))
+    elseif r == 9 then
+        return print
+    elseif r == 10 then
+        return #pool > 0 and pool[math.random(1, #pool)] or "ref"
+    elseif r == 11 then
+        local t = {}
+        local n = math.random(0, 40)
+        local kind = math.random(1, 3)
+        for i = 1, n do
+            t[i] = kind == 1 and math.random(0, 0xff) or kind == 2 and math.random() or random_value(depth - 1, pool)
+        end
+        pool[#pool+1] = t
+        return t
+    elseif r == 12 then
+        local t = {}
+        for _ = 1, math.random(0, 10) do
+            local k = math.random(1, 2) == 1 and ("k"..math.random(1, 20)) or math.random(-5, 50)
+            t[k] = random_value(depth - 1, pool)
+        end
+        pool[#pool+1] = t
+        return t
+    elseif r == 13 then
+        local t = { random_value(depth - 1, pool) }
+        t.self = t
+        pool[#pool+1] = t
+        return t
+    else
+        local t = {}
+        for i = 1, math.random(1, 8) do
+            t[i] = random_value(depth - 1, pool)
+        end
+        t.x = random_value(depth - 1, pool)
+        pool[#pool+1] = t
+        return t
+    end
+end
+
+function test_seri:test_fuzz()
+    local _ <close> = lt.randomseed(20231012)
+    for _ = 1, 200 do
+        local pool = {}
+        local n = math.random(0, 4)
+        local data = {}
+        for i = 1, n do
+            data[i] = random_value(math.random(0, 6), pool)
+        end
+        local str = seri.packstring(table.unpack(data, 1, n))
+        local res = table.pack(seri.unpack(str))
+        lt.assertEquals(res.n, n)
+        res.n = nil
+        lt.assertEquals(isomorphic(data, res, {}), true)
+        if n > 0 then
+            lt.assertEquals(isomorphic(data[1], seri.unpack(seri.pack(data[1])), {}), true)
+            local v = seri.view(str)
+            lt.assertEquals(isomorphic(data[1], type(v) == "userdata" and v() or v, {}), true)
+        end
+        for _ = 1, 8 do
+            local pos = math.random(1, #str)
+            local truncated = str:sub(1, pos - 1)
+            local corrupted = truncated..string.char(math.random(0, 255))..str:sub(pos + 1)
+            pcall(seri.unpack, truncated)
+            pcall(seri.unpack, corrupted)
+            pcall(function ()
+                local v = seri.view(corrupted)
+                if type(v) == "userdata" then
+                    return v(), #v, v[1], v.x
+                end
+            end)
+        end
+    end
+end
+
+function test_seri:test_hostile()
+    local function frame(s)
+        return string.pack("<I4", #s)..s
+    end
+    local full = "\x12"
+    local pointer = "\x02"..string.pack("<J", 0x41414141)
+    local cfunction = "\x0A"..string.pack("<J", 0x41414141)
+    lt.assertErrorMsgEquals("Invalid userdata", seri.unpack, frame(full..pointer.."\0"))
+    lt.assertErrorMsgEquals("Invalid userdata", seri.unpack, frame(full..cfunction.."\0"))
+    lt.assertErrorMsgEquals("Invalid userdata", seri.unpack, frame(full.."\x09\xff\0"))
+    lt.assertErrorMsgEquals("Invalid userdata", seri.unpack, frame(full.."\x41"..string.pack("<d", 0).."\0"))
+    lt.assertErrorMsgEquals("Invalid userdata", seri.unpack, frame("\x0D"..full..cfunction.."\0\0"))
+end
@@ -3,6 +3,7 @@ local socket = require "bee.socket"
 local select = require "bee.select"
 local thread = require "bee.thread"
 local fs = require "bee.filesystem"
+local platform = require "bee.platform"
 
 local function simple_select(fd, mode)
     local s <close> = select.create()
@@ -78,6 +79,31 @@ local function syncEcho(from, to, msg)
     lt.assertEquals(syncRecv(to, #msg), msg)
 end
 
+local function tcp_listen(backlog)
+    local server = assert(socket.create "tcp")
+    assert(server:bind("127.0.0.1", 0))
+    assert(server:listen(backlog))
+    local _, port = server:info "socket":value()
+    return server, port
+end
+
+local function tcp_connect(port)
+    local client = assert(socket.create "tcp")
+    client:connect("127.0.0.1", port)
+    simple_select(client, "w")
+    assert(client:status())
+    return client
+end
+
+local function tcp_pair()
+    local server, port = tcp_listen()
+    local client = tcp_connect(port)
+    simple_select(server, "r")
+    local session = assert(server:accept())
+    server:close()
+    return client, session
+end
+
 local test_socket = lt.test "socket"
 
 local TestUnixSock = "test.unixsock"
@@ -206,6 +232,110 @@ function test_socket:test_pair()
     server:close()
 end
 
+function test_socket:test_sendv()
+    local server, client = assert(socket.pair())
+    lt.assertEquals(client:sendv("head", "", "body", 1), 9)
+    lt.assertEquals(syncRecv(server, 9), "headbody1")
+    lt.assertEquals(client:sendv(), 0)
+    lt.assertError(client.sendv, client, "ok", {})
+
+    local parts = {}
+    for i = 1, 100 do
+        parts[i] = ("%03d"):format(i)
+    end
+    lt.assertEquals(client:sendv(table.unpack(parts)), 3 * 64)
+    lt.assertEquals(syncRecv(server, 3 * 64), table.concat(parts, "", 1, 64))
+
+    local big = ("x"):rep(16 * 1024 * 1024)
+    local n, i, off = client:sendv("hdr:", big, "tail")
+    lt.assertIsNumber(n)
+    lt.assertEquals(i, 2)
+    lt.assertEquals(off, n - 4)
+    lt.assertEquals(client:sendv("hdr:", big:sub(off + 1), "tail"), false)
+    client:close()
+    server:close()
+end
+
+function test_socket:test_sendfile()
+    local content = ("0123456789"):rep(10000)
+    local f = assert(io.open("test_sendfile.txt", "wb"))
+    f:write(content)
+    f:close()
+    f = assert(io.open("test_sendfile.txt", "rb"))
+    local client, server = tcp_pair()
+    lt.assertEquals(client:sendfile(f, 0, 0), 0)
+    lt.assertEquals(client:sendfile(f, 5, 10), 10)
+    lt.assertEquals(syncRecv(server, 10), "5678901234")
+    lt.assertEquals(client:sendfile(f, #content, 10), 0)
+    lt.assertError(client.sendfile, client, f, -1, 10)
+    lt.assertError(client.sendfile, client, "file", 0, 10)
+
+    local offset = 0
+    local received = {}
+    while offset < #content do
+        local n = client:sendfile(f, offset, #content - offset)
+        if n then
+            offset = offset + n
+        end
+        local data = server:recv()
+        if data then
+            received[#received + 1] = data
+        end
+    end
+    local rest = #content - #table.concat(received)
+    if rest > 0 then
+        received[#received + 1] = syncRecv(server, rest)
+    end
+    lt.assertEquals(table.concat(received), content)
+    f:close()
+    lt.assertEquals(client:sendfile(f, 0, 10), nil)
+    client:close()
+    server:close()
+    os.remove "test_sendfile.txt"
+end
+
+function test_socket:test_splice()
+    if not socket.splice then
+        return
+    end
+    local a, b = assert(socket.pair())
+    local c, d = assert(socket.pair())
+    lt.assertEquals(socket.splice(b, c), false)
+    lt.assertEquals(a:send "hello", 5)
+    simple_select(b, "r")
+    lt.assertEquals(socket.splice(b, c, 3), 3)
+    lt.assertEquals(socket.splice(b, c), 2)
+    lt.assertEquals(syncRecv(d, 5), "hello")
+
+    local chunk = ("x"):rep(64 * 1024)
+    local total = 1024 * 1024
+    local sent, moved, received = 0, 0, 0
+    while received < total do
+        if sent < total then
+            local n = a:send(chunk:sub(1, total - sent))
+            if n then
+                sent = sent + n
+            end
+        end
+        local n = socket.splice(b, c)
+        if n then
+            moved = moved + n
+        end
+        local data = d:recv(64 * 1024)
+        if data then
+            received = received + #data
+        end
+    end
+    lt.assertEquals(sent, total)
+    lt.assertEquals(moved, total)
+    a:close()
+    simple_select(b, "r")
+    lt.assertEquals(socket.splice(b, c), nil)
+    b:close()
+    c:close()
+    d:close()
+end
+
 local function createEchoThread(name, ...)
     return thread.create(([[
     -- %s
@@ -406,6 +536,63 @@ function test_socket:test_udp()
     b_fd:close()
 end
 
+function test_socket:test_mmsg()
+    local a_fd = lt.assertIsUserdata(socket.create "udp")
+    local b_fd = lt.assertIsUserdata(socket.create "udp")
+    lt.assertEquals(a_fd:bind("127.0.0.1", 0), true)
+    lt.assertEquals(b_fd:bind("127.0.0.1", 0), true)
+    local a_ep = a_fd:info "socket"
+    local b_ep = b_fd:info "socket"
+    lt.assertEquals(b_fd:recvmmsg(8), false)
+    lt.assertEquals(a_fd:sendmmsg({}, b_ep), 0)
+
+    local sent = {}
+    for i = 1, 10 do
+        sent[i] = ("packet%d"):format(i)
+    end
+    sent[3] = ""
+    lt.assertEquals(a_fd:sendmmsg(sent, b_ep), 10)
+    lt.assertEquals(a_fd:sendmmsg({ "x", "y" }, { b_ep, b_ep }), 2)
+    lt.assertError(a_fd.sendmmsg, a_fd, { "x" }, { "ep" })
+    lt.assertError(a_fd.sendmmsg, a_fd, { {} }, b_ep)
+
+    local datas, eps = {}, {}
+    local received = {}
+    while #received < 12 do
+        simple_select(b_fd, "r")
+        local n, d, e = b_fd:recvmmsg(4, nil, datas, eps)
+        if n then
+            lt.assertEquals(d, datas)
+            lt.assertEquals(e, eps)
+            lt.assertEquals(n <= 4, true)
+            for i = 1, n do
+                received[#received + 1] = datas[i]
+                lt.assertEquals(eps[i], a_ep)
+            end
+        end
+    end
+    local ep1 = eps[1]
+    lt.assertEquals(#eps, 4)
+    lt.assertEquals(table.concat(received, ",", 1, 10), table.concat(sent, ","))
+    lt.assertEquals(received[11], "x")
+    lt.assertEquals(received[12], "y")
+
+    lt.assertEquals(a_fd:sendto("again", b_ep), 5)
+    simple_select(b_fd, "r")
+    lt.assertEquals(b_fd:recvmmsg(4, 3, datas, eps), 1)
+    lt.assertEquals(datas[1], "aga")
+    lt.assertEquals(rawequal(eps[1], ep1), true)
+
+    lt.assertEquals(a_fd:sendto("new", b_ep), 3)
+    simple_select(b_fd, "r")
+    local n, d, e = b_fd:recvmmsg(100)
+    lt.assertEquals(n, 1)
+    lt.assertEquals(d[1], "new")
+    lt.assertEquals(e[1], a_ep)
+    a_fd:close()
+    b_fd:close()
+end
+
 function test_socket:test_udp_unreachable()
     local a_fd = lt.assertIsUserdata(socket.create "udp")
     local b_fd = lt.assertIsUserdata(socket.create "udp")
@@ -418,3 +605,416 @@ function test_socket:test_udp_unreachable()
     lt.assertEquals(a_fd:recvfrom(), false)
     a_fd:close()
 end
+
+function test_socket:test_option()
+    local fd <close> = lt.assertIsUserdata(socket.create "tcp")
+    lt.assertEquals(fd:option("nodelay", 1), true)
+    lt.assertEquals(fd:option("keepalive", 1), true)
+    lt.assertError(fd.option, fd, "unknown", 1)
+    if platform.os ~= "windows" then
+        lt.assertEquals(fd:option("reuseport", 1), true)
+        lt.assertEquals(fd:option("keepidle", 30), true)
+        lt.assertEquals(fd:option("keepintvl", 5), true)
+        lt.assertEquals(fd:option("keepcnt", 3), true)
+    end
+    if platform.os == "linux" then
+        lt.assertEquals(fd:option("defer_accept", 1), true)
+    end
+end
+
+if platform.os ~= "windows" then
+    function test_socket:test_listen_shards()
+        local shards = assert(socket.listen_shards("tcp", 2, "127.0.0.1", 0))
+        lt.assertEquals(#shards, 2)
+        local _, port = shards[1]:info "socket":value()
+        lt.assertEquals(port ~= 0, true)
+        local _, port2 = shards[2]:info "socket":value()
+        lt.assertEquals(port2, port)
+        local thd = thread.create([[
+            local listener = ...
+            local socket = require "bee.socket"
+            local select = require "bee.select"
+            local s <close> = select.create()
+            s:event_add(listener, select.SELECT_READ)
+            local accepted = 0
+            while accepted < 1 do
+                for _ in s:wait(5000) do
+                    while true do
+                        local newfd = listener:accept()
+                        if not newfd then
+                            break
+                        end
+                        newfd:close()
+                        accepted = accepted + 1
+                    end
+                end
+            end
+        ]], shards[2])
+        shards[2]:close()
+        -- connections are spread over the shards by hashing the peer address,
+        -- so enough clients reach the worker's listener for it to finish.
+        local clients = {}
+        for i = 1, 64 do
+            local c = assert(socket.create "tcp")
+            c:connect("127.0.0.1", port)
+            clients[i] = c
+        end
+        thread.wait(thd)
+        assertNotThreadError()
+        for _, c in ipairs(clients) do
+            c:close()
+        end
+        shards[1]:close()
+    end
+end
+
+function test_socket:test_accept_many()
+    local server <close>, port = tcp_listen(16)
+    lt.assertEquals(server:accept_many(8), 0)
+    local clients = {}
+    for i = 1, 5 do
+        clients[i] = tcp_connect(port)
+    end
+    simple_select(server, "r")
+    local fds = {}
+    local n, out = server:accept_many(3, fds)
+    lt.assertEquals(n, 3)
+    lt.assertEquals(out, fds)
+    local total = n
+    while total < 5 do
+        simple_select(server, "r")
+        n = server:accept_many(8, fds)
+        total = total + n
+    end
+    lt.assertEquals(total, 5)
+    for _, fd in ipairs(fds) do
+        fd:close()
+    end
+    for _, c in ipairs(clients) do
+        c:close()
+    end
+end
+
+if platform.os ~= "windows" then
+    function test_socket:test_accept_many_epoll()
+        local epoll = require "bee.epoll"
+        local ep <close> = assert(epoll.create(16))
+        local server <close>, port = tcp_listen(16)
+        local clients = {}
+        for i = 1, 4 do
+            clients[i] = tcp_connect(port)
+        end
+        local accepted = {}
+        while #accepted < 4 do
+            simple_select(server, "r")
+            local n, fds = server:accept_many(16, nil, ep, epoll.EPOLLIN)
+            for i = 1, n do
+                accepted[#accepted + 1] = fds[i]
+            end
+        end
+        for i, c in ipairs(clients) do
+            lt.assertEquals(c:send("x" .. i), 2)
+        end
+        local seen = {}
+        local count = 0
+        while count < 4 do
+            for fd in ep:wait(1000) do
+                local data = fd:recv()
+                lt.assertEquals(#data, 2)
+                lt.assertEquals(seen[fd], nil)
+                seen[fd] = true
+                count = count + 1
+            end
+        end
+        for _, fd in ipairs(accepted) do
+            ep:event_del(fd)
+            fd:close()
+        end
+        -- a failed registration closes the fd and ends the batch.
+        local late = tcp_connect(port)
+        simple_select(server, "r")
+        ep:close()
+        local n, fds, err = server:accept_many(16, nil, ep, epoll.EPOLLIN)
+        lt.assertEquals(n, 0)
+        lt.assertEquals(#fds, 0)
+        lt.assertEquals(err, "bad file descriptor")
+        late:close()
+        for _, c in ipairs(clients) do
+            c:close()
+        end
+    end
+end
+
+function test_socket:test_select_many()
+    local count = 600
+    local socks = {}
+    for i = 1, count do
+        local a, b = assert(socket.pair())
+        socks[i] = { a, b }
+    end
+    local s <close> = select.create()
+    for i, p in ipairs(socks) do
+        s:event_add(p[2], select.SELECT_READ, i)
+    end
+    lt.assertEquals(socks[count][1]:send "x", 1)
+    lt.assertEquals(socks[1][1]:send "x", 1)
+    local seen = {}
+    for i, event in s:wait(1000) do
+        lt.assertEquals(event, select.SELECT_READ)
+        seen[#seen + 1] = i
+    end
+    table.sort(seen)
+    lt.assertEquals(seen, { 1, count })
+    s:event_del(socks[1][2])
+    s:event_mod(socks[2][2], select.SELECT_WRITE)
+    seen = {}
+    for i, event in s:wait(1000) do
+        seen[i] = event
+    end
+    lt.assertEquals(seen, { [2] = select.SELECT_WRITE, [count] = select.SELECT_READ })
+    -- removing the fd being handled must not hide the ones after it.
+    local s2 <close> = select.create()
+    for i, p in ipairs(socks) do
+        s2:event_add(p[2], select.SELECT_READ, i)
+    end
+    seen = {}
+    for i in s2:wait(1000) do
+        seen[#seen + 1] = i
+        s2:event_del(socks[i][2])
+    end
+    table.sort(seen)
+    lt.assertEquals(seen, { 1, count })
+    for i in s2:wait(0) do
+        lt.failure("unexpected event for %d", i)
+    end
+    for _, p in ipairs(socks) do
+        p[1]:close()
+        p[2]:close()
+    end
+end
+
+if platform.os ~= "windows" then
+    function test_socket:test_sendfd()
+        local a, b = assert(socket.pair())
+        local c, d = assert(socket.pair())
+        local e, f = assert(socket.pair())
+        lt.assertEquals(b:recvfd(), false)
+        lt.assertError(a.sendfd, a, c, "")
+        lt.assertEquals(a:sendfd({ c, e }, "fds"), 3)
+        lt.assertEquals(a:sendfd(d, "one"), 3)
+        local data, fds = b:recvfd(3)
+        lt.assertEquals(data, "fds")
+        lt.assertEquals(#fds, 2)
+        c:close()
+        e:close()
+        lt.assertEquals(fds[1]:send "via c", 5)
+        lt.assertEquals(fds[2]:send "via e", 5)
+        simple_select(d, "r")
+        lt.assertEquals(d:recv(), "via c")
+        simple_select(f, "r")
+        lt.assertEquals(f:recv(), "via e")
+        fds[1]:close()
+        fds[2]:close()
+        data, fds = b:recvfd()
+        lt.assertEquals(data, "one")
+        lt.assertEquals(#fds, 1)
+        d:close()
+        lt.assertEquals(fds[1]:recv(), nil)
+        lt.assertEquals(b:recvfd(), false)
+        a:close()
+        lt.assertEquals(b:recvfd(), nil)
+        fds[1]:close()
+        b:close()
+        f:close()
+    end
+end
+
+function test_socket:test_stats()
+    local a, b = assert(socket.pair())
+    local zero = {
+        recv_bytes = 0,
+        send_bytes = 0,
+        recv_calls = 0,
+        send_calls = 0,
+        recv_waits = 0,
+        send_waits = 0,
+    }
+    lt.assertEquals(a:stats(), zero)
+    lt.assertEquals(b:recv(), false)
+    lt.assertEquals(a:send "hello", 5)
+    lt.assertEquals(a:sendv("a", "bc"), 3)
+    simple_select(b, "r")
+    lt.assertEquals(b:recv(), "helloabc")
+    lt.assertEquals(a:stats(), {
+        recv_bytes = 0,
+        send_bytes = 8,
+        recv_calls = 0,
+        send_calls = 2,
+        recv_waits = 0,
+        send_waits = 0,
+    })
+    lt.assertEquals(b:stats(), {
+        recv_bytes = 8,
+        send_bytes = 0,
+        recv_calls = 2,
+        send_calls = 0,
+        recv_waits = 1,
+        send_waits = 0,
+    })
+    local view = socket.fd(a:handle(), true)
+    lt.assertEquals(view:stats(), zero)
+    local handle = a:detach()
+    local a2 = socket.fd(handle)
+    lt.assertEquals(a2:stats(), zero)
+    lt.assertEquals(a2:send "x", 1)
+    lt.assertEquals(a2:stats().send_bytes, 1)
+    a2:close()
+    b:close()
+    local c, d = assert(socket.pair())
+    lt.assertEquals(c:stats(), zero)
+    lt.assertEquals(d:stats(), zero)
+    c:close()
+    d:close()
+end
+
+function test_socket:test_tcpinfo()
+    local client, session = tcp_pair()
+    if platform.os ~= "linux" then
+        lt.assertEquals(client:tcpinfo(), nil)
+        client:close()
+        session:close()
+        return
+    end
+    lt.assertEquals(client:send "hello", 5)
+    simple_select(session, "r")
+    local info = assert(session:tcpinfo())
+    lt.assertEquals(info.recvq, 5)
+    lt.assertEquals(info.sendq, 0)
+    lt.assertEquals(info.mss > 0, true)
+    lt.assertEquals(info.cwnd > 0, true)
+    lt.assertEquals(math.type(info.rtt), "integer")
+    lt.assertEquals(math.type(info.rttvar), "integer")
+    lt.assertEquals(math.type(info.retransmits), "integer")
+    lt.assertEquals(math.type(info.unacked), "integer")
+    lt.assertEquals(math.type(info.inflight), "integer")
+    local a, b = assert(socket.pair())
+    lt.assertEquals(a:tcpinfo(), nil)
+    a:close()
+    b:close()
+    session:close()
+    client:close()
+end
+
+function test_socket:test_cork()
+    local client, session = tcp_pair()
+    if platform.os == "windows" then
+        lt.assertEquals(client:cork(), nil)
+    else
+        lt.assertEquals(client:cork(), true)
+        lt.assertEquals(client:send "a", 1)
+        lt.assertEquals(client:send "b", 1)
+        lt.assertEquals(client:uncork(), true)
+        local data = ""
+        while #data < 2 do
+            simple_select(session, "r")
+            data = data .. session:recv()
+        end
+        lt.assertEquals(data, "ab")
+    end
+    client:close()
+    session:close()
+end
+
+if platform.os == "linux" then
+    function test_socket:test_zerocopy()
+        local client, session = tcp_pair()
+        lt.assertError(client.send_zc, client, "x")
+        if not client:zerocopy() then
+            client:close()
+            session:close()
+            return
+        end
+        local big = ("z"):rep(256 * 1024)
+        lt.assertEquals(client:send_zc "small", 5)
+        local sent = 0
+        local received = 0
+        while sent < #big or received < #big + 5 do
+            if sent < #big then
+                local n = client:send_zc(big, sent)
+                if n then
+                    sent = sent + n
+                end
+            end
+            local data = session:recv(65536)
+            if data then
+                received = received + #data
+            elseif sent == #big then
+                simple_select(session, "r")
+            end
+        end
+        local done, pending, copied = 0, nil, nil
+        for _ = 1, 100 do
+            local n, p, c = client:reap_zc()
+            done = done + n
+            pending = p
+            copied = c
+            if pending == 0 then
+                break
+            end
+            thread.sleep(10)
+        end
+        lt.assertEquals(pending, 0)
+        lt.assertEquals(done > 0, true)
+        lt.assertEquals(type(copied), "boolean")
+        local _, _, _, errors = client:reap_zc()
+        lt.assertEquals(errors, nil)
+        client:close()
+        session:close()
+    end
+
+    function test_socket:test_zerocopy_linger()
+        local epoll = require "bee.epoll"
+        local client, session = tcp_pair()
+        if not client:zerocopy() then
+            client:close()
+            session:close()
+            return
+        end
+        local ep <close> = epoll.create(16)
+        assert(ep:event_add(client, epoll.EPOLLIN))
+        -- fill the connection, so the completions wait for the peer.
+        local big = ("z"):rep(64 * 1024)
+        local sent = 0
+        while true do
+            local n = client:send_zc(big)
+            if not n then
+                break
+            end
+            sent = sent + n
+        end
+        big = nil
+        client:close()
+        collectgarbage()
+        -- the socket stays open until its completions are reaped by the
+        -- epoll loop, whose events for it are not reported.
+        local received = 0
+        local eof = false
+        for _ = 1, 1000 do
+            for _ in ep:wait(0) do
+                lt.failure "event reported for a closed socket"
+            end
+            local data = session:recv(65536)
+            if data == nil then
+                eof = true
+                break
+            elseif data then
+                received = received + #data
+            else
+                thread.sleep(1)
+            end
+        end
+        lt.assertEquals(eof, true)
+        lt.assertEquals(received, sent)
+        session:close()
+    end
+end
@@ -0,0 +1,205 @@
+local lt = require "ltest"
+local socket = require "bee.socket"
+local stream = require "bee.stream"
+local m = lt.test "stream"
+
+local function pair()
+    local a, b = assert(socket.pair())
+    return a, b, stream.create(a), stream.create(b)
+end
+
+function m.test_readline()
+    local a, b, sa, sb = pair()
+    lt.assertEquals(sb:readline(), false)
+    lt.assertEquals(a:send "hello\nwor", 9)
+    lt.assertEquals(sb:readline(), "hello")
+    lt.assertEquals(sb:readline(), false)
+    lt.assertEquals(sb:buffered(), 3)
+    lt.assertEquals(a:send "ld\r\n\nlast", 9)
+    lt.assertEquals(sb:readline(true), "world\r\n")
+    lt.assertEquals(sb:readline(), "")
+    lt.assertEquals(sb:readline(), false)
+    a:close()
+    lt.assertEquals(sb:readline(), "last")
+    lt.assertEquals(sb:readline(), nil)
+    b:close()
+    lt.assertError(sb.readline, sb)
+    lt.assertEquals(sa:fd(), a)
+end
+
+function m.test_readline_limit()
+    local a, b, _, sb = pair()
+    lt.assertEquals(a:send "hello world\n", 12)
+    lt.assertErrorMsgEquals("line too large (11 bytes)", sb.readline, sb, false, 10)
+    lt.assertEquals(sb:buffered(), 12)
+    lt.assertEquals(sb:readline(false, 11), "hello world")
+    lt.assertEquals(a:send "no newline", 10)
+    lt.assertErrorMsgEquals("line too large (10 bytes)", sb.readline, sb, false, 4)
+    lt.assertEquals(sb:buffered(), 10)
+    a:close()
+    b:close()
+end
+
+function m.test_read()
+    local a, b, sa, sb = pair()
+    lt.assertEquals(sb:read(4), false)
+    lt.assertEquals(sb:read(), false)
+    lt.assertEquals(a:send "abcdefg", 7)
+    lt.assertEquals(sb:read(4), "abcd")
+    lt.assertEquals(sb:read(4), false)
+    lt.assertEquals(sb:read(0), "")
+    lt.assertEquals(sb:read(), "efg")
+    lt.assertEquals(a:send "xyz", 3)
+    a:close()
+    lt.assertEquals(sb:read(5), "xyz")
+    lt.assertEquals(sb:read(5), nil)
+    b:close()
+end
+
+function m.test_frame()
+    local a, b, sa, sb = pair()
+    for _, lenbytes in ipairs { 1, 2, 4 } do
+        lt.assertEquals(sa:write_frame(lenbytes, "hello"), true)
+        lt.assertEquals(sa:write_frame(lenbytes, ""), true)
+        lt.assertEquals(sa:flush(), true)
+        lt.assertEquals(sb:read_frame(lenbytes), "hello")
+        lt.assertEquals(sb:read_frame(lenbytes), "")
+        lt.assertEquals(sb:read_frame(lenbytes), false)
+    end
+    lt.assertError(sa.write_frame, sa, 1, ("x"):rep(256))
+    lt.assertError(sa.write_frame, sa, 3, "x")
+    lt.assertEquals(a:send "\0\0\0\5he", 6)
+    lt.assertEquals(sb:read_frame(4), false)
+    lt.assertEquals(a:send "llo\0\0", 5)
+    lt.assertEquals(sb:read_frame(4), "hello")
+    lt.assertEquals(sb:read_frame(4), false)
+    a:close()
+    lt.assertEquals(sb:read_frame(4), nil)
+    b:close()
+end
+
+function m.test_frame_limit()
+    local a, b, _, sb = pair()
+    lt.assertEquals(a:send "\0\0\0\16", 4)
+    lt.assertErrorMsgEquals("frame too large (16 bytes)", sb.read_frame, sb, 4, 15)
+    lt.assertEquals(sb:buffered(), 4)
+    a:close()
+    b:close()
+    a, b, _, sb = pair()
+    lt.assertEquals(a:send "\127\255\255\255", 4)
+    lt.assertErrorMsgEquals("frame too large (2147483647 bytes)", sb.read_frame, sb, 4)
+    lt.assertEquals(sb:buffered(), 4)
+    a:close()
+    b:close()
+end
+
+function m.test_write()
+    local a, b, sa, sb = pair()
+    lt.assertEquals(sa:write("a", "b", "c\n"), true)
+    lt.assertEquals(sa:pending(), 4)
+    lt.assertEquals(sb:readline(), false)
+    lt.assertEquals(sa:flush(), true)
+    lt.assertEquals(sa:pending(), 0)
+    lt.assertEquals(sb:readline(), "abc")
+    local chunk = ("x"):rep(65536)
+    local n = 0
+    while true do
+        sa:write(chunk)
+        n = n + #chunk
+        if sa:flush() == false then
+            break
+        end
+    end
+    local pending = sa:pending()
+    lt.assertEquals(pending > 0, true)
+    local received = 0
+    while received < n do
+        local data = sb:read()
+        if data then
+            received = received + #data
+        end
+        sa:flush()
+    end
+    lt.assertEquals(received, n)
+    lt.assertEquals(sa:pending(), 0)
+    a:close()
+    b:close()
+end
+
+function m.test_large_frame()
+    local a, b, sa, sb = pair()
+    local data = ("0123456789"):rep(100000)
+    sa:write_frame(4, data)
+    local frame
+    repeat
+        sa:flush()
+        frame = sb:read_frame(4)
+    until frame
+    lt.assertEquals(frame, data)
+    a:close()
+    b:close()
+end
+
+function m.test_msg()
+    local a, b, sa, sb = pair()
+    lt.assertEquals(sb:recv_msg(), false)
+    lt.assertEquals(sa:send_msg(1, "two", { 3, x = { y = true } }), true)
+    lt.assertEquals(sa:send_msg(), true)
+    lt.assertEquals(sa:send_msg(nil, 2.5, nil), true)
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 4, true, 1, "two", { 3, x = { y = true } } })
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 1, true })
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 4, true, nil, 2.5, nil })
+    lt.assertEquals(sb:recv_msg(), false)
+    lt.assertError(sa.send_msg, sa, function() end)
+    local big = ("x"):rep(1000000)
+    sa:send_msg(big, #big)
+    local ok, data, len
+    repeat
+        sa:flush()
+        ok, data, len = sb:recv_msg()
+    until ok
+    lt.assertEquals(len, #big)
+    lt.assertEquals(data, big)
+    a:close()
+    lt.assertEquals(sb:recv_msg(), nil)
+    b:close()
+end
+
+function m.test_msg_untrusted()
+    local a, b, sa, sb = pair()
+    local serialization = require "bee.serialization"
+    lt.assertEquals(sa:send_msg(print), true)
+    lt.assertErrorMsgEquals("Userdata can't be deserialized", sb.recv_msg, sb)
+    lt.assertEquals(sa:send_msg(serialization.lightuserdata(sa)), true)
+    lt.assertErrorMsgEquals("Userdata can't be deserialized", sb.recv_msg, sb)
+    lt.assertEquals(sa:send_msg(require "bee.filesystem".path "a"), true)
+    lt.assertErrorMsgEquals("Userdata can't be deserialized", sb.recv_msg, sb)
+    lt.assertEquals(sa:send_msg(1, { "two" }), true)
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 3, true, 1, { "two" } })
+    lt.assertEquals(sa:send_msg(("x"):rep(100)), true)
+    lt.assertErrorMsgEquals("message too large (103 bytes)", sb.recv_msg, sb, 64)
+    a:close()
+    b:close()
+    a, b, _, sb = pair()
+    lt.assertEquals(a:send "\255\255\255\127", 4)
+    lt.assertErrorMsgEquals("message too large (2147483647 bytes)", sb.recv_msg, sb)
+    lt.assertEquals(sb:buffered(), 4)
+    a:close()
+    b:close()
+end
+
+function m.test_msg_partial()
+    local a, b, sa, sb = pair()
+    local serialization = require "bee.serialization"
+    local msg = serialization.packstring("hello", 42)
+    lt.assertEquals(a:send(msg:sub(1, 3)), 3)
+    lt.assertEquals(sb:recv_msg(), false)
+    lt.assertEquals(a:send(msg:sub(4, 10)), 7)
+    lt.assertEquals(sb:recv_msg(), false)
+    lt.assertEquals(a:send(msg:sub(11) .. msg), #msg - 10 + #msg)
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 3, true, "hello", 42 })
+    lt.assertEquals(table.pack(sb:recv_msg()), { n = 3, true, "hello", 42 })
+    lt.assertEquals(sb:recv_msg(), false)
+    a:close()
+    b:close()
+end
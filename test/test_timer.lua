@@ -0,0 +1,174 @@
+local lt = require "ltest"
+local timer = require "bee.timer"
+local m = lt.test "timer"
+
+local function fire(t, now)
+    local n, ids = t:update(now)
+    local r = {}
+    for i = 1, n do
+        r[ids[i]] = true
+    end
+    return n, r
+end
+
+function m.test_basic()
+    local t <close> = timer.create(1000)
+    lt.assertEquals(t:now(), 1000)
+    lt.assertEquals(t:next(), -1)
+    lt.assertEquals(#t, 0)
+    local a = t:add(10)
+    local b = t:add(20)
+    local c = t:add(20)
+    lt.assertEquals(#t, 3)
+    lt.assertEquals(t:next(), 10)
+    lt.assertEquals(fire(t, 1009), 0)
+    lt.assertEquals(t:next(), 1)
+    local n, r = fire(t, 1010)
+    lt.assertEquals(n, 1)
+    lt.assertEquals(r[a], true)
+    lt.assertEquals(t:cancel(a), false)
+    lt.assertEquals(t:cancel(b), true)
+    lt.assertEquals(t:cancel(b), false)
+    n, r = fire(t, 5000)
+    lt.assertEquals(n, 1)
+    lt.assertEquals(r[c], true)
+    lt.assertEquals(t:now(), 5000)
+    lt.assertEquals(#t, 0)
+    lt.assertEquals(t:next(), -1)
+    lt.assertError(t.add, t, -1)
+end
+
+function m.test_zero()
+    local t <close> = timer.create(0)
+    local a = t:add(0)
+    lt.assertEquals(t:next(), 1)
+    local n, r = fire(t, 0)
+    lt.assertEquals(n, 0)
+    n, r = fire(t, 1)
+    lt.assertEquals(n, 1)
+    lt.assertEquals(r[a], true)
+end
+
+function m.test_reuse_id()
+    local t <close> = timer.create(0)
+    local a = t:add(5)
+    lt.assertEquals(t:cancel(a), true)
+    local b = t:add(5)
+    lt.assertNotEquals(a, b)
+    lt.assertEquals(t:cancel(a), false)
+    lt.assertEquals(#t, 1)
+    local ids = {}
+    local n, out = t:update(5, ids)
+    lt.assertEquals(n, 1)
+    lt.assertEquals(out, ids)
+    lt.assertEquals(ids[1], b)
+end
+
+function m.test_cascade()
+    local t <close> = timer.create(123)
+    local timeouts = { 1, 255, 256, 257, 1000, 16383, 16384, 20000, 1048576, 5000000, 300000000 }
+    local ids = {}
+    for i, timeout in ipairs(timeouts) do
+        ids[t:add(timeout)] = 123 + timeout
+    end
+    local fired = 0
+    local now = 123
+    while #t > 0 do
+        local next = t:next()
+        lt.assertEquals(next > 0, true)
+        now = now + next
+        local n, r = fire(t, now)
+        for id in pairs(r) do
+            lt.assertEquals(ids[id], now)
+            fired = fired + 1
+        end
+        lt.assertEquals(n >= 0, true)
+    end
+    lt.assertEquals(fired, #timeouts)
+end
+
+function m.test_next_wraparound()
+    -- the timer lands in the upper slot of the current block, one rotation
+    -- later; next() must not report it as due on every tick.
+    for _, case in ipairs { { 9, 16383 }, { 300, 16300 }, { 9, 1048500 }, { 70000, 1048575 } } do
+        local start, timeout = case[1], case[2]
+        local t <close> = timer.create(start)
+        local id = t:add(timeout)
+        local now = start
+        local steps = 0
+        while #t > 0 do
+            local next = t:next()
+            lt.assertEquals(next > 0, true)
+            lt.assertEquals(now + next <= start + timeout, true)
+            now = now + next
+            steps = steps + 1
+            local n, r = fire(t, now)
+            if n > 0 then
+                lt.assertEquals(r[id], true)
+            end
+        end
+        lt.assertEquals(now, start + timeout)
+        lt.assertEquals(steps <= 5, true)
+    end
+end
+
+function m.test_random()
+    local t <close> = timer.create(0)
+    local rand = math.random
+    local _ <close> = lt.randomseed(20231012)
+    local expire = {}
+    local now = 0
+    for _ = 1, 200 do
+        for _ = 1, 50 do
+            local timeout = rand(0, 3) == 0 and rand(0, 100000) or rand(0, 300)
+            expire[t:add(timeout)] = now + timeout
+        end
+        for id in pairs(expire) do
+            if rand(0, 20) == 0 then
+                lt.assertEquals(t:cancel(id), true)
+                expire[id] = nil
+            end
+        end
+        now = now + rand(0, 500)
+        local n, ids = t:update(now)
+        for i = 1, n do
+            local id = ids[i]
+            lt.assertEquals(expire[id] ~= nil, true)
+            lt.assertEquals(expire[id] <= now, true)
+            expire[id] = nil
+        end
+        for _, e in pairs(expire) do
+            lt.assertEquals(e > now, true)
+        end
+    end
+end
+
+if timer.create(0).fd then
+    function m.test_timerfd()
+        local epoll = require "bee.epoll"
+        local time = require "bee.time"
+        local ep <close> = assert(epoll.create(4))
+        local t <close> = timer.create(time.monotonic())
+        local fd = assert(t:fd())
+        assert(ep:event_add(fd, epoll.EPOLLIN, "timer"))
+        for _ in ep:wait(0) do
+            lt.assertEquals(true, false)
+        end
+        local id = t:add(20)
+        local start = time.monotonic()
+        local woke = false
+        for obj in ep:wait(1000) do
+            lt.assertEquals(obj, "timer")
+            woke = true
+        end
+        lt.assertEquals(woke, true)
+        lt.assertEquals(time.monotonic() - start >= 10, true)
+        local n, ids = t:update(time.monotonic())
+        lt.assertEquals(n, 1)
+        lt.assertEquals(ids[1], id)
+        for _ in ep:wait(0) do
+            lt.assertEquals(true, false)
+        end
+        assert(ep:event_del(fd))
+    end
+end
@@ -0,0 +1,135 @@
+local lt = require "ltest"
+local uring = require "bee.uring"
+local socket = require "bee.socket"
+local time = require "bee.time"
+local m = lt.test "uring"
+
+local function collect(ring, count)
+    local results = {}
+    local n = 0
+    local deadline = time.monotonic() + 5000
+    while n < count do
+        assert(time.monotonic() < deadline, "timeout")
+        for token, res, err in assert(ring:wait(100)) do
+            results[token] = { res, err }
+            n = n + 1
+        end
+    end
+    return results
+end
+
+local function listener()
+    local fd = assert(socket.create "tcp")
+    assert(fd:bind("127.0.0.1", 0))
+    assert(fd:listen())
+    local ep = assert(fd:info "socket")
+    return fd, ep
+end
+
+local function test_backend(backend)
+    local ring <close> = assert(uring.create(16, backend))
+    if backend == "epoll" then
+        lt.assertEquals(ring:backend(), "epoll")
+    else
+        local name = ring:backend()
+        lt.assertEquals(name == "io_uring" or name == "epoll", true)
+    end
+
+    local server <close>, ep = listener()
+    local client <close> = assert(socket.create "tcp")
+    lt.assertEquals(ring:accept(server, "accept"), true)
+    lt.assertEquals(ring:connect(client, ep, "connect"), true)
+    local r = collect(ring, 2)
+    lt.assertEquals(r.connect[1], true)
+    local session <close> = r.accept[1]
+    lt.assertIsUserdata(session)
+
+    lt.assertEquals(ring:recv(session, 64, "recv"), true)
+    lt.assertEquals(ring:send(client, "hello", "send"), true)
+    r = collect(ring, 2)
+    lt.assertEquals(r.send[1], 5)
+    lt.assertEquals(r.recv[1], "hello")
+
+    lt.assertEquals(ring:recv(session, 64), true)
+    lt.assertEquals(ring:recv(client, 64), true)
+    lt.assertEquals(ring:send(session, "world", "send"), true)
+    r = collect(ring, 2)
+    lt.assertEquals(r[client][1], "world")
+    lt.assertEquals(r.send[1], 5)
+
+    client:close()
+    r = collect(ring, 1)
+    lt.assertEquals(r[session][1], nil)
+    lt.assertEquals(r[session][2], nil)
+
+    local refused <close> = assert(socket.create "tcp")
+    local closed <close>, closed_ep = listener()
+    closed:close()
+    lt.assertEquals(ring:connect(refused, closed_ep, "refused"), true)
+    r = collect(ring, 1)
+    lt.assertEquals(r.refused[1], nil)
+    lt.assertIsString(r.refused[2])
+
+    for _ in ring:wait(0) do
+        lt.assertEquals(true, false)
+    end
+    lt.assertEquals(ring:close(), true)
+    lt.assertError(ring.wait, ring, 0)
+end
+
+function m.test_create()
+    lt.assertFailed("entries is less than or equal to zero.", uring.create(0))
+    lt.assertError(uring.create, 16, "select")
+    local ring <close> = assert(uring.create(1))
+    local server <close> = listener()
+    lt.assertEquals(ring:accept(server), true)
+    lt.assertFailed("Too many operations.", ring:accept(server))
+end
+
+function m.test_io_uring()
+    test_backend "io_uring"
+end
+
+function m.test_epoll()
+    test_backend "epoll"
+end
+
+function m.test_close_pending()
+    for _, backend in ipairs { "io_uring", "epoll" } do
+        local a, b = assert(socket.pair())
+        local ring = assert(uring.create(4, backend))
+        lt.assertEquals(ring:recv(a, 64), true)
+        for _ in ring:wait(0) do
+            lt.assertEquals(true, false)
+        end
+        -- the pending recv is cancelled, not left to consume later data.
+        lt.assertEquals(ring:close(), true)
+        lt.assertEquals(b:send "late", 4)
+        local data
+        local deadline = time.monotonic() + 5000
+        repeat
+            assert(time.monotonic() < deadline, "timeout")
+            data = a:recv()
+        until data
+        lt.assertEquals(data, "late")
+        a:close()
+        b:close()
+    end
+end
+
+function m.test_close_full()
+    -- the cancels do not fit next to the unsubmitted recvs in the queue.
+    local socks = {}
+    local ring = assert(uring.create(4))
+    for i = 1, 4 do
+        local a, b = assert(socket.pair())
+        socks[i] = { a, b }
+        lt.assertEquals(ring:recv(a, 64), true)
+    end
+    lt.assertEquals(ring:close(), true)
+    for _, p in ipairs(socks) do
+        lt.assertEquals(p[2]:send "x", 1)
+        p[1]:close()
+        p[2]:close()
+    end
+end